@@ -168,16 +168,12 @@
 		}
 
 		if (wasm) {
-			window.Module = {};
-			fetch("/assets/wasm/main.wasm").then(function (res) {
-				return res.arrayBuffer();
-			}).then(function (bytes) {
-				// TODO: Parallel downloads of main.js and main.wasm
-				var script = document.createElement('script');
-				script.src = "/assets/wasm/main.js";
-				Module.wasmBinary = bytes;
-				document.head.appendChild(script);
-			});
+			// The module runs in a worker and fetches main.wasm itself. The
+			// DOM side of brunhild applies its DOM mutations and performs all
+			// other main thread operations for it.
+			loadScript("wasm/brunhild").onload = function () {
+				brunhild.connect(new Worker("/assets/wasm/main.js"));
+			};
 		} else {
 			loadScript("js/main").onload = function () {
 				require("main");
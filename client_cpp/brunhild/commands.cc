@@ -0,0 +1,36 @@
+#include "commands.hh"
+
+namespace brunhild {
+
+void detach_commands(
+    const uint8_t* buf, size_t size, std::vector<uint8_t>& out)
+{
+    out.reserve(out.size() + size);
+    for (size_t i = 0; i < size;) {
+        const auto op = Op(buf[i]);
+        out.push_back(buf[i++]);
+        for (int j = operand_count(op); j; j--) {
+            uint32_t len = 0;
+            for (int k = 0; k < 4; k++) {
+                len |= uint32_t(buf[i++]) << (k * 8);
+            }
+            const uint8_t* s = buf + i;
+            if (len & string_ref_flag) {
+                len &= ~string_ref_flag;
+                uintptr_t p = 0;
+                for (size_t k = 0; k < sizeof(p); k++) {
+                    p |= uintptr_t(buf[i++]) << (k * 8);
+                }
+                s = reinterpret_cast<const uint8_t*>(p);
+            } else {
+                i += len;
+            }
+
+            for (int k = 0; k < 4; k++) {
+                out.push_back(uint8_t(len >> (k * 8)));
+            }
+            out.insert(out.end(), s, s + len);
+        }
+    }
+}
+}
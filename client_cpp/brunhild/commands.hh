@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace brunhild {
+
+// Opcodes of the serialized DOM mutation command buffer produced by flush().
+// Each command is an opcode byte followed by its string operands. Strings are
+// encoded as a little-endian uint32 byte length followed by the UTF-8 bytes
+// without a null terminator. If the length has string_ref_flag set, the bytes
+// are not inlined and the length is followed by a little-endian pointer of
+// sizeof(void*) bytes to them instead.
+// All commands, but select, apply to the element selected by the last select
+// command. Commands for an element missing from the DOM are ignored.
+enum class Op : uint8_t {
+    select, // id
+    before, // html
+    after, // html
+    remove,
+    set_outer_html, // html
+    set_inner_html, // html
+    append, // html
+    prepend, // html
+    move_prepend, // child_id
+    move_after, // child_id
+    set_attr, // key, value
+    remove_attr, // key
+    scroll_into_view,
+    insert_child_after, // sibling_id or empty for first child, html
+    move_child_after, // sibling_id or empty for first child, child_id
+};
+
+// Set on the length of strings passed by reference
+const uint32_t string_ref_flag = uint32_t(1) << 31;
+
+// Returns the number of string operands of an opcode
+inline int operand_count(Op op)
+{
+    switch (op) {
+    case Op::remove:
+    case Op::scroll_into_view:
+        return 0;
+    case Op::set_attr:
+    case Op::insert_child_after:
+    case Op::move_child_after:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+// Append a copy of a command buffer to out with all strings passed by
+// reference inlined. The copy does not point into this module's memory, so it
+// can be applied by another thread or WASM instance.
+void detach_commands(
+    const uint8_t* buf, size_t size, std::vector<uint8_t>& out);
+
+// Receives the command buffer of each flush and applies it to a DOM
+class DOMSink {
+public:
+    virtual ~DOMSink() = default;
+
+    // Apply a buffer of serialized commands. The buffer is only valid for the
+    // duration of the call.
+    virtual void apply(const uint8_t* buf, size_t size) = 0;
+
+    // Report, which elements are at least partially inside the viewport. buf
+    // contains only select commands. Set out[i] to 1 for each visible element
+    // of the i-th command. out is zeroed by the caller, so the default
+    // implementation reports no elements as visible.
+    virtual void on_screen(const uint8_t* buf, size_t size, uint8_t* out) {}
+};
+}
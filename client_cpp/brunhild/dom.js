@@ -0,0 +1,748 @@
+// DOM side of brunhild. Applies serialized mutation command buffers,
+// delegates DOM events to handlers registered from WASM, reports the
+// viewports of watched elements and performs all other operations on the
+// main thread's globals, like localStorage, history and location.
+//
+// Prepended to the module with --pre-js. If the module runs in a Web Worker,
+// this script must also be loaded on the main thread and passed the worker
+// with brunhild.connect(). The main thread then sends a snapshot of the state
+// the module reads synchronously and keeps it up to date. The module does not
+// start before the snapshot arrives. The worker posts command buffers, handler
+// registrations and main thread operations to the main thread, which applies
+// them and posts matched events and viewport measurements back. Both sides
+// apply the same command stream.
+var brunhild = (function() {
+    var inWorker = typeof document === 'undefined';
+    var decoder = new TextDecoder('utf-8');
+
+    // Worker connected to the main thread, if any
+    var worker = null;
+
+    // Registered event handlers pooled by event type. Unscoped handlers are
+    // stored as {id: selector} and scoped ones as {scope: {id: selector}}.
+    var handlers = {};
+
+    // Address and capacity of the WASM buffer IDs of matched handlers are
+    // written to
+    var matchedPtr = 0;
+    var maxMatched = 0;
+
+    // IDs of handlers matched by the current event. Reused between events.
+    var matched = [];
+
+    function parseHTML(html)
+    {
+        var cont = document.createElement('div');
+        cont.innerHTML = html;
+        return cont.firstChild;
+    }
+
+    // Apply the commands in buf[start:end]. Strings passed by reference must
+    // point into buf. Opcodes must be kept in sync with Op in commands.hh.
+    function apply(buf, start, end)
+    {
+        var i = start;
+
+        function readUint32()
+        {
+            var n = (buf[i] | (buf[i + 1] << 8) | (buf[i + 2] << 16)
+                        | (buf[i + 3] << 24))
+                >>> 0;
+            i += 4;
+            return n;
+        }
+
+        function readString()
+        {
+            var len = readUint32();
+            if (len & 0x80000000) {
+                // Reference to a string elsewhere in linear memory
+                var p = readUint32();
+                return decoder.decode(buf.subarray(p, p + (len & 0x7fffffff)));
+            }
+            var s = decoder.decode(buf.subarray(i, i + len));
+            i += len;
+            return s;
+        }
+
+        // Element all following commands apply to. Commands for a missing
+        // element must still be read, but are otherwise ignored.
+        var el = null;
+        var s, key;
+        while (i < end) {
+            switch (buf[i++]) {
+            case 0: // select
+                el = document.getElementById(readString());
+                break;
+            case 1: // before
+                s = readString();
+                if (el) {
+                    el.parentNode.insertBefore(parseHTML(s), el);
+                }
+                break;
+            case 2: // after
+                s = readString();
+                if (el) {
+                    el.parentNode.insertBefore(parseHTML(s), el.nextSibling);
+                }
+                break;
+            case 3: // remove
+                if (el) {
+                    el.parentNode.removeChild(el);
+                }
+                break;
+            case 4: // set_outer_html
+                s = readString();
+                if (el) {
+                    el.outerHTML = s;
+                }
+                break;
+            case 5: // set_inner_html
+                s = readString();
+                if (el) {
+                    el.innerHTML = s;
+                }
+                break;
+            case 6: // append
+                s = readString();
+                if (el) {
+                    el.appendChild(parseHTML(s));
+                }
+                break;
+            case 7: // prepend
+                s = readString();
+                if (el) {
+                    el.insertBefore(parseHTML(s), el.firstChild);
+                }
+                break;
+            case 8: // move_prepend
+                s = readString();
+                if (el) {
+                    el.insertBefore(document.getElementById(s), el.firstChild);
+                }
+                break;
+            case 9: // move_after
+                s = readString();
+                if (el) {
+                    el.parentNode.insertBefore(
+                        document.getElementById(s), el.nextSibling);
+                }
+                break;
+            case 10: // set_attr
+                key = readString();
+                s = readString();
+                if (el) {
+                    el.setAttribute(key, s);
+                }
+                break;
+            case 11: // remove_attr
+                s = readString();
+                if (el) {
+                    el.removeAttribute(s);
+                }
+                break;
+            case 12: // scroll_into_view
+                if (el) {
+                    el.scrollIntoView();
+                }
+                break;
+            case 13: // insert_child_after
+                key = readString();
+                s = readString();
+                if (el) {
+                    el.insertBefore(parseHTML(s),
+                        key ? document.getElementById(key).nextSibling
+                            : el.firstChild);
+                }
+                break;
+            case 14: // move_child_after
+                key = readString();
+                s = readString();
+                if (el) {
+                    el.insertBefore(document.getElementById(s),
+                        key ? document.getElementById(key).nextSibling
+                            : el.firstChild);
+                }
+                break;
+            }
+        }
+    }
+
+    // Post a copy of a detached command buffer in buf[start:end] to the main
+    // thread
+    function post(buf, start, end)
+    {
+        var copy = buf.slice(start, end);
+        postMessage({ bh : 'apply', buf : copy.buffer }, [ copy.buffer ]);
+    }
+
+    // Set buf[out + n] to 1 for the n-th element of the select commands in
+    // buf[start:end], that is at least partially inside the viewport.
+    // Layout is not accessible from a worker, so no elements are reported
+    // there.
+    function onScreen(buf, start, end, out)
+    {
+        if (inWorker) {
+            return;
+        }
+        var h = window.innerHeight;
+        var w = window.innerWidth;
+        for (var i = start, n = out; i < end; n++) {
+            i++; // select
+            var len = (buf[i] | (buf[i + 1] << 8) | (buf[i + 2] << 16)
+                          | (buf[i + 3] << 24))
+                >>> 0;
+            i += 4;
+            var el = document.getElementById(
+                decoder.decode(buf.subarray(i, i + len)));
+            i += len;
+            if (el) {
+                var r = el.getBoundingClientRect();
+                buf[n] = r.bottom > 0 && r.top < h && r.right > 0 && r.left < w;
+            }
+        }
+    }
+
+    // Elements, whose viewport is reported to WASM, by watcher ID
+    var watched = {};
+
+    // A viewport measurement is scheduled for the next frame
+    var measurePending = false;
+
+    // Scroll and resize listeners are registered
+    var watchingViewport = false;
+
+    // Measure the viewports of all watched elements on the next frame
+    function scheduleMeasure()
+    {
+        if (measurePending) {
+            return;
+        }
+        measurePending = true;
+        requestAnimationFrame(function() {
+            measurePending = false;
+            measureViewports();
+        });
+    }
+
+    // Report the viewport offset and child heights of each watched element,
+    // that is in the DOM
+    function measureViewports()
+    {
+        var h = window.innerHeight;
+        for (var id in watched) {
+            var el = document.getElementById(watched[id]);
+            if (!el) {
+                continue;
+            }
+
+            // Distance between the tops of consecutive children, so margins
+            // are included
+            var ch = el.children;
+            var heights = new Array(ch.length);
+            for (var i = 0; i < ch.length; i++) {
+                heights[i] = i + 1 < ch.length
+                    ? ch[i + 1].offsetTop - ch[i].offsetTop
+                    : ch[i].offsetHeight;
+            }
+            var top = -el.getBoundingClientRect().top | 0;
+            if (worker) {
+                worker.postMessage({
+                    bh : 'viewport',
+                    id : +id,
+                    top : top,
+                    height : h,
+                    heights : heights
+                });
+            } else {
+                dispatchViewport(+id, top, h, heights);
+            }
+        }
+    }
+
+    // Pass a viewport measurement to WASM
+    function dispatchViewport(id, top, height, heights)
+    {
+        var buf = Module._viewport_buffer(heights.length) >> 2;
+        for (var i = 0; i < heights.length; i++) {
+            HEAP32[buf + i] = heights[i];
+        }
+        Module._dispatch_viewport(id, top, height);
+    }
+
+    // Report the viewport of the element with ID el to the viewport handler
+    // with watcher ID id on the next frame and each frame with scrolling or
+    // resizing
+    function watchViewport(id, el)
+    {
+        if (inWorker) {
+            postMessage({ bh : 'watchViewport', id : id, el : el });
+            return;
+        }
+
+        watched[id] = el;
+        if (!watchingViewport) {
+            watchingViewport = true;
+            window.addEventListener('scroll', scheduleMeasure, { passive : true });
+            window.addEventListener('resize', scheduleMeasure, { passive : true });
+        }
+        scheduleMeasure();
+    }
+
+    // Stop reporting the viewport to a handler by watcher ID
+    function unwatchViewport(id)
+    {
+        if (inWorker) {
+            postMessage({ bh : 'unwatchViewport', id : id });
+            return;
+        }
+        delete watched[id];
+    }
+
+    // Pass an event, the properties extracted from it and the IDs of its
+    // matched handlers to WASM. IDs not fitting the WASM buffer are
+    // dispatched in further batches. e is null inside a worker.
+    function dispatch(e, d, ids)
+    {
+        if (ids.length > maxMatched) {
+            // Handlers can dispatch nested events, that reuse the array
+            ids = ids.slice();
+        }
+        var buf = matchedPtr >> 2;
+        for (var start = 0; start < ids.length; start += maxMatched) {
+            var n = Math.min(ids.length - start, maxMatched);
+            for (var i = 0; i < n; i++) {
+                HEAP32[buf + i] = ids[start + i];
+            }
+            Module._dispatch_event(e, d.type, d.targetId, d.dataId,
+                d.modifiers, d.button, d.x, d.y, d.value, d.name, d.checked,
+                d.href, d.path, n);
+        }
+    }
+
+    // Match an event against the handlers of its type and dispatch it, if
+    // any matched
+    function onEvent(e, type, h)
+    {
+        var t = e.target;
+        if (!t.tagName) { // Not an element
+            return;
+        }
+
+        matched.length = 0;
+        function match(set)
+        {
+            for (var id in set) {
+                if (!set[id] || t.matches(set[id])) {
+                    matched.push(+id);
+                }
+            }
+        }
+
+        // Only the scopes of the target and its ancestors can match
+        var path = '';
+        for (var el = t; el; el = el.parentElement) {
+            if (el.id) {
+                path += (path ? ' ' : '') + el.id;
+                if (h.scoped[el.id]) {
+                    match(h.scoped[el.id]);
+                }
+            }
+        }
+        match(h.global);
+        if (!matched.length) {
+            return;
+        }
+
+        // Event objects can not be passed to a worker, so everything handlers
+        // commonly need is extracted here
+        var d = {
+            type : type,
+            targetId : t.id,
+            dataId : t.getAttribute('data-id') || '',
+            modifiers : (e.shiftKey ? 1 : 0) | (e.ctrlKey ? 2 : 0)
+                | (e.altKey ? 4 : 0) | (e.metaKey ? 8 : 0),
+            button : e.button | 0,
+            x : e.clientX | 0,
+            y : e.clientY | 0,
+            value : typeof t.value === 'string' ? t.value : '',
+            name : t.getAttribute('name') || '',
+            checked : !!t.checked,
+            href : typeof t.href === 'string' ? t.href : '',
+            path : path
+        };
+        if (worker) {
+            worker.postMessage({ bh : 'event', event : d, ids : matched });
+        } else {
+            dispatch(e, d, matched);
+        }
+    }
+
+    // Register an event handler by ID. ptr and max set the buffer matched
+    // handler IDs are written to.
+    function listen(type, id, sel, scope, ptr, max)
+    {
+        if (ptr) {
+            matchedPtr = ptr;
+            maxMatched = max;
+        }
+        if (inWorker) {
+            postMessage(
+                { bh : 'listen', type : type, id : id, sel : sel, scope : scope });
+            return;
+        }
+
+        var h = handlers[type];
+        if (!h) {
+            h = handlers[type] = { global : {}, scoped : {} };
+            document.addEventListener(type,
+                function(e) { onEvent(e, type, h); }, { passive : true });
+        }
+        if (scope) {
+            if (!h.scoped[scope]) {
+                h.scoped[scope] = {};
+            }
+            h.scoped[scope][id] = sel;
+        } else {
+            h.global[id] = sel;
+        }
+    }
+
+    // Unregister an event handler by ID. Not removing the document listener
+    // completely, as that would require tracking handler functions.
+    function unlisten(type, id, scope)
+    {
+        if (inWorker) {
+            postMessage({ bh : 'unlisten', type : type, id : id, scope : scope });
+            return;
+        }
+
+        var h = handlers[type];
+        if (!h) {
+            return;
+        }
+        if (!scope) {
+            delete h.global[id];
+            return;
+        }
+        var set = h.scoped[scope];
+        if (!set) {
+            return;
+        }
+        delete set[id];
+        for (var _ in set) {
+            return;
+        }
+        delete h.scoped[scope];
+    }
+
+    // State of the main thread, that the module reads synchronously. Inside
+    // a worker it is sent by the main thread on connection and kept up to
+    // date by it.
+    var env = null;
+
+    // Returns the parts of a URL the module reads
+    function parseLocation(href)
+    {
+        var u = new URL(href);
+        return {
+            href : u.href,
+            origin : u.origin,
+            protocol : u.protocol,
+            host : u.host,
+            search : u.search,
+            hash : u.hash
+        };
+    }
+
+    // Returns a snapshot of the main thread's state. Embedded JSON data
+    // elements are included, as a worker can not read the document.
+    function snapshot()
+    {
+        var storage = {};
+        for (var i = 0; i < localStorage.length; i++) {
+            var key = localStorage.key(i);
+            storage[key] = localStorage.getItem(key);
+        }
+        var data = {};
+        var els = document.querySelectorAll('script[type="application/json"]');
+        for (var i = 0; i < els.length; i++) {
+            if (els[i].id) {
+                data[els[i].id] = els[i].textContent;
+            }
+        }
+        return {
+            location : parseLocation(location.href),
+            innerHeight : window.innerHeight,
+            hidden : !!document.hidden,
+            storage : storage,
+            data : data
+        };
+    }
+
+    // Returns the current page location
+    function getLocation()
+    {
+        return inWorker ? env.location : parseLocation(location.href);
+    }
+
+    // Returns the height of the viewport in pixels
+    function innerHeight()
+    {
+        return inWorker ? env.innerHeight : window.innerHeight;
+    }
+
+    // Returns, if the page is hidden
+    function isHidden()
+    {
+        return inWorker ? env.hidden : !!document.hidden;
+    }
+
+    // Returns the value of a localStorage key or null
+    function getStorage(key)
+    {
+        if (inWorker) {
+            return env.storage.hasOwnProperty(key) ? env.storage[key] : null;
+        }
+        return localStorage.getItem(key);
+    }
+
+    // Returns the contents of an embedded JSON data element by ID or null
+    function pageData(id)
+    {
+        if (inWorker) {
+            return env.data.hasOwnProperty(id) ? env.data[id] : null;
+        }
+        var el = document.getElementById(id);
+        return el ? el.textContent : null;
+    }
+
+    // Call an exported function of the module. From the main thread of a
+    // module running in a worker, the call is posted to the worker.
+    function callModule(name, args)
+    {
+        if (worker) {
+            worker.postMessage({ bh : 'call', name : name, args : args });
+        } else {
+            Module[name].apply(null, args);
+        }
+    }
+
+    // Send the parts of the main thread's state in diff to the worker
+    function updateEnv(diff)
+    {
+        if (worker) {
+            worker.postMessage({ bh : 'env', diff : diff });
+        }
+    }
+
+    // Operations, that can only be performed on the main thread. Called
+    // through call().
+    var services = {
+        setStorage : function(key, val) { localStorage.setItem(key, val); },
+        pushState : function(url)
+        {
+            history.pushState(null, null, url);
+            updateEnv({ location : parseLocation(location.href) });
+        },
+        setHash : function(hash)
+        {
+            location.hash = hash;
+            updateEnv({ location : parseLocation(location.href) });
+        },
+        reload : function() { location.reload(true); },
+        alert : function(msg) { alert(msg); },
+
+        // Click the first element matching sel inside the element with ID id
+        click : function(id, sel)
+        {
+            var el = document.getElementById(id);
+            if (el && (el = el.querySelector(sel))) {
+                el.click();
+            }
+        },
+
+        // Block the browser's default navigation on link clicks and form
+        // submission, unless the user intends to open a new tab or a browser
+        // menu, and restore scroll positions manually, so the module can
+        // handle navigation itself
+        takeOverNavigation : function()
+        {
+            history.scrollRestoration = 'manual';
+            document.addEventListener('click', function(e) {
+                if (e.which != 1 || e.ctrlKey) {
+                    return;
+                }
+                var t = e.target;
+                switch (t.tagName) {
+                case 'A':
+                    if (t.getAttribute('target') == '_blank'
+                        || t.getAttribute('download')) {
+                        return;
+                    }
+                case 'IMG':
+                    e.preventDefault();
+                }
+            });
+            document.addEventListener(
+                'submit', function(e) { e.preventDefault(); });
+        },
+
+        // Call the exported function fn of the module, when an event of type
+        // is fired on window or document, as set by target
+        listenGlobal : function(target, type, fn)
+        {
+            (target == 'document' ? document : window)
+                .addEventListener(type, function() { callModule(fn, []); },
+                    { passive : true });
+        }
+    };
+
+    // Perform a main thread operation from services. Inside a worker the
+    // operation is posted to the main thread.
+    function call(name, args)
+    {
+        if (!inWorker) {
+            services[name].apply(null, args);
+            return;
+        }
+
+        // Keep the worker's copy of the main thread's state up to date, so
+        // the module reads its own changes
+        switch (name) {
+        case 'setStorage':
+            env.storage[args[0]] = args[1];
+            break;
+        case 'pushState':
+            env.location = parseLocation(new URL(args[0], env.location.href));
+            break;
+        case 'setHash':
+            var u = new URL(env.location.href);
+            u.hash = args[0];
+            env.location = parseLocation(u.href);
+            break;
+        }
+        postMessage({ bh : 'call', name : name, args : args });
+    }
+
+    // Apply command buffers and handler registrations posted by a worker
+    // running the module and forward matched events to it
+    function connect(w)
+    {
+        worker = w;
+        w.postMessage({ bh : 'init', env : snapshot() });
+
+        // Keep the worker's copy of the main thread's state up to date
+        function onLocation()
+        {
+            updateEnv({ location : parseLocation(location.href) });
+        }
+        window.addEventListener('popstate', onLocation);
+        window.addEventListener('hashchange', onLocation);
+        window.addEventListener('resize',
+            function() { updateEnv({ innerHeight : window.innerHeight }); },
+            { passive : true });
+        document.addEventListener('visibilitychange',
+            function() { updateEnv({ hidden : !!document.hidden }); });
+        window.addEventListener('storage', function(e) {
+            if (e.key !== null) {
+                w.postMessage(
+                    { bh : 'storage', key : e.key, val : e.newValue });
+            }
+        });
+
+        w.addEventListener('message', function(e) {
+            var d = e.data;
+            if (!d || !d.bh) {
+                return;
+            }
+            switch (d.bh) {
+            case 'apply':
+                var buf = new Uint8Array(d.buf);
+                apply(buf, 0, buf.length);
+                break;
+            case 'listen':
+                listen(d.type, d.id, d.sel, d.scope, 0, 0);
+                break;
+            case 'unlisten':
+                unlisten(d.type, d.id, d.scope);
+                break;
+            case 'watchViewport':
+                watchViewport(d.id, d.el);
+                break;
+            case 'unwatchViewport':
+                unwatchViewport(d.id);
+                break;
+            case 'call':
+                services[d.name].apply(null, d.args);
+                break;
+            }
+        });
+    }
+
+    if (inWorker && typeof addEventListener === 'function') {
+        // The module must not run, before the main thread's state arrives
+        var waiting = false;
+        Module.preRun = [].concat(Module.preRun || [], function() {
+            if (!env) {
+                waiting = true;
+                addRunDependency('brunhild');
+            }
+        });
+
+        addEventListener('message', function(e) {
+            var d = e.data;
+            if (!d) {
+                return;
+            }
+            switch (d.bh) {
+            case 'init':
+                env = d.env;
+                if (waiting) {
+                    waiting = false;
+                    removeRunDependency('brunhild');
+                }
+                break;
+            case 'env':
+                for (var key in d.diff) {
+                    env[key] = d.diff[key];
+                }
+                break;
+            case 'storage':
+                if (d.val === null) {
+                    delete env.storage[d.key];
+                } else {
+                    env.storage[d.key] = d.val;
+                }
+                break;
+            case 'call':
+                Module[d.name].apply(null, d.args);
+                break;
+            case 'event':
+                dispatch(null, d.event, d.ids);
+                break;
+            case 'viewport':
+                dispatchViewport(d.id, d.top, d.height, d.heights);
+                break;
+            }
+        });
+    }
+
+    return {
+        inWorker : inWorker,
+        apply : apply,
+        post : post,
+        onScreen : onScreen,
+        watchViewport : watchViewport,
+        unwatchViewport : unwatchViewport,
+        location : getLocation,
+        innerHeight : innerHeight,
+        isHidden : isHidden,
+        getStorage : getStorage,
+        pageData : pageData,
+        call : call,
+        listen : listen,
+        unlisten : unlisten,
+        connect : connect,
+    };
+})();
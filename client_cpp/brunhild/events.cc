@@ -1,108 +1,101 @@
 #include "events.hh"
+#include <algorithm>
 #include <emscripten.h>
-#include <map>
+#include <emscripten/bind.h>
+#include <stdint.h>
 #include <unordered_map>
 
 using std::string;
 
 namespace brunhild {
 
-// used to identify event handler targets
-typedef std::pair<std::string, std::string> Key;
-
-struct pairhash {
-public:
-    template <typename T, typename U>
-    std::size_t operator()(const std::pair<T, U>& x) const
-    {
-        return std::hash<T>()(x.first) ^ (std::hash<U>()(x.second) << 1);
-    }
+struct Registration {
+    string type, scope;
+    Handler handler;
 };
 
-// All registered event handlers
-static std::unordered_map<Key, std::unordered_map<long, Handler>, pairhash>
-    handlers;
+// All registered event handlers by ID
+static std::unordered_map<long, Registration> handlers;
 
 static long id_counter = 0;
 
-long register_handler(string type, Handler handler, string selector)
-{
-    const Key key = { type, selector };
+// IDs of the handlers matched by an event are written here by the global
+// listeners in dom.js, so they can be passed into WASM without allocating.
+// Events matching more handlers are dispatched in batches of max_matched.
+static const int max_matched = 64;
+static int32_t matched[max_matched];
 
-    if (!handlers.count(key)) {
-        EM_ASM_INT(
-            {
-                var type = UTF8ToString($0);
-                var sel = UTF8ToString($1);
-
-                if (!window.__bh_handlers) {
-                    window.__bh_handlers = {};
-                }
+long register_handler(
+    string type, Handler handler, string selector, string scope)
+{
+    const long id = id_counter++;
+    EM_ASM(
+        {
+            brunhild.listen(UTF8ToString($0), $3, UTF8ToString($1),
+                UTF8ToString($2), $4, $5);
+        },
+        type.c_str(), selector.c_str(), scope.c_str(), id, matched,
+        max_matched);
 
-                // Pool event handlers of one event type together
-                if (!window.__bh_handlers[type]) {
-                    window.__bh_handlers[type] = {};
-                    document.addEventListener(type,
-                        function(e) {
-                            var t = e.target;
-                            if (!t.tagName) { // Not an element
-                                return;
-                            }
+    handlers[id] = { std::move(type), std::move(scope), std::move(handler) };
+    return id;
+}
 
-                            for (var sel in window.__bh_handlers[type]) {
-                                if (!sel || t.matches(sel)) {
-                                    Module._run_event_handlers(type, sel, e);
-                                }
-                            }
-                        },
-                        { passive : true });
-                }
-                window.__bh_handlers[type][sel] = true;
-            },
-            type.c_str(), selector.c_str());
+void unregister_handler(long id)
+{
+    auto it = handlers.find(id);
+    if (it == handlers.end()) {
+        return;
     }
 
-    const long id = id_counter++;
-    handlers[key][id] = handler;
-    return id;
+    EM_ASM({ brunhild.unlisten(UTF8ToString($0), $1, UTF8ToString($2)); },
+        it->second.type.c_str(), id, it->second.scope.c_str());
+    handlers.erase(it);
 }
 
-void unregister_handler(long id)
+bool Event::is_inside(std::string_view id) const
 {
-    for (auto & [ key, h_set ] : handlers) {
-        for (auto[h_id, _] : h_set) {
-            if (h_id == id) {
-                h_set.erase(h_id);
-                if (h_set.empty()) {
-                    // Not removing global listener completely, as that would
-                    // require tracking handler functions
-                    EM_ASM_INT(
-                        {
-                            delete window.__bh_handlers[UTF8ToString($0)]
-                                                       [UTF8ToString($1)];
-                        },
-                        key.first.c_str(), key.second.c_str());
-                }
-                return;
-            }
+    std::string_view p = path;
+    while (p.size()) {
+        const auto i = p.find(' ');
+        if (p.substr(0, i) == id) {
+            return true;
+        }
+        if (i == std::string_view::npos) {
+            break;
         }
+        p = p.substr(i + 1);
     }
+    return false;
 }
 
-static void run_event_handlers(string type, string sel, emscripten::val event)
+static void dispatch_event(emscripten::val raw, string type, string target_id,
+    string data_id, unsigned modifiers, int button, int x, int y, string value,
+    string name, bool checked, string href, string path, int count)
 {
-    const Key key = { type, sel };
-    if (!handlers.count(key)) {
-        return;
-    }
-    auto copy = handlers.at(key); // Handler might invalidate this iterator
-    for (auto & [ id, h ] : copy) {
+    // Handlers can dispatch nested events, that overwrite the matched buffer
+    int32_t ids[max_matched];
+    std::copy(matched, matched + count, ids);
+
+    const Event event = { std::move(type), std::move(target_id),
+        std::move(data_id), modifiers, button, x, y, std::move(value),
+        std::move(name), checked, std::move(href), std::move(path),
+        std::move(raw) };
+    for (int i = 0; i < count; i++) {
+        // Earlier handlers might have unregistered this one
+        auto it = handlers.find(ids[i]);
+        if (it == handlers.end()) {
+            continue;
+        }
+
+        // Handler might unregister itself and destroy its own function
+        auto h = it->second.handler;
         h(event);
     }
 }
 
 EMSCRIPTEN_BINDINGS(module_events)
 {
-    emscripten::function("_run_event_handlers", &run_event_handlers);
+    emscripten::function("_dispatch_event", &dispatch_event);
 }
 }
@@ -1,22 +1,73 @@
 #pragma once
 
 #include "node.hh"
-#include <emscripten/bind.h>
+#include <emscripten/val.h>
 #include <functional>
 #include <string>
+#include <string_view>
 
 namespace brunhild {
 
-// Handles a captured event and receives the passed Event object as the only
-// argument
-typedef std::function<void(emscripten::val&)> Handler;
+// Modifier keys held during an event. Bitmask values of Event::modifiers.
+enum Modifier : unsigned {
+    shift_key = 1,
+    ctrl_key = 1 << 1,
+    alt_key = 1 << 2,
+    meta_key = 1 << 3,
+};
+
+// DOM event with its commonly used properties extracted in the same call into
+// WASM, that dispatched it
+struct Event {
+    // DOM event type (click, hover, ...)
+    std::string type;
+
+    // "id" and "data-id" attributes of the event target. Empty, if not set.
+    std::string target_id, data_id;
+
+    // Bitmask of held Modifier keys
+    unsigned modifiers = 0;
+
+    // Pressed mouse button for mouse events
+    int button = 0;
+
+    // Coordinates of mouse events relative to the viewport
+    int x = 0, y = 0;
+
+    // Value, "name" attribute and checked state of input elements
+    std::string value, name;
+    bool checked = false;
+
+    // Resolved URL of link targets
+    std::string href;
+
+    // Space-separated IDs of the target and its ancestors, innermost first.
+    // Only elements with an ID are included.
+    std::string path;
+
+    // Underlying Event object for reading any other properties. Null, if the
+    // module runs in a worker.
+    emscripten::val raw;
+
+    // Returns, if the target is the element with the passed ID or one of its
+    // descendants
+    bool is_inside(std::string_view id) const;
+};
+
+// Handles a captured event
+typedef std::function<void(const Event&)> Handler;
 
 // Register a persistent global event handler.
 // type: DOM event type (click, hover, ...).
-// selector: any CSS selector the event target should be matched against
+// selector: any CSS selector the event target should be matched against.
+// Empty selector matches any target.
+// scope: ID of an element. If set, the handler is only run for events on this
+// element and its descendants. Handlers of one scope are only tested against
+// events inside it, so registering many scoped handlers does not slow down
+// dispatch of unrelated events.
 // Returns handler ID
-long register_handler(
-    std::string type, Handler handler, std::string selector = "");
+long register_handler(std::string type, Handler handler,
+    std::string selector = "", std::string scope = "");
 
 // Remove a global event handler by ID
 void unregister_handler(long id);
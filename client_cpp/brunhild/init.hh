@@ -1,6 +1,6 @@
 #pragma once
 
 namespace brunhild {
-// Initializes brunhild and starts the main loop
+// Initializes brunhild and requests the first frame
 void init();
 }
@@ -0,0 +1,196 @@
+#include "mutation_queue.hh"
+#include <functional>
+
+namespace brunhild {
+
+ElementMutations::ElementMutations(StrRef id)
+    : id(id)
+{
+    head.fill(none);
+    tail.fill(none);
+}
+
+void ElementMutations::clear(ListKind kind)
+{
+    head[size_t(kind)] = none;
+    tail[size_t(kind)] = none;
+}
+
+void ElementMutations::free_inner()
+{
+    clear(ListKind::append);
+    clear(ListKind::prepend);
+    clear(ListKind::children);
+    clear(ListKind::move_prepend);
+    clear(ListKind::move_after);
+    has_inner_html = false;
+}
+
+void ElementMutations::free_outer()
+{
+    free_inner();
+    clear(ListKind::set_attr);
+    clear(ListKind::remove_attr);
+    has_outer_html = false;
+}
+
+MutationQueue::MutationQueue()
+{
+    strings.reserve(1 << 12);
+    elements.reserve(64);
+    records.reserve(256);
+    index.resize(128);
+}
+
+uint32_t MutationQueue::intern(std::string_view id)
+{
+    const size_t mask = index.size() - 1;
+    for (size_t i = std::hash<std::string_view>()(id) & mask;;
+         i = (i + 1) & mask) {
+        auto& slot = index[i];
+        if (slot.gen != generation) {
+            const uint32_t el = add_element(id);
+            slot = { generation, el };
+
+            // Keep load factor under 1/2
+            if (elements.size() << 1 > index.size()) {
+                grow();
+            }
+            return el;
+        }
+        if (str(elements[slot.el].id) == id) {
+            // Applied mutations can not be merged into anymore. Order the
+            // new set after all mutations accessed so far.
+            if (elements[slot.el].done) {
+                slot.el = add_element(id);
+                if (elements.size() << 1 > index.size()) {
+                    grow();
+                }
+                // Index might have been rehashed
+                return elements.size() - 1;
+            }
+            return slot.el;
+        }
+    }
+}
+
+uint32_t MutationQueue::add_element(std::string_view id)
+{
+    elements.emplace_back(store(id));
+    pending++;
+    return elements.size() - 1;
+}
+
+void MutationQueue::mark_done(uint32_t el)
+{
+    auto& e = elements[el];
+    if (e.done) {
+        return;
+    }
+    e.done = true;
+    pending--;
+    for (auto r : { e.set_inner_html, e.set_outer_html }) {
+        if (r.owned) {
+            std::string().swap(owned[r.offset]);
+        }
+    }
+}
+
+void MutationQueue::grow()
+{
+    index.assign(index.size() << 1, {});
+    generation = 1;
+    const size_t mask = index.size() - 1;
+    for (uint32_t el = 0; el < elements.size(); el++) {
+        if (elements[el].done) {
+            continue;
+        }
+        size_t i = std::hash<std::string_view>()(str(elements[el].id)) & mask;
+        while (index[i].gen == generation) {
+            i = (i + 1) & mask;
+        }
+        index[i] = { generation, el };
+    }
+}
+
+StrRef MutationQueue::store(std::string_view s)
+{
+    const StrRef r = { uint32_t(strings.size()), uint32_t(s.size()) };
+    strings += s;
+    return r;
+}
+
+StrRef MutationQueue::adopt(std::string&& s)
+{
+    const StrRef r = { uint32_t(owned.size()), uint32_t(s.size()), true };
+    owned.push_back(std::move(s));
+    return r;
+}
+
+MutationRecord& MutationQueue::push(
+    uint32_t el, ListKind kind, StrRef arg, StrRef val)
+{
+    const uint32_t i = records.size();
+    records.push_back({ arg, val });
+
+    auto& e = elements[el];
+    const auto k = size_t(kind);
+    if (e.tail[k] == ElementMutations::none) {
+        e.head[k] = i;
+    } else {
+        records[e.tail[k]].next = i;
+    }
+    e.tail[k] = i;
+    return records[i];
+}
+
+bool MutationQueue::remove(uint32_t el, ListKind kind, std::string_view arg)
+{
+    auto& e = elements[el];
+    const auto k = size_t(kind);
+    bool removed = false;
+    uint32_t prev = ElementMutations::none;
+    for (auto i = e.head[k]; i != ElementMutations::none;
+         i = records[i].next) {
+        if (str(records[i].arg) != arg) {
+            prev = i;
+            continue;
+        }
+        removed = true;
+        if (prev == ElementMutations::none) {
+            e.head[k] = records[i].next;
+        } else {
+            records[prev].next = records[i].next;
+        }
+        if (e.tail[k] == i) {
+            e.tail[k] = prev;
+        }
+    }
+    return removed;
+}
+
+MutationRecord* MutationQueue::find(
+    uint32_t el, ListKind kind, std::string_view arg)
+{
+    for (auto i = elements[el].head[size_t(kind)];
+         i != ElementMutations::none; i = records[i].next) {
+        if (str(records[i].arg) == arg) {
+            return &records[i];
+        }
+    }
+    return nullptr;
+}
+
+void MutationQueue::clear()
+{
+    strings.clear();
+    owned.clear();
+    elements.clear();
+    records.clear();
+    pending = 0;
+    if (++generation == 0) { // Wrapped around
+        index.assign(index.size(), {});
+        generation = 1;
+    }
+}
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <array>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace brunhild {
+
+// Reference to a string stored in MutationQueue's string arena or, if owned,
+// to a string the queue took ownership of
+struct StrRef {
+    uint32_t offset = 0, size = 0;
+
+    // offset is an index into the owned strings instead of the arena
+    bool owned = false;
+};
+
+// Kinds of mutation lists an element can have buffered. Ordered by execution
+// order.
+enum class ListKind : uint8_t {
+    before,
+    after,
+    append,
+    prepend,
+    children,
+    move_prepend,
+    move_after,
+    set_attr,
+    remove_attr,
+    _count,
+};
+
+// Pending mutations for an element
+struct ElementMutations {
+    // No record index
+    static constexpr uint32_t none = uint32_t(-1);
+
+    StrRef id;
+    bool remove_el = false, scroll_into_view = false, has_inner_html = false,
+         has_outer_html = false;
+
+    // Mutations were already applied in an earlier slice of a flush split
+    // across frames. Further mutations of the element get a new set.
+    bool done = false;
+    StrRef set_inner_html, set_outer_html;
+
+    // First and last record indices of each mutation list
+    std::array<uint32_t, size_t(ListKind::_count)> head, tail;
+
+    ElementMutations(StrRef id);
+
+    // Clear mutations of element inner content
+    void free_inner();
+
+    // Clear mutations of element inner and outer content
+    void free_outer();
+
+    // Clear a mutation list
+    void clear(ListKind kind);
+};
+
+// Single buffered mutation, that is a node of one of the element's mutation
+// lists
+struct MutationRecord {
+    // Operands. val is only used by set_attr and the children list.
+    StrRef arg, val;
+
+    // Record of the children list moves an existing child instead of
+    // inserting HTML
+    bool is_move = false;
+
+    // Index of the next record in the list
+    uint32_t next = ElementMutations::none;
+};
+
+// Insertion-ordered queue of pending DOM mutations grouped by element.
+// Element IDs are interned to integer indices and all strings and records are
+// stored in contiguous arenas, that are reset, but not deallocated, on clear().
+// This makes buffering mutations allocation-free in the steady state.
+class MutationQueue {
+public:
+    MutationQueue();
+
+    // Returns the index of the mutation set of the element, creating it on
+    // first access. Mutation sets are ordered by first access.
+    uint32_t intern(std::string_view id);
+
+    // Returns a mutation set by index. The reference is invalidated by the
+    // next call to intern().
+    ElementMutations& operator[](uint32_t i) { return elements[i]; }
+
+    // Returns mutation sets ordered by first access, including ones already
+    // marked done
+    const std::vector<ElementMutations>& all() const { return elements; }
+
+    // Returns, if there are no mutation sets, that are not done
+    bool empty() const { return !pending; }
+
+    // Returns the number of mutation sets, that are not done
+    size_t pending_count() const { return pending; }
+
+    // Mark a mutation set as applied and free its owned strings. The memory
+    // of the arenas is only reclaimed by clear().
+    void mark_done(uint32_t el);
+
+    // Copy a string into the arena
+    StrRef store(std::string_view s);
+
+    // Take ownership of a string without copying it. Used for large HTML
+    // strings.
+    StrRef adopt(std::string&& s);
+
+    // Returns a view into the arena. Invalidated by the next store() call.
+    std::string_view str(StrRef r) const
+    {
+        if (r.owned) {
+            return owned[r.offset];
+        }
+        return std::string_view(strings.data() + r.offset, r.size);
+    }
+
+    // Append a record to one of the element's mutation lists
+    // Returns the pushed record.
+    MutationRecord& push(
+        uint32_t el, ListKind kind, StrRef arg, StrRef val = {});
+
+    // Remove all records of the element's list with an argument equal to arg.
+    // Returns, if any records were removed.
+    bool remove(uint32_t el, ListKind kind, std::string_view arg);
+
+    // Find the first record of the element's list with an argument equal to
+    // arg. Returns NULL, if none.
+    MutationRecord* find(uint32_t el, ListKind kind, std::string_view arg);
+
+    // Run fn on each record of the element's mutation list in insertion order
+    template <class F>
+    void for_each(const ElementMutations& el, ListKind kind, F fn) const
+    {
+        for (auto i = el.head[size_t(kind)]; i != ElementMutations::none;
+             i = records[i].next) {
+            fn(records[i]);
+        }
+    }
+
+    // Reset the queue, but keep all allocated memory for reuse. Owned strings
+    // are freed.
+    void clear();
+
+private:
+    // Arena for IDs, HTML and attribute strings
+    std::string strings;
+
+    // Strings passed by adopt()
+    std::vector<std::string> owned;
+
+    // Mutation sets in first access order
+    std::vector<ElementMutations> elements;
+
+    // Number of mutation sets, that are not done
+    size_t pending = 0;
+
+    // Arena for list records
+    std::vector<MutationRecord> records;
+
+    // Open addressing hash table of element indices. Slots are only valid, if
+    // their generation matches the queue's current one, which makes clearing
+    // the table O(1).
+    struct Slot {
+        uint32_t gen = 0, el = 0;
+    };
+    std::vector<Slot> index;
+    uint32_t generation = 1;
+
+    // Append a new mutation set for an element and return its index
+    uint32_t add_element(std::string_view id);
+
+    // Double index capacity and rehash all elements, that are not done
+    void grow();
+};
+}
@@ -1,271 +1,382 @@
 #include "mutations.hh"
+#include "mutation_queue.hh"
+#include <algorithm>
 #include <emscripten.h>
-#include <optional>
-#include <unordered_map>
-#include <unordered_set>
+#include <stdint.h>
 #include <vector>
 
 namespace brunhild {
-using std::string;
-
-// Pending mutations for an element
-struct Mutations {
-    bool remove_el = false, scroll_into_view = false;
-    std::optional<std::string> set_inner_html, set_outer_html;
-    std::vector<std::string> append, prepend, before, after, move_prepend,
-        move_after;
-    std::unordered_set<std::string> remove_attr;
-    std::unordered_map<std::string, std::string> set_attr;
-
-    // Clear mutations of element inner content to free up memory
-    void free_inner();
-
-    // Clear mutations of element inner and outer content to free up memory
-    void free_outer();
-
-    // Execute buffered mutations
-    void exec(const std::string& id);
-};
+using std::string_view;
 
 void (*before_flush)() = nullptr;
 void (*after_flush)() = nullptr;
 
-// TODO: Should probably use some smarter data structure, that maintains both
-// mutation set insertion order and is searchable by string
+// All pending mutations in element first access order. Keeping the order
+// makes sure new children are not manipulated before insertion.
+static MutationQueue queue;
 
-// All pending mutations quickly accessible by element ID
-static std::unordered_map<string, Mutations> mutations;
+static bool frame_requested = false;
+double frame_budget = 8;
 
-// Stores mutation order, so we can somewhat make sure, new children are not
-// manipulated, before insertion
-static std::vector<std::string> mutation_order;
+// Returns the index of an element's mutation set and requests a frame to
+// apply it
+static uint32_t intern(string_view id)
+{
+    request_frame();
+    return queue.intern(id);
+}
 
-// Fetches a mutation set by element ID or creates a new one ond registers
-// its execution order
-static Mutations* get_mutation_set(string id)
+// Push a string argument to one of an element's mutation lists
+static void push(string_view id, ListKind kind, string_view arg)
 {
-    if (!mutations.count(id)) {
-        mutation_order.push_back(id);
-    }
-    return &mutations[id];
+    const auto el = intern(id);
+    queue.push(el, kind, queue.store(arg));
 }
 
-void append(string id, string html)
+void append(string_view id, string_view html)
 {
-    get_mutation_set(id)->append.push_back(html);
+    push(id, ListKind::append, html);
 }
 
-void prepend(string id, string html)
+void prepend(string_view id, string_view html)
 {
-    get_mutation_set(id)->prepend.push_back(html);
+    push(id, ListKind::prepend, html);
 }
 
-void before(string id, string html)
+void insert_child_after(
+    string_view parent_id, string_view sibling_id, string_view html)
 {
-    get_mutation_set(id)->before.push_back(html);
+    const auto el = intern(parent_id);
+    const auto sibling = queue.store(sibling_id);
+    queue.push(el, ListKind::children, sibling, queue.store(html));
 }
 
-void after(string id, string html)
+void move_child_after(
+    string_view parent_id, string_view sibling_id, string_view child_id)
 {
-    get_mutation_set(id)->after.push_back(html);
+    const auto el = intern(parent_id);
+    const auto sibling = queue.store(sibling_id);
+    queue.push(el, ListKind::children, sibling, queue.store(child_id)).is_move
+        = true;
 }
 
-// Move child node to the front of the parent
-void move_prepend(string parent_id, string child_id)
+void before(string_view id, string_view html)
 {
-    get_mutation_set(parent_id)->move_prepend.push_back(child_id);
+    push(id, ListKind::before, html);
 }
 
-// Move child node after a sibling in the parent
-void move_after(string sibling_id, string child_id)
+void after(string_view id, string_view html)
 {
-    get_mutation_set(sibling_id)->move_prepend.push_back(child_id);
+    push(id, ListKind::after, html);
 }
 
-void set_inner_html(string id, string html)
+void move_prepend(string_view parent_id, string_view child_id)
 {
-    auto mut = get_mutation_set(id);
-    // These would be overwritten, so we can free up used memory
-    mut->free_inner();
-    mut->set_inner_html = html;
+    push(parent_id, ListKind::move_prepend, child_id);
 }
 
-void set_outer_html(string id, string html)
+void move_after(string_view sibling_id, string_view child_id)
 {
-    auto mut = get_mutation_set(id);
-    mut->free_outer();
-    mut->set_outer_html = html;
+    push(sibling_id, ListKind::move_after, child_id);
 }
 
-void remove(string id)
+// Set inner HTML of an element to a stored string
+static void set_inner_html(string_view id, StrRef html)
 {
-    auto mut = get_mutation_set(id);
-    mut->free_outer();
-    mut->remove_el = true;
+    auto& mut = queue[intern(id)];
+    // These would be overwritten, so they can be dropped
+    mut.free_inner();
+    mut.has_inner_html = true;
+    mut.set_inner_html = html;
 }
 
-void set_attr(string id, string key, string val)
+void set_inner_html(string_view id, string_view html)
 {
-    get_mutation_set(id)->set_attr[key] = val;
+    set_inner_html(id, queue.store(html));
 }
 
-void remove_attr(string id, string key)
+void set_inner_html(string_view id, std::string&& html)
 {
-    auto mut = get_mutation_set(id);
-    mut->set_attr.erase(key);
-    mut->remove_attr.insert(id);
+    set_inner_html(id, queue.adopt(std::move(html)));
 }
 
-void scroll_into_view(string id)
+// Set outer HTML of an element to a stored string
+static void set_outer_html(string_view id, StrRef html)
 {
-    get_mutation_set(id)->scroll_into_view = true;
+    auto& mut = queue[intern(id)];
+    mut.free_outer();
+    mut.has_outer_html = true;
+    mut.set_outer_html = html;
 }
 
-void Mutations::free_inner()
+void set_outer_html(string_view id, string_view html)
 {
-    append.clear();
-    prepend.clear();
-    move_prepend.clear();
-    move_after.clear();
-    set_inner_html = std::nullopt;
+    set_outer_html(id, queue.store(html));
 }
 
-void Mutations::free_outer()
+void set_outer_html(string_view id, std::string&& html)
 {
-    free_inner();
-    remove_attr.clear();
-    set_attr.clear();
-    set_outer_html = std::nullopt;
+    set_outer_html(id, queue.adopt(std::move(html)));
 }
 
-extern "C" void flush()
+void remove(string_view id)
 {
-    if (before_flush) {
-        (*before_flush)();
+    auto& mut = queue[intern(id)];
+    mut.free_outer();
+    mut.remove_el = true;
+}
+
+void set_attr(string_view id, string_view key, string_view val)
+{
+    const auto el = intern(id);
+    queue.remove(el, ListKind::remove_attr, key);
+    const auto v = queue.store(val);
+    if (auto r = queue.find(el, ListKind::set_attr, key)) {
+        r->val = v;
+    } else {
+        queue.push(el, ListKind::set_attr, queue.store(key), v);
     }
+}
 
-    if (mutations.size()) {
-        for (auto& id : mutation_order) {
-            mutations.at(id).exec(id);
-        }
-        mutation_order.clear();
-        mutations.clear();
+void remove_attr(string_view id, string_view key)
+{
+    const auto el = intern(id);
+    queue.remove(el, ListKind::set_attr, key);
+    if (!queue.find(el, ListKind::remove_attr, key)) {
+        queue.push(el, ListKind::remove_attr, queue.store(key));
     }
+}
 
-    if (after_flush) {
-        (*after_flush)();
+void scroll_into_view(string_view id)
+{
+    queue[intern(id)].scroll_into_view = true;
+}
+
+// Mutations of the current flush serialized into one buffer, so they can be
+// applied with a single call into JS. Kept between flushes to reuse the
+// allocated memory.
+static std::vector<uint8_t> commands;
+
+static void write_op(Op op) { commands.push_back(static_cast<uint8_t>(op)); }
+
+// Strings are encoded as a little-endian uint32 byte length followed by the
+// UTF-8 bytes without a null terminator. Owned strings are passed by
+// reference instead.
+static void write_string(StrRef r)
+{
+    const auto s = queue.str(r);
+    const uint32_t size = r.owned ? s.size() | string_ref_flag : s.size();
+    for (int i = 0; i < 4; i++) {
+        commands.push_back(uint8_t(size >> (i * 8)));
+    }
+    if (r.owned) {
+        const uintptr_t p = reinterpret_cast<uintptr_t>(s.data());
+        for (size_t i = 0; i < sizeof(p); i++) {
+            commands.push_back(uint8_t(p >> (i * 8)));
+        }
+    } else {
+        commands.insert(commands.end(), s.begin(), s.end());
     }
 }
 
-void Mutations::exec(const string& id)
+// Applies commands to the browser DOM
+class BrowserSink : public DOMSink {
+public:
+    void apply(const uint8_t* buf, size_t size);
+    void on_screen(const uint8_t* buf, size_t size, uint8_t* out);
+};
+
+static BrowserSink browser_sink;
+static DOMSink* sink = &browser_sink;
+
+void set_dom_sink(DOMSink* s) { sink = s ? s : &browser_sink; }
+
+// Buffer for detaching commands, when running in a worker. Kept between
+// flushes to reuse the allocated memory.
+static std::vector<uint8_t> detached;
+
+// Apply all serialized mutations in one JS call. Inside a worker the commands
+// are posted to the main thread instead, which requires them to be detached
+// from the module's memory.
+void BrowserSink::apply(const uint8_t* buf, size_t size)
 {
-    // Assign element to global variable, so we don't have to look it up each
-    // time
-    const bool exists = (bool)EM_ASM_INT(
-        {
-            window.__el = document.getElementById(UTF8ToString($0));
-            return !!window.__el;
-        },
-        id.c_str());
-    if (!exists) {
-        // Nothing we can do
-        return;
+    static const bool in_worker = EM_ASM_INT({ return brunhild.inWorker; });
+    if (in_worker) {
+        detached.clear();
+        detach_commands(buf, size, detached);
+        EM_ASM({ brunhild.post(HEAPU8, $0, $0 + $1); }, detached.data(),
+            detached.size());
+    } else {
+        EM_ASM({ brunhild.apply(HEAPU8, $0, $0 + $1); }, buf, size);
     }
+}
 
-    // TODO: Do these loops in one JS call, if possible
+// Serialize an element's buffered mutations into the command buffer
+static void serialize(const ElementMutations& mut)
+{
+    write_op(Op::select);
+    write_string(mut.id);
+
+    // Write all records of a mutation list as commands of one type
+    auto write_list = [](const ElementMutations& mut, ListKind kind, Op op) {
+        queue.for_each(mut, kind, [=](const MutationRecord& r) {
+            write_op(r.is_move ? Op::move_child_after : op);
+            write_string(r.arg);
+            if (op == Op::set_attr || op == Op::insert_child_after) {
+                write_string(r.val);
+            }
+        });
+    };
 
     // Before and after inserts need to happen, even if the element is going to
     // be removed
-    for (auto& html : before) {
-        EM_ASM_INT(
-            {
-                var el = window.__el;
-                var cont = document.createElement('div');
-                cont.innerHTML = UTF8ToString($0);
-                el.parentNode.insertBefore(cont.firstChild, el);
-            },
-            html.c_str());
-    }
-    for (auto& html : after) {
-        EM_ASM_INT(
-            {
-                var el = window.__el;
-                var cont = document.createElement('div');
-                cont.innerHTML = UTF8ToString($0);
-                el.parentNode.insertBefore(cont.firstChild, el.nextSibling);
-            },
-            html.c_str());
-    }
+    write_list(mut, ListKind::before, Op::before);
+    write_list(mut, ListKind::after, Op::after);
 
-    if (remove_el) {
-        EM_ASM({
-            var el = window.__el;
-            el.parentNode.removeChild(el);
-        });
+    if (mut.remove_el) {
         // If the element is to be removed, nothing else needs to be done
+        write_op(Op::remove);
         return;
     }
 
-    if (set_outer_html) {
-        EM_ASM_INT({ window.__el.outerHTML = UTF8ToString($0); },
-            set_outer_html->c_str());
+    if (mut.has_outer_html) {
+        write_op(Op::set_outer_html);
+        write_string(mut.set_outer_html);
     }
-    if (set_inner_html) {
-        EM_ASM_INT({ window.__el.innerHTML = UTF8ToString($0); },
-            set_inner_html->c_str());
+    if (mut.has_inner_html) {
+        write_op(Op::set_inner_html);
+        write_string(mut.set_inner_html);
     }
 
-    for (auto& html : append) {
-        EM_ASM_INT(
-            {
-                var el = window.__el;
-                var cont = document.createElement('div');
-                cont.innerHTML = UTF8ToString($0);
-                el.appendChild(cont.firstChild);
-            },
-            html.c_str());
+    write_list(mut, ListKind::append, Op::append);
+    write_list(mut, ListKind::prepend, Op::prepend);
+    write_list(mut, ListKind::children, Op::insert_child_after);
+    write_list(mut, ListKind::move_prepend, Op::move_prepend);
+    write_list(mut, ListKind::move_after, Op::move_after);
+    write_list(mut, ListKind::set_attr, Op::set_attr);
+    write_list(mut, ListKind::remove_attr, Op::remove_attr);
+
+    if (mut.scroll_into_view) {
+        write_op(Op::scroll_into_view);
+    }
+}
+
+void BrowserSink::on_screen(const uint8_t* buf, size_t size, uint8_t* out)
+{
+    EM_ASM({ brunhild.onScreen(HEAPU8, $0, $0 + $1, $2); }, buf, size, out);
+}
+
+// Number of mutation sets serialized and applied at once between checks of
+// the frame budget
+static const size_t slice_size = 16;
+
+// Indices of pending mutation sets in application order. Kept between
+// flushes to reuse the allocated memory.
+static std::vector<uint32_t> order, off_screen;
+static std::vector<uint8_t> visible;
+
+// Fill order with the pending mutation sets. If they might not fit into the
+// frame budget, the ones of elements in the viewport are moved to the front.
+static void order_pending()
+{
+    order.clear();
+    const auto& all = queue.all();
+    for (uint32_t i = 0; i < all.size(); i++) {
+        if (!all[i].done) {
+            order.push_back(i);
+        }
+    }
+    if (!frame_budget || order.size() <= slice_size) {
+        return;
+    }
+
+    // Elements in the viewport already exist in the DOM, so applying their
+    // mutations early does not depend on the insertion of elements with
+    // earlier mutations
+    for (auto i : order) {
+        write_op(Op::select);
+        write_string(all[i].id);
     }
-    for (auto& html : prepend) {
-        EM_ASM_INT(
-            {
-                var el = window.__el;
-                var cont = document.createElement('div');
-                cont.innerHTML = UTF8ToString($0);
-                el.insertBefore(cont.firstChild, el.firstChild);
-            },
-            html.c_str());
+    visible.assign(order.size(), 0);
+    sink->on_screen(commands.data(), commands.size(), visible.data());
+    commands.clear();
+
+    // Stable partition, that keeps first access order within both groups
+    size_t n = 0;
+    off_screen.clear();
+    for (size_t i = 0; i < order.size(); i++) {
+        if (visible[i]) {
+            order[n++] = order[i];
+        } else {
+            off_screen.push_back(order[i]);
+        }
+    }
+    std::copy(off_screen.begin(), off_screen.end(), order.begin() + n);
+}
+
+// Apply pending mutations in slices until the frame budget is exceeded.
+// At least one slice is always applied.
+static void apply_pending()
+{
+    const auto deadline = emscripten_get_now() + frame_budget;
+    const auto slice = frame_budget ? slice_size : order.size();
+    for (size_t i = 0; i < order.size();) {
+        const auto end = std::min(i + slice, order.size());
+        for (auto j = i; j < end; j++) {
+            serialize(queue[order[j]]);
+        }
+        sink->apply(commands.data(), commands.size());
+        commands.clear();
+
+        // Owned strings are referenced by the command buffer and must
+        // outlive it
+        for (; i < end; i++) {
+            queue.mark_done(order[i]);
+        }
+
+        if (frame_budget && emscripten_get_now() >= deadline) {
+            return;
+        }
     }
-    for (auto& child_id : move_prepend) {
-        EM_ASM_INT(
-            {
-                var el = window.__el;
-                el.insertBefore(
-                    document.getElementById(UTF8ToString($0)), el.firstChild);
-            },
-            child_id.c_str());
+}
+
+void request_frame()
+{
+    if (!frame_requested) {
+        frame_requested = true;
+        emscripten_async_call([](void*) { flush(); }, nullptr, -1);
     }
-    for (auto& child_id : move_after) {
-        EM_ASM_INT(
-            {
-                var el = window.__el;
-                el.parentNode.insertBefore(
-                    document.getElementById(UTF8ToString($0)), el.nextSibling);
-            },
-            child_id.c_str());
+}
+
+void request_frame_in(int ms)
+{
+    emscripten_async_call([](void*) { request_frame(); }, nullptr, ms);
+}
+
+extern "C" void flush()
+{
+    // Mutations made by before_flush are applied in this same frame, so
+    // frame_requested is only reset after applying
+    frame_requested = true;
+    if (before_flush) {
+        (*before_flush)();
     }
 
-    for (auto& kv : set_attr) {
-        EM_ASM_INT(
-            { window.__el.setAttribute(UTF8ToString($0), UTF8ToString($1)); },
-            kv.first.c_str(), kv.second.c_str());
+    if (!queue.empty()) {
+        order_pending();
+        apply_pending();
     }
-    for (auto& key : remove_attr) {
-        EM_ASM_INT(
-            { window.__el.removeAttribute(UTF8ToString($0)); }, key.c_str());
+
+    frame_requested = false;
+    if (queue.empty()) {
+        queue.clear();
+    } else {
+        // Continue on the next frame
+        request_frame();
     }
 
-    if (scroll_into_view) {
-        EM_ASM({ window.__el.scrollIntoView(); });
+    if (after_flush) {
+        (*after_flush)();
     }
 }
 }
@@ -1,51 +1,97 @@
 #pragma once
 
+#include "commands.hh"
 #include <functional>
 #include <string>
+#include <string_view>
 
 namespace brunhild {
 // Append a node to a parent
-void append(std::string id, std::string html);
+void append(std::string_view id, std::string_view html);
 
 // Prepend a node to a parent
-void prepend(std::string id, std::string html);
+void prepend(std::string_view id, std::string_view html);
 
 // Move child node to the front of the parent
-void move_prepend(std::string parent_id, std::string child_id);
+void move_prepend(std::string_view parent_id, std::string_view child_id);
 
 // Move child node after a sibling in the parent
-void move_after(std::string sibling_id, std::string child_id);
+void move_after(std::string_view sibling_id, std::string_view child_id);
+
+// Insert a node into a parent after a sibling. If sibling_id is empty, the
+// node is inserted as the first child of the parent.
+// Unlike other mutations, insert_child_after() and move_child_after() calls on
+// the same parent are executed in call order relative to each other, which
+// makes them suitable for applying a computed sequence of reorderings.
+void insert_child_after(std::string_view parent_id,
+    std::string_view sibling_id, std::string_view html);
+
+// Move a child node of a parent after a sibling. If sibling_id is empty, the
+// child is moved to the front of the parent.
+// See insert_child_after() for ordering guarantees.
+void move_child_after(std::string_view parent_id, std::string_view sibling_id,
+    std::string_view child_id);
 
 // Insert a node before a sibling
-void before(std::string id, std::string html);
+void before(std::string_view id, std::string_view html);
 
 // Insert a node after a sibling
-void after(std::string id, std::string html);
+void after(std::string_view id, std::string_view html);
 
 // Set inner html of an element
-void set_inner_html(std::string id, std::string html);
+void set_inner_html(std::string_view id, std::string_view html);
+
+// Set inner html of an element. Takes ownership of html and passes it to the
+// DOM without copying, which is preferable for large renders.
+void set_inner_html(std::string_view id, std::string&& html);
 
 // Set outer html of an element
-void set_outer_html(std::string id, std::string html);
+void set_outer_html(std::string_view id, std::string_view html);
+
+// Set outer html of an element. Takes ownership of html and passes it to the
+// DOM without copying.
+void set_outer_html(std::string_view id, std::string&& html);
 
 // Remove an element
-void remove(std::string id);
+void remove(std::string_view id);
 
 // Set an element attribute to a value
-void set_attr(std::string id, std::string key, std::string val);
+void set_attr(std::string_view id, std::string_view key, std::string_view val);
 
 // Remove an element attribute
-void remove_attr(std::string id, std::string key);
+void remove_attr(std::string_view id, std::string_view key);
 
 // Scroll and element into the viewport
-void scroll_into_view(std::string id);
+void scroll_into_view(std::string_view id);
 
-// Flush all pending DOM mutations
+// Flush pending DOM mutations. Run on animation frames requested with
+// request_frame(). If frame_budget is exceeded, the remaining mutations are
+// left for the next frame.
 extern "C" void flush();
 
+// Request flush() to run on the next animation frame. All mutation functions
+// call this, so frames are only run, when there is work to do. Repeated calls
+// before the frame runs are no-ops.
+void request_frame();
+
+// Request flush() to run on the first animation frame after ms milliseconds.
+// Use for scheduling work of before_flush, that is due at a later time.
+void request_frame_in(int ms);
+
+// Maximum number of milliseconds flush() spends applying mutations per frame.
+// If exceeded, the remaining mutations are applied on the following frames,
+// with mutations of elements in the viewport prioritized. 0 disables the
+// limit. Defaults to 8.
+extern double frame_budget;
+
+// Set the sink flushed mutations are applied to. NULL restores the default
+// sink, which applies them to the browser DOM.
+void set_dom_sink(DOMSink*);
+
 // Function to run before flushing DOM updates. Is run on each call of flush().
+// Mutations made by it are applied in the same frame.
 extern void (*before_flush)();
 
-// Function to run after flushing DOM updates. IIs run on each call of flush().
+// Function to run after flushing DOM updates. Is run on each call of flush().
 extern void (*after_flush)();
 }
@@ -1,28 +1,114 @@
 #include "node.hh"
 #include "mutations.hh"
 #include "util.hh"
+#include <algorithm>
+#include <stdexcept>
 
-static unsigned long long id_counter = 0;
+static unsigned long id_counter = 0;
 
 namespace brunhild {
 
-std::string new_id()
+unsigned long new_id() { return ++id_counter; }
+
+ElementID::ElementID(unsigned long id)
 {
-    std::ostringstream s;
-    s << "bh-" << id_counter++;
-    return s.str();
+    // Write digits from the back of the buffer and then shift them in place
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    do {
+        *--p = '0' + id % 10;
+        id /= 10;
+    } while (id);
+    buf[0] = 'b';
+    buf[1] = 'h';
+    buf[2] = '-';
+    len = 3 + (end - p);
+    memmove(buf + 3, p, end - p);
 }
 
 std::string HTMLWriter::html()
 {
-    Rope s;
+    auto s = Rope::linear(1 << 10);
     write_html(s);
-    return s.str();
+    return s.take();
+}
+
+Attrs::Attrs(std::initializer_list<value_type> list)
+{
+    attrs.reserve(list.size());
+    for (auto& kv : list) {
+        auto it = lower_bound(kv.first);
+        if (it == end() || it->first != kv.first) {
+            attrs.insert(it, value_type(kv));
+        }
+    }
+}
+
+Attrs::iterator Attrs::lower_bound(std::string_view key)
+{
+    return std::lower_bound(begin(), end(), key,
+        [](const value_type& kv, std::string_view key) {
+            return kv.first < key;
+        });
+}
+
+Attrs::const_iterator Attrs::lower_bound(std::string_view key) const
+{
+    return std::lower_bound(begin(), end(), key,
+        [](const value_type& kv, std::string_view key) {
+            return kv.first < key;
+        });
+}
+
+Attrs::iterator Attrs::find(std::string_view key)
+{
+    auto it = lower_bound(key);
+    return it != end() && it->first == key ? it : end();
+}
+
+Attrs::const_iterator Attrs::find(std::string_view key) const
+{
+    auto it = lower_bound(key);
+    return it != end() && it->first == key ? it : end();
+}
+
+std::string& Attrs::operator[](std::string_view key)
+{
+    auto it = lower_bound(key);
+    if (it == end() || it->first != key) {
+        it = attrs.insert(it, { std::string(key), std::string() });
+    }
+    return it->second;
+}
+
+std::string& Attrs::at(std::string_view key)
+{
+    auto it = find(key);
+    if (it == end()) {
+        throw std::out_of_range("attribute not set");
+    }
+    return it->second;
+}
+
+const std::string& Attrs::at(std::string_view key) const
+{
+    auto it = find(key);
+    if (it == end()) {
+        throw std::out_of_range("attribute not set");
+    }
+    return it->second;
+}
+
+void Attrs::erase(std::string_view key)
+{
+    if (auto it = find(key); it != end()) {
+        attrs.erase(it);
+    }
 }
 
 void Attrs::write_html(Rope& s)
 {
-    for (auto & [ key, val ] : *this) {
+    for (auto& [key, val] : *this) {
         s << ' ' << key;
         if (val != "") {
             s << "=\"" << val << '"';
@@ -30,36 +116,68 @@ void Attrs::write_html(Rope& s)
     }
 }
 
-void Attrs::patch(Attrs&& attrs)
+void Attrs::patch(std::string_view id, Attrs&& attrs)
 {
-    const auto id = (*this)["id"];
     bool patched = false;
 
-    // Attributes added or changed
-    for (auto & [ key, val ] : attrs) {
-        if (key != "id" && (!count(key) || at(key) != val)) {
-            set_attr(id, key, val);
-            patched = true;
+    // Both sets are sorted by key, so they can be diffed in one linear merge
+    auto old_it = begin();
+    auto new_it = attrs.begin();
+    while (old_it != end() || new_it != attrs.end()) {
+        if (new_it == attrs.end()
+            || (old_it != end() && old_it->first < new_it->first)) {
+            // Attribute removed
+            if (old_it->first != "id") {
+                remove_attr(id, old_it->first);
+                patched = true;
+            }
+            old_it++;
+        } else if (old_it == end() || new_it->first < old_it->first) {
+            // Attribute added
+            if (new_it->first != "id") {
+                set_attr(id, new_it->first, new_it->second);
+                patched = true;
+            }
+            new_it++;
+        } else {
+            // Attribute possibly changed
+            if (old_it->first != "id" && old_it->second != new_it->second) {
+                set_attr(id, new_it->first, new_it->second);
+                patched = true;
+            }
+            old_it++;
+            new_it++;
         }
     }
 
-    // Attributes removed
-    for (auto & [ key, _ ] : *this) {
-        if (key != "id" && !attrs.count(key)) {
-            remove_attr(id, key);
-            patched = true;
+    if (patched) {
+        // Preserve any explicitly set element ID
+        if (auto it = find("id"); it != end()) {
+            attrs["id"] = std::move(it->second);
+        } else {
+            attrs.erase("id");
         }
+        *this = std::move(attrs);
     }
+}
 
-    if (patched) {
-        *this = attrs;
-        (*this)["id"] = id;
+ElementID Node::element_id() const
+{
+    if (id) {
+        return id;
     }
+    if (auto it = attrs.find("id"); it != attrs.end()) {
+        return std::string_view(it->second);
+    }
+    return std::string_view();
 }
 
 void Node::write_html(Rope& s)
 {
     s << '<' << tag;
+    if (id) {
+        s << " id=\"" << std::string_view(ElementID(id)) << '"';
+    }
     attrs.write_html(s);
     s << '>';
 
@@ -85,12 +203,14 @@ void Node::stringify_subtree()
     for (auto& ch : children) {
         ch.write_html(s);
     }
-    inner_html = s.str();
+    inner_html = s.take();
     children.clear();
 }
 
 void Node::clear()
 {
+    id = 0;
+    key = 0;
     tag.clear();
     attrs.clear();
     children.clear();
@@ -1,16 +1,49 @@
 #pragma once
 
+#include "small_vector.hh"
 #include "util.hh"
+#include <initializer_list>
 #include <optional>
-#include <sstream>
+#include <stdint.h>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace brunhild {
 
-// Generate a new unique element ID
-std::string new_id();
+// Generate a new unique numeric element ID
+unsigned long new_id();
+
+// DOM element ID of a Node. Either formats a numeric ID as "bh-<id>" into an
+// inline buffer without allocating or refers to an explicitly set string ID.
+class ElementID {
+public:
+    ElementID(unsigned long id);
+
+    // Refer to a string ID. The string must outlive the ElementID.
+    ElementID(std::string_view id)
+        : ext(id)
+    {
+    }
+
+    operator std::string_view() const
+    {
+        return ext.data() ? ext : std::string_view(buf, len);
+    }
+
+private:
+    char buf[24];
+    uint8_t len = 0;
+    std::string_view ext;
+};
+
+// Generate a new unique element ID string. Used for views, which are addressed
+// by string IDs.
+inline std::string new_string_id()
+{
+    return std::string(std::string_view(ElementID(new_id())));
+}
 
 // Helper for serializing to HTML
 class HTMLWriter {
@@ -22,23 +55,76 @@ public:
     virtual void write_html(Rope&) = 0;
 };
 
-// Element attributes
-class Attrs : public std::unordered_map<std::string, std::string>,
-              public HTMLWriter {
-    typedef std::unordered_map<std::string, std::string> Base;
-    using Base::Base;
-
+// Element attributes. Stored as a vector sorted by key with inline storage for
+// the common case of few attributes, so most nodes do not need to allocate
+// attribute storage and attributes are always written in a deterministic
+// order.
+class Attrs : public HTMLWriter {
 public:
+    typedef std::pair<std::string, std::string> value_type;
+    typedef SmallVector<value_type, 3> Storage;
+    typedef Storage::iterator iterator;
+    typedef Storage::const_iterator const_iterator;
+
+    Attrs() = default;
+
+    // Duplicate keys are ignored
+    Attrs(std::initializer_list<value_type>);
+
+    // Returns a reference to the value of the attribute. Inserts an empty
+    // value, if not set.
+    std::string& operator[](std::string_view key);
+
+    // Returns an iterator to the attribute or end(), if not found
+    iterator find(std::string_view key);
+    const_iterator find(std::string_view key) const;
+
+    // Returns 1, if the attribute is set, and 0 otherwise
+    size_t count(std::string_view key) const { return find(key) != end(); }
+
+    // Returns the value of the attribute. Throws, if not set.
+    std::string& at(std::string_view key);
+    const std::string& at(std::string_view key) const;
+
+    // Remove an attribute, if set
+    void erase(std::string_view key);
+
+    iterator begin() { return attrs.begin(); }
+    iterator end() { return attrs.end(); }
+    const_iterator begin() const { return attrs.begin(); }
+    const_iterator end() const { return attrs.end(); }
+    size_t size() const { return attrs.size(); }
+    bool empty() const { return attrs.empty(); }
+    void clear() { attrs.clear(); }
+
     // Write attrs as HTML to stream
     void write_html(Rope&);
 
-    // Diff attributes with new value and apply patches to the DOM
-    void patch(Attrs&& attrs);
+    // Diff attributes with new value and apply patches to the DOM element with
+    // the passed ID. An explicitly set "id" attribute is never patched.
+    void patch(std::string_view id, Attrs&& attrs);
+
+private:
+    Storage attrs;
+
+    // Returns the first attribute with a key not less than key
+    iterator lower_bound(std::string_view key);
+    const_iterator lower_bound(std::string_view key) const;
 };
 
 // Represents an HTML element. Can be used to construct node trees more easily.
 class Node : public HTMLWriter {
 public:
+    // Numeric element ID. Written to HTML as the "id" attribute, unless one
+    // is set explicitly in attrs. 0 denotes no ID.
+    unsigned long id = 0;
+
+    // Identifies the node among its siblings across renders. If all children
+    // of an element are keyed, they are matched by key instead of position,
+    // which allows reordering, inserting and removing children without
+    // rerendering their siblings. 0 denotes an unkeyed node.
+    unsigned long key = 0;
+
     // Tag of the Element
     std::string tag;
 
@@ -51,35 +137,46 @@ public:
     // Inner HTML of the Element. If set, children are ignored
     std::optional<std::string> inner_html;
 
-    // Creates a Node with optional attributes and children
+    // Creates a Node with optional attributes and children.
+    // Arguments are moved into the Node, so pass temporaries or std::move()
+    // existing subtrees to avoid copying them.
     Node(std::string tag, Attrs attrs = {}, std::vector<Node> children = {})
-        : tag(tag)
-        , attrs(attrs)
-        , children(children)
+        : tag(std::move(tag))
+        , attrs(std::move(attrs))
+        , children(std::move(children))
     {
     }
 
     // Creates a Node with html set as the inner contents.
     // Escaped specifies, if the text should be escaped.
     Node(std::string tag, Attrs attrs, std::string html, bool escape = false)
-        : tag(tag)
-        , attrs(attrs)
-        , inner_html(escape ? brunhild::escape(html) : html)
+        : tag(std::move(tag))
+        , attrs(std::move(attrs))
+        , inner_html(
+              escape ? brunhild::escape(std::move(html)) : std::move(html))
     {
     }
 
     // Creates a Node with html set as the inner contents.
     // Escaped specifies, if the text should be escaped.
     Node(std::string tag, std::string html, bool escape = false)
-        : Node(tag, {}, html, escape)
+        : Node(std::move(tag), {}, std::move(html), escape)
     {
     }
 
     Node() = default;
+    Node(const Node&) = default;
+    Node(Node&&) noexcept = default;
+    Node& operator=(const Node&) = default;
+    Node& operator=(Node&&) noexcept = default;
 
     // Write node as HTML to stream
     void write_html(Rope&);
 
+    // Returns the DOM element ID of the node. The returned value must not
+    // outlive the node.
+    ElementID element_id() const;
+
     // Converts the subtree of the node into an HTML string and sets it to
     // inner_html. This can reduce the diffing and memory costs of large mostly
     // static subtrees, but will cause any changes to replace the entire
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <initializer_list>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+namespace brunhild {
+
+// Vector, that stores up to N elements inline and only allocates on the heap,
+// when grown past that
+template <class T, size_t N> class SmallVector {
+public:
+    typedef T value_type;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+
+    SmallVector() = default;
+
+    SmallVector(std::initializer_list<T> list)
+    {
+        reserve(list.size());
+        for (auto& v : list) {
+            push_back(v);
+        }
+    }
+
+    SmallVector(const SmallVector& other)
+    {
+        reserve(other.sz);
+        for (auto& v : other) {
+            push_back(v);
+        }
+    }
+
+    SmallVector(SmallVector&& other) noexcept { steal(other); }
+
+    SmallVector& operator=(const SmallVector& other)
+    {
+        if (this != &other) {
+            clear();
+            reserve(other.sz);
+            for (auto& v : other) {
+                push_back(v);
+            }
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& other) noexcept
+    {
+        if (this != &other) {
+            clear();
+            free_heap();
+            steal(other);
+        }
+        return *this;
+    }
+
+    ~SmallVector()
+    {
+        clear();
+        free_heap();
+    }
+
+    size_t size() const { return sz; }
+    bool empty() const { return !sz; }
+    size_t capacity() const { return cap; }
+
+    iterator begin() { return data; }
+    iterator end() { return data + sz; }
+    const_iterator begin() const { return data; }
+    const_iterator end() const { return data + sz; }
+
+    T& operator[](size_t i) { return data[i]; }
+    const T& operator[](size_t i) const { return data[i]; }
+    T& back() { return data[sz - 1]; }
+
+    // Ensure capacity for at least n elements
+    void reserve(size_t n)
+    {
+        if (n <= cap) {
+            return;
+        }
+        T* next = static_cast<T*>(::operator new(n * sizeof(T)));
+        for (size_t i = 0; i < sz; i++) {
+            new (next + i) T(std::move(data[i]));
+            data[i].~T();
+        }
+        free_heap();
+        data = next;
+        cap = n;
+    }
+
+    template <class... Args> T& emplace_back(Args&&... args)
+    {
+        if (sz == cap) {
+            reserve(cap << 1);
+        }
+        return *new (data + sz++) T(std::forward<Args>(args)...);
+    }
+
+    void push_back(const T& v) { emplace_back(v); }
+    void push_back(T&& v) { emplace_back(std::move(v)); }
+
+    // Insert element before pos and return an iterator to it
+    iterator insert(const_iterator pos, T&& v)
+    {
+        const size_t i = pos - data;
+        if (i == sz) {
+            emplace_back(std::move(v));
+            return data + i;
+        }
+        if (sz == cap) {
+            reserve(cap << 1);
+        }
+        new (data + sz) T(std::move(data[sz - 1]));
+        sz++;
+        for (size_t j = sz - 2; j > i; j--) {
+            data[j] = std::move(data[j - 1]);
+        }
+        data[i] = std::move(v);
+        return data + i;
+    }
+
+    // Erase element at pos and return an iterator to the following element
+    iterator erase(const_iterator pos)
+    {
+        const size_t i = pos - data;
+        for (size_t j = i + 1; j < sz; j++) {
+            data[j - 1] = std::move(data[j]);
+        }
+        data[--sz].~T();
+        return data + i;
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < sz; i++) {
+            data[i].~T();
+        }
+        sz = 0;
+    }
+
+private:
+    alignas(T) unsigned char buf[N * sizeof(T)];
+    T* data = reinterpret_cast<T*>(buf);
+    uint32_t sz = 0, cap = N;
+
+    bool is_inline() const
+    {
+        return data == reinterpret_cast<const T*>(buf);
+    }
+
+    // Free any heap allocated storage and revert to inline storage.
+    // Must only be called on an empty vector.
+    void free_heap()
+    {
+        if (!is_inline()) {
+            ::operator delete(data);
+            data = reinterpret_cast<T*>(buf);
+            cap = N;
+        }
+    }
+
+    // Take over the contents of another vector and leave it empty.
+    // Must only be called on an empty vector with inline storage.
+    void steal(SmallVector& other)
+    {
+        if (other.is_inline()) {
+            for (size_t i = 0; i < other.sz; i++) {
+                new (data + i) T(std::move(other.data[i]));
+            }
+            sz = other.sz;
+            other.clear();
+        } else {
+            data = other.data;
+            sz = other.sz;
+            cap = other.cap;
+            other.data = reinterpret_cast<T*>(other.buf);
+            other.sz = 0;
+            other.cap = N;
+        }
+    }
+};
+}
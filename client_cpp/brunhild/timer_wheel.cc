@@ -0,0 +1,53 @@
+#include "timer_wheel.hh"
+#include <algorithm>
+
+namespace brunhild {
+
+void TimerWheel::schedule(unsigned long key, int64_t at)
+{
+    auto[it, inserted] = due.try_emplace(key, at);
+    if (!inserted) {
+        if (it->second <= at) {
+            return;
+        }
+        it->second = at;
+    }
+    insert({ key, at }, current + 1);
+}
+
+void TimerWheel::insert(Entry e, int64_t earliest)
+{
+    // Keys due beyond the span of the wheel are stored in the top level and
+    // moved again, when reached
+    const int64_t at = std::clamp(e.at, earliest, current + span(levels) - 1);
+    int level = 0;
+    while (level < levels - 1 && at - current >= span(level + 1)) {
+        level++;
+    }
+    slots[level][(at >> (slot_bits * level)) & (slot_count - 1)].push_back(e);
+}
+
+void TimerWheel::cascade(int level)
+{
+    buf.clear();
+    std::swap(
+        buf, slots[level][(current >> (slot_bits * level)) & (slot_count - 1)]);
+    // Cascading happens on the tick being advanced to before its level 0
+    // slot is processed, so keys due on it can still be stored there
+    for (auto e : buf) {
+        if (!is_stale(e)) {
+            insert(e, current);
+        }
+    }
+}
+
+void TimerWheel::reset(int64_t now)
+{
+    for (auto& level : slots) {
+        for (auto& slot : level) {
+            slot.clear();
+        }
+    }
+    current = now;
+}
+}
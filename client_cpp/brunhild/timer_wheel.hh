@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace brunhild {
+
+// Hierarchical timer wheel of keys due at integer ticks, like seconds.
+// Scheduling and cancelling are O(1). Advancing costs O(1) per elapsed tick
+// plus O(1) per due key, regardless of the number of keys scheduled for later.
+//
+// Each level has 64 slots, which span 64 times the ticks of the slots of the
+// level below. Keys are stored in the lowest level, that spans their due time,
+// and moved down a level, when the slot they are in comes up.
+class TimerWheel {
+public:
+    // now: tick the wheel starts at
+    TimerWheel(int64_t now)
+        : current(now)
+    {
+    }
+
+    // Schedule key to be due at tick at. If the key is already scheduled, the
+    // earlier tick is kept. Keys due at or before the current tick are due on
+    // the next one.
+    void schedule(unsigned long key, int64_t at);
+
+    // Unschedule key, if scheduled
+    void cancel(unsigned long key) { due.erase(key); }
+
+    // Number of scheduled keys
+    size_t size() const { return due.size(); }
+
+    // Advance the wheel to tick now and call fn(key) for each key, that is
+    // due. Keys are unscheduled before fn is called, so fn can schedule them
+    // again.
+    template <class F> void advance(int64_t now, F fn)
+    {
+        if (due.empty()) {
+            reset(now);
+            return;
+        }
+
+        while (current < now) {
+            current++;
+            for (int level = levels - 1; level > 0; level--) {
+                if (!(current & (span(level) - 1))) {
+                    cascade(level);
+                }
+            }
+
+            buf.clear();
+            std::swap(buf, slots[0][current & (slot_count - 1)]);
+            for (auto e : buf) {
+                if (is_stale(e)) {
+                    continue;
+                }
+                if (e.at > current) {
+                    insert(e, current + 1);
+                    continue;
+                }
+                due.erase(e.key);
+                fn(e.key);
+            }
+        }
+    }
+
+private:
+    static constexpr int levels = 5, slot_bits = 6,
+                         slot_count = 1 << slot_bits;
+
+    struct Entry {
+        unsigned long key;
+        int64_t at;
+    };
+
+    // Tick the wheel was last advanced to
+    int64_t current;
+
+    // Due tick of each scheduled key. Entries in slots, that do not match it,
+    // were cancelled or rescheduled and are dropped, when reached.
+    std::unordered_map<unsigned long, int64_t> due;
+
+    std::vector<Entry> slots[levels][slot_count];
+
+    // Reused buffer for the entries of the slot being processed
+    std::vector<Entry> buf;
+
+    // Ticks spanned by a slot of a level
+    static constexpr int64_t span(int level)
+    {
+        return int64_t(1) << (slot_bits * level);
+    }
+
+    bool is_stale(const Entry& e) const
+    {
+        auto it = due.find(e.key);
+        return it == due.end() || it->second != e.at;
+    }
+
+    // Store entry in the slot spanning its due tick. Entries due before tick
+    // earliest are stored at it.
+    void insert(Entry e, int64_t earliest);
+
+    // Move the entries of the current slot of level one level down
+    void cascade(int level);
+
+    // Drop all stale entries and restart the wheel at tick now
+    void reset(int64_t now);
+};
+}
@@ -1,32 +1,146 @@
+#include "util.hh"
+#include <algorithm>
 #include <string>
 
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace brunhild {
 
-std::string escape(const std::string& s)
+size_t find_escapable(std::string_view s)
 {
-    std::string out;
-    out.reserve(s.size() * 1.1);
-    for (auto ch : s) {
-        switch (ch) {
+    const char* const p = s.data();
+    const size_t n = s.size();
+    size_t i = 0;
+
+    // '<' and '>' only differ in bit 1 and '&' and '\'' only in bit 0, so each
+    // 16 byte chunk is checked with 3 comparisons
+#if defined(__wasm_simd128__)
+    const v128_t angle = wasm_i8x16_splat('>'), amp = wasm_i8x16_splat('\''),
+                 quot = wasm_i8x16_splat('"'), bit0 = wasm_i8x16_splat(1),
+                 bit1 = wasm_i8x16_splat(2);
+    for (; i + 16 <= n; i += 16) {
+        const v128_t v = wasm_v128_load(p + i);
+        const v128_t m = wasm_v128_or(
+            wasm_v128_or(wasm_i8x16_eq(wasm_v128_or(v, bit1), angle),
+                wasm_i8x16_eq(wasm_v128_or(v, bit0), amp)),
+            wasm_i8x16_eq(v, quot));
+        if (const uint32_t mask = wasm_i8x16_bitmask(m)) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i angle = _mm_set1_epi8('>'), amp = _mm_set1_epi8('\''),
+                  quot = _mm_set1_epi8('"'), bit0 = _mm_set1_epi8(1),
+                  bit1 = _mm_set1_epi8(2);
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v
+            = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        const __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(_mm_or_si128(v, bit1), angle),
+                _mm_cmpeq_epi8(_mm_or_si128(v, bit0), amp)),
+            _mm_cmpeq_epi8(v, quot));
+        if (const int mask = _mm_movemask_epi8(m)) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        switch (p[i]) {
         case '&':
-            out += "&amp;";
-            break;
         case '\'':
-            out += "&#39;"; // "&#39;" is shorter than "&apos;"
-            break;
         case '<':
-            out += "&lt;";
-            break;
         case '>':
-            out += "&gt;";
-            break;
-        case '\"':
-            out += "&#34;"; // "&#34;" is shorter than "&quot;"
-            break;
-        default:
-            out += ch;
+        case '"':
+            return i;
         }
     }
+    return n;
+}
+
+// Returns the HTML entity of a character found by find_escapable()
+static std::string_view entity(char ch)
+{
+    switch (ch) {
+    case '&':
+        return "&amp;";
+    case '\'':
+        return "&#39;"; // "&#39;" is shorter than "&apos;"
+    case '<':
+        return "&lt;";
+    case '>':
+        return "&gt;";
+    default:
+        return "&#34;"; // "&#34;" is shorter than "&quot;"
+    }
+}
+
+// Write s with all characters from position i on escaped
+template <class F>
+static void write_escaped(std::string_view s, size_t i, F write)
+{
+    while (i != s.size()) {
+        write(s.substr(0, i));
+        write(entity(s[i]));
+        s = s.substr(i + 1);
+        i = find_escapable(s);
+    }
+    write(s);
+}
+
+std::string escape(std::string s)
+{
+    const size_t i = find_escapable(s);
+    if (i == s.size()) {
+        return s;
+    }
+
+    std::string out;
+    out.reserve(s.size() * 1.1);
+    write_escaped(s, i, [&](std::string_view frag) { out += frag; });
     return out;
 }
+
+void escape(Rope& out, std::string_view s)
+{
+    write_escaped(s, find_escapable(s), [&](std::string_view frag) {
+        if (frag.size()) {
+            out << frag;
+        }
+    });
+}
+
+std::vector<bool> longest_increasing_subsequence(const std::vector<size_t>& seq)
+{
+    // tails[k] is the index of the smallest tail of all increasing
+    // subsequences of length k + 1 found so far. prev links each element to
+    // its predecessor in the subsequence it ends.
+    std::vector<size_t> tails, prev(seq.size(), SIZE_MAX);
+    for (size_t i = 0; i < seq.size(); i++) {
+        if (seq[i] == SIZE_MAX) {
+            continue;
+        }
+        auto it = std::lower_bound(tails.begin(), tails.end(), seq[i],
+            [&](size_t j, size_t val) { return seq[j] < val; });
+        if (it != tails.begin()) {
+            prev[i] = *(it - 1);
+        }
+        if (it == tails.end()) {
+            tails.push_back(i);
+        } else {
+            *it = i;
+        }
+    }
+
+    std::vector<bool> in(seq.size(), false);
+    for (size_t i = tails.empty() ? SIZE_MAX : tails.back(); i != SIZE_MAX;
+         i = prev[i]) {
+        in[i] = true;
+    }
+    return in;
+}
 }
@@ -1,15 +1,27 @@
 #pragma once
 
+#include <stdint.h>
 #include <string.h>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 
 namespace brunhild {
 
+// Returns the position of the first character of s, that needs escaping for
+// HTML, or s.size(), if none. Scans 16 bytes at a time, if compiled with SIMD
+// support.
+size_t find_escapable(std::string_view s);
+
 // Escape a user-submitted unsafe string to protect against XSS and malformed
-// HTML
-std::string escape(const std::string& s);
+// HTML. Strings without any characters to escape are returned as is without
+// allocating.
+std::string escape(std::string s);
+
+// Marks the elements of seq, that form its longest strictly increasing
+// subsequence. Elements equal to SIZE_MAX are skipped. Runs in O(n log n).
+std::vector<bool> longest_increasing_subsequence(const std::vector<size_t>& seq);
 
 // Allows returning the size of a std::string, std::string_view, char or char*
 inline size_t string_size(const std::string& s) { return s.size(); }
@@ -17,7 +29,9 @@ inline size_t string_size(const std::string_view& s) { return s.size(); }
 inline size_t string_size(char sep[[maybe_unused]]) { return 1; }
 inline size_t string_size(const char* sep) { return strlen(sep); }
 
-// Append-only rope data structure for more efficient HTML building
+// Append-only rope data structure for more efficient HTML building.
+// A linear Rope writes into a single growable buffer instead, so its contents
+// can be taken by take() without copying.
 class Rope {
     template <class T> friend Rope& operator<<(Rope& r, const T& s);
     friend Rope& operator<<(Rope& r, const std::string& s);
@@ -34,9 +48,23 @@ public:
         parts.emplace_back().reserve(1 << 10);
     }
 
+    // Create a Rope, that writes into a single buffer with an initial
+    // capacity
+    static Rope linear(size_t capacity = 1 << 16)
+    {
+        Rope r;
+        r.is_linear = true;
+        r.parts.back().reserve(capacity);
+        return r;
+    }
+
     // Dumps Rope contents to string
     std::string str()
     {
+        if (parts.size() == 1) {
+            return parts.back();
+        }
+
         size_t cap = 0;
         for (auto& s : parts) {
             cap += s.size();
@@ -49,13 +77,29 @@ public:
         return re;
     }
 
+    // Moves Rope contents out of the Rope without copying, if linear, and
+    // leaves it empty
+    std::string take()
+    {
+        std::string re;
+        if (parts.size() == 1) {
+            re = std::move(parts.back());
+        } else {
+            re = str();
+        }
+        parts.clear();
+        parts.emplace_back();
+        return re;
+    }
+
 private:
+    bool is_linear = false;
     std::vector<std::string> parts;
 
     template <class T> Rope& append(const T& s)
     {
         std::string* last = &parts.back();
-        if (last->size() + string_size(s) > last->capacity()) {
+        if (!is_linear && last->size() + string_size(s) > last->capacity()) {
             const auto last_cap = last->capacity();
             last = &parts.emplace_back();
             last->reserve(last_cap << 1);
@@ -71,6 +115,9 @@ inline Rope& operator<<(Rope& r, std::string_view s) { return r.append(s); }
 inline Rope& operator<<(Rope& r, char s) { return r.append(s); }
 inline Rope& operator<<(Rope& r, const char* s) { return r.append(s); }
 
+// Escape an unsafe string like escape() and append it to a Rope
+void escape(Rope& out, std::string_view s);
+
 // Append anything convertable with std::to_string() to Rope
 template <class T> inline Rope& operator<<(Rope& r, const T& s)
 {
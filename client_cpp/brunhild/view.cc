@@ -7,12 +7,19 @@
 #include <emscripten/bind.h>
 #include <sstream>
 #include <string_view>
+#include <unordered_map>
 #include <utility>
 
 using std::string;
 
 namespace brunhild {
 
+uint64_t render_epoch = 1;
+
+static uint64_t version_counter = 0;
+
+uint64_t next_version() { return ++version_counter; }
+
 View::View(std::string id)
     : id(id)
 {
@@ -22,48 +29,9 @@ View::~View() { remove_event_handlers(); }
 
 void View::on(std::string type, std::string selector, Handler handler)
 {
-    // Need to prepend root node ID to all selectors
-    Rope s;
-    if (selector != "") {
-        std::string_view view = { selector };
-        size_t i;
-        while (1) {
-            i = view.find(',');
-            auto frag = view.substr(0, i);
-
-            // If this comma is inside a selector like :not(.foo,.bar), skip the
-            // appropriate amount of closing brackets. Assumes correct CSS
-            // syntax.
-            const auto opening = std::count(frag.begin(), frag.end(), '(');
-            if (opening) {
-                const auto closing = std::count(frag.begin(), frag.end(), ')');
-                if (closing != opening) {
-                    i = view.find(',', view.find(")", i, closing - opening));
-                    frag = view.substr(0, i);
-                }
-            }
-
-            s << '#' << id << ' ' << frag;
-            if (i != std::string::npos) {
-                view = view.substr(i + 1);
-                s << ',';
-            } else {
-                break;
-            }
-        }
-    } else {
-        // Select all children, if no selector
-        s << '#' << id << " *";
-    }
-
-    event_handlers.push_back(register_handler(type, handler, s.str()));
-}
-
-emscripten::val View::el()
-{
-    using emscripten::val;
-
-    return val::global("document").call<val>("getElementById", id);
+    event_handlers.push_back(
+        register_handler(std::move(type), std::move(handler),
+            std::move(selector), id));
 }
 
 void View::scroll_into_view() { brunhild::scroll_into_view(id); }
@@ -80,8 +48,8 @@ void View::remove_event_handlers()
 
 void VirtualView::ensure_id(Node& node)
 {
-    if (!node.attrs.count("id")) {
-        node.attrs["id"] = new_id();
+    if (!node.id && !node.attrs.count("id")) {
+        node.id = new_id();
     }
     for (auto& ch : node.children) {
         ensure_id(ch);
@@ -111,21 +79,41 @@ void VirtualView::patch()
     patch_node(saved, std::move(node));
 }
 
+// Returns, if a node must be completely replaced with its subtree, because
+// the tag or an explicitly set element ID differ
+static bool needs_replace(const Node& old, const Node& node)
+{
+    if (old.tag != node.tag) {
+        return true;
+    }
+    if (auto it = node.attrs.find("id"); it != node.attrs.end()) {
+        auto old_it = old.attrs.find("id");
+        return old_it == old.attrs.end() || old_it->second != it->second;
+    }
+    return false;
+}
+
+// Returns, if all nodes have a key set
+static bool all_keyed(const std::vector<Node>& nodes)
+{
+    for (auto& n : nodes) {
+        if (!n.key) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void VirtualView::patch_node(Node& old, Node&& node)
 {
-    // Completely replace node and subtree
-    const auto replace = old.tag != node.tag
-        || (node.attrs.count("id")
-               && node.attrs.at("id") != old.attrs.at("id"));
-    if (replace) {
-        const auto old_id = old.attrs.at("id");
+    if (needs_replace(old, node)) {
+        ensure_id(node);
+        set_outer_html(old.element_id(), node.html());
         old = std::move(node);
-        ensure_id(old);
-        set_outer_html(old_id, old.html());
         return;
     }
 
-    old.attrs.patch(std::move(node.attrs));
+    old.attrs.patch(old.element_id(), std::move(node.attrs));
     patch_children(old, std::move(node));
 }
 
@@ -137,7 +125,7 @@ void VirtualView::patch_children(Node& old, Node&& node)
         // Hot path
         if (node.inner_html) {
             if (*old.inner_html != *node.inner_html) {
-                set_inner_html(old.attrs.at("id"), *node.inner_html);
+                set_inner_html(old.element_id(), *node.inner_html);
                 old.inner_html = move(node.inner_html);
             }
             return;
@@ -150,15 +138,21 @@ void VirtualView::patch_children(Node& old, Node&& node)
         }
         old.children = move(node.children);
         old.inner_html = std::nullopt;
-        set_inner_html(old.attrs.at("id"), s.str());
+        set_inner_html(old.element_id(), s.str());
         return;
     } else if (node.inner_html) {
-        set_inner_html(old.attrs.at("id"), *node.inner_html);
+        set_inner_html(old.element_id(), *node.inner_html);
         old.children.clear();
         old.inner_html = move(node.inner_html);
         return;
     }
 
+    if (old.children.size() && node.children.size()
+        && all_keyed(old.children) && all_keyed(node.children)) {
+        patch_keyed_children(old, std::move(node));
+        return;
+    }
+
     // Diff existing nodes
     for (size_t i = 0; i < old.children.size() && i < node.children.size();
          i++) {
@@ -171,14 +165,103 @@ void VirtualView::patch_children(Node& old, Node&& node)
         while (i < node.children.size()) {
             auto& ch = node.children[i++];
             ensure_id(ch);
-            append(old.attrs.at("id"), ch.html());
+            append(old.element_id(), ch.html());
             old.children.push_back(std::move(ch));
         }
     } else { // Remove Nodes from the end
         while (diff++ < 0) {
-            brunhild::remove(old.children.back().attrs.at("id"));
+            brunhild::remove(old.children.back().element_id());
             old.children.pop_back();
         }
     }
 }
+
+void VirtualView::patch_keyed_children(Node& old, Node&& node)
+{
+    auto& old_ch = old.children;
+    auto& new_ch = node.children;
+    const auto parent_id = old.element_id();
+
+    // Patch common prefix and suffix in place. This covers the most common
+    // cases of appending, prepending or updating nodes without any moves.
+    size_t start = 0;
+    while (start < old_ch.size() && start < new_ch.size()
+        && old_ch[start].key == new_ch[start].key
+        && !needs_replace(old_ch[start], new_ch[start])) {
+        patch_node(old_ch[start], std::move(new_ch[start]));
+        start++;
+    }
+    size_t old_end = old_ch.size(), new_end = new_ch.size();
+    while (old_end > start && new_end > start
+        && old_ch[old_end - 1].key == new_ch[new_end - 1].key
+        && !needs_replace(old_ch[old_end - 1], new_ch[new_end - 1])) {
+        patch_node(old_ch[--old_end], std::move(new_ch[--new_end]));
+    }
+    if (start == old_end && start == new_end) {
+        return;
+    }
+
+    // Match the remaining new nodes to old ones by key. Nodes, that would
+    // need to be replaced, are treated as new nodes, so any move always
+    // refers to an element already in the DOM.
+    std::unordered_map<unsigned long, size_t> old_keys;
+    old_keys.reserve(old_end - start);
+    for (size_t i = start; i < old_end; i++) {
+        old_keys.emplace(old_ch[i].key, i);
+    }
+    std::vector<size_t> sources(new_end - start, SIZE_MAX);
+    std::vector<bool> reused(old_end - start, false);
+    for (size_t j = start; j < new_end; j++) {
+        auto it = old_keys.find(new_ch[j].key);
+        if (it == old_keys.end()) {
+            continue;
+        }
+        const size_t i = it->second;
+        old_keys.erase(it); // Duplicate keys only match once
+        if (needs_replace(old_ch[i], new_ch[j])) {
+            continue;
+        }
+        reused[i - start] = true;
+        sources[j - start] = i;
+        patch_node(old_ch[i], std::move(new_ch[j]));
+    }
+    for (size_t i = start; i < old_end; i++) {
+        if (!reused[i - start]) {
+            brunhild::remove(old_ch[i].element_id());
+        }
+    }
+
+    // Nodes in the longest increasing subsequence of old positions keep their
+    // relative order. Only the rest need to be moved.
+    const auto stable = longest_increasing_subsequence(sources);
+
+    std::vector<Node> children;
+    children.reserve(new_ch.size());
+    for (size_t i = 0; i < start; i++) {
+        children.push_back(std::move(old_ch[i]));
+    }
+    for (size_t j = start; j < new_end; j++) {
+        // Empty sibling ID inserts at the front
+        const ElementID prev = children.empty()
+            ? ElementID(std::string_view())
+            : children.back().element_id();
+        const size_t src = sources[j - start];
+        if (src == SIZE_MAX) {
+            auto& ch = new_ch[j];
+            ensure_id(ch);
+            insert_child_after(parent_id, prev, ch.html());
+            children.push_back(std::move(ch));
+        } else {
+            auto& ch = old_ch[src];
+            if (!stable[j - start]) {
+                move_child_after(parent_id, prev, ch.element_id());
+            }
+            children.push_back(std::move(ch));
+        }
+    }
+    for (size_t i = old_end; i < old_ch.size(); i++) {
+        children.push_back(std::move(old_ch[i]));
+    }
+    old_ch = std::move(children);
+}
 }
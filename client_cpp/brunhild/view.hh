@@ -4,11 +4,11 @@
 #include "mutations.hh"
 #include "node.hh"
 #include <emscripten.h>
-#include <emscripten/val.h>
 #include <memory>
+#include <stdint.h>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 namespace brunhild {
@@ -25,17 +25,19 @@ public:
     const std::string id;
 
     // Creates new view with an optional root node ID
-    View(std::string id = new_id());
+    View(std::string id = new_string_id());
 
     // Remove all event listeners
     virtual ~View();
 
-    // Add DOM event handler to view.
+    // Add DOM event handler to view, that is run for events on the view's
+    // root element and its descendants.
     // If you have many instances of the same View subclass, it
     // is  recommended to use register_handler with View collection lookup on
-    // your side to reduce DOM event listener count.
+    // your side to reduce the number of registered handlers.
     // type: DOM event type (click, hover, ...)
-    // selector: any CSS selector the event target should be matched against
+    // selector: any CSS selector the event target should be matched against.
+    // Empty selector matches any target.
     // handler: handler for a matched event
     void on(std::string type, std::string selector, Handler handler);
 
@@ -49,10 +51,6 @@ public:
     // Can only be called after the view has been inserted into the DOM.
     virtual void patch() = 0;
 
-protected:
-    // Returns the root element of the view
-    emscripten::val el();
-
 private:
     // Registered DOM event handlers
     std::vector<long> event_handlers;
@@ -82,7 +80,7 @@ public:
     virtual void patch();
 
     // Creates a new View with an optional specific root node ID.
-    VirtualView(std::string id = new_id())
+    VirtualView(std::string id = new_string_id())
         : View(id)
     {
     }
@@ -98,14 +96,21 @@ protected:
     // Ensure the Node and it's subtree all have element IDs defined
     void ensure_id(Node&);
 
+    // Patch an old node against the new one and generate DOM mutations.
+    // Can be used to patch a subtree of saved, that is known to have changed,
+    // without rerendering the entire view.
+    void patch_node(Node& old, Node&& node);
+
 private:
     bool is_initialized = false;
 
-    // Patch an old node against the new one and generate DOM mutations
-    void patch_node(Node& old, Node&& node);
-
     // Patch element's subtree
     void patch_children(Node& old, Node&& node);
+
+    // Patch children of an element, that are all keyed, by matching them on
+    // their keys and moving only the nodes not in the longest increasing
+    // subsequence of preserved nodes
+    void patch_keyed_children(Node& old, Node&& node);
 };
 
 // Simple constant view that renders a Node with its subtree
@@ -123,7 +128,33 @@ protected:
     }
 };
 
-// Utility adapter for the MV* pattern
+// Returns a new version number. Versions are unique across all models.
+uint64_t next_version();
+
+// Epoch of global state affecting the rendering of all views. Compared by
+// ModelView to detect changes not tracked by model versions.
+extern uint64_t render_epoch;
+
+// Force all ModelViews to rerender on their next patch. Call after changing
+// global state views depend on, like user options.
+inline void invalidate_views() { render_epoch++; }
+
+// Base class for models of ModelView, that tracks changes to the model with a
+// version number
+class Versioned {
+public:
+    // Current version of the model. As versions are unique, a replaced model
+    // never has the version of its predecessor.
+    uint64_t version = next_version();
+
+    // Mark the model as changed. Must be called after any modification of the
+    // model, that affects its rendering.
+    void touch() { version = next_version(); }
+};
+
+// Utility adapter for the MV* pattern.
+// M must be derived from Versioned. patch() is a no-op, if neither the model's
+// version nor the render_epoch changed since the last render.
 template <class M> class ModelView : public VirtualView {
 public:
     // Caches model pointer and calls render_model(M*)
@@ -138,9 +169,33 @@ public:
                 id.data());
             throw "model missing";
         }
+        rendered_version = m->version;
+        rendered_epoch = render_epoch;
         return render(m);
     }
 
+    // Returns, if the model and global state did not change since the last
+    // render
+    bool is_current()
+    {
+        auto model = get_model();
+        return model && rendered_epoch == render_epoch
+            && rendered_version == model->version;
+    }
+
+    // Rerender and patch the view, if the model or global state changed since
+    // the last render
+    void patch()
+    {
+        if (!is_current()) {
+            VirtualView::patch();
+        }
+    }
+
+    // Force the next patch() to rerender the view. Call after changing any
+    // view state, that affects rendering.
+    void invalidate() { rendered_epoch = 0; }
+
     // Fetches pointer to model (for example, from some collection or weak
     // pointer). Must return NULL, if model no longer exists.
     virtual M* get_model() = 0;
@@ -153,6 +208,11 @@ protected:
     // The "id" attribute on the root node is ignored and is always set to
     // View::id.
     virtual Node render(M*) = 0;
+
+private:
+    // Model version and render_epoch at the last render. Epoch 0 is never
+    // current, so views start out invalidated.
+    uint64_t rendered_version = 0, rendered_epoch = 0;
 };
 
 // Common functionality of all parent views
@@ -162,7 +222,7 @@ public:
     const std::string tag;
 
     // Creates a new view with an optional specific root node ID.
-    ParentView(std::string tag, std::string id = new_id())
+    ParentView(std::string tag, std::string id = new_string_id())
         : View(id)
         , tag(tag)
     {
@@ -210,6 +270,8 @@ private:
 // V: ModelView<M>
 template <class M, class V> class ListView : public ParentView<V> {
     using ParentView<V>::ParentView;
+
+protected:
     using ParentView<V>::saved;
     using ParentView<V>::saved_attrs;
     using ParentView<V>::attrs;
@@ -217,93 +279,131 @@ template <class M, class V> class ListView : public ParentView<V> {
 public:
     virtual void init()
     {
-        for (auto m : get_list()) {
+        saved_models = get_list();
+        saved.reserve(saved_models.size());
+        for (auto m : saved_models) {
             saved.push_back(create_child(m));
         }
         ParentView<V>::init();
     }
 
     // Patches the attributes of the ListView and reorders its children, while
-    // also creating any missing ones an removing no longer actual children.
+    // also creating any missing ones and removing no longer actual children.
+    // Models are identified by pointer, so they must not be relocated while
+    // listed. Child views patch themselves on model changes, so only
+    // reordered, created and removed views generate mutations.
+    void patch() { patch(false); }
+
     // deep: should patching recurse to the view's child views
-    void patch()
+    void patch(bool deep)
     {
-        saved_attrs.patch(attrs());
-
-        const auto new_list = get_list();
-        const auto new_set
-            = std::unordered_set<M*>(new_list.begin(), new_list.end());
-        std::unordered_map<M*, std::shared_ptr<V>> saved_set;
-        std::vector<M*> saved_list;
-
-        // Map saved views to models
-        saved_set.reserve(saved.size());
-        saved_list.reserve(saved.size());
-        for (auto it = saved.begin(); it != saved.end();) {
-            auto& v = *it;
-            auto m = v->get_model();
-            if (m) {
-                saved_set[m] = v;
-                saved_list.push_back(m);
-                it++;
-            } else {
-                // Get rid of views without models
-                v->remove();
-                it = saved.erase(it);
-            }
-        }
+        saved_attrs.patch(View::id, attrs());
 
-        // Diff and reorder views in the overlaping range
-        for (size_t i = 0; i < saved_list.size() && i < new_list.size(); i++) {
-            auto m = new_list[i];
-            if (saved_list[i] == m) {
-                saved_set[m]->patch();
-                saved_set.erase(m);
-                continue;
-            }
+        const auto& new_list = get_list();
 
-            std::shared_ptr<V> v;
-            if (saved_set.count(m)) {
-                v = saved_set.at(m);
-                if (!i) {
-                    move_prepend(View::id, v->id);
-                } else {
-                    move_after(saved[i - 1]->id, v->id);
-                }
-                saved_set[m]->patch();
-                saved_set.erase(m);
-            } else {
-                v = create_child(m);
-                if (!i) {
-                    prepend(View::id, v->html());
-                } else {
-                    after(View::id, v->html());
-                }
+        // Fast path for unchanged lists and pure appends, which is the most
+        // common case for live updates
+        size_t start = 0;
+        while (start < saved_models.size() && start < new_list.size()
+            && saved_models[start] == new_list[start]) {
+            if (deep) {
+                saved[start]->patch();
             }
-            saved[i] = v;
+            start++;
         }
-
-        if (saved.size() > new_list.size()) {
-            // Remove all unused old views
-            for (auto& p : saved_set) {
-                p.second->remove();
-            }
-            saved.resize(new_list.size());
-        } else {
-            // Append all missing views
-            for (size_t i = saved.size() - 1; i < new_list.size(); i++) {
+        if (start == saved_models.size()) {
+            for (size_t i = start; i < new_list.size(); i++) {
                 append(View::id,
                     saved.emplace_back(create_child(new_list[i]))->html());
+                saved_models.push_back(new_list[i]);
             }
+            return;
         }
+
+        reorder(new_list, start, deep);
     }
 
 protected:
-    // Returns an ordered list of models to be used to render view contents
-    virtual std::vector<M*> get_list() = 0;
+    // Returns an ordered list of models to be used to render view contents.
+    // The list must not be modified during patching.
+    virtual const std::vector<M*>& get_list() = 0;
 
     // Create a new instance of a child view
     virtual std::shared_ptr<V> create_child(M*) = 0;
+
+    // Remove a child view, whose model is no longer listed, from the DOM.
+    // The view is destroyed after patching, unless referenced elsewhere.
+    virtual void remove_child(V* v) { v->remove(); }
+
+private:
+    // Models of the views in saved at the same positions
+    std::vector<M*> saved_models;
+
+    // Reconcile saved views with new_list, that shares the first start models
+    // with saved_models. Only the views not in the longest increasing
+    // subsequence of reused views' old positions are moved.
+    void reorder(const std::vector<M*>& new_list, size_t start, bool deep)
+    {
+        size_t old_end = saved_models.size(), new_end = new_list.size();
+        while (old_end > start && new_end > start
+            && saved_models[old_end - 1] == new_list[new_end - 1]) {
+            old_end--;
+            new_end--;
+        }
+
+        std::unordered_map<M*, size_t> old_pos;
+        old_pos.reserve(old_end - start);
+        for (size_t i = start; i < old_end; i++) {
+            old_pos.emplace(saved_models[i], i);
+        }
+        std::vector<size_t> sources(new_end - start, SIZE_MAX);
+        for (size_t j = start; j < new_end; j++) {
+            if (auto it = old_pos.find(new_list[j]); it != old_pos.end()) {
+                sources[j - start] = it->second;
+                old_pos.erase(it);
+            }
+        }
+
+        // Any views left unmatched are no longer listed
+        for (auto& p : old_pos) {
+            remove_child(saved[p.second].get());
+        }
+
+        const auto stable = longest_increasing_subsequence(sources);
+
+        std::vector<std::shared_ptr<V>> views;
+        views.reserve(new_list.size());
+        for (size_t i = 0; i < start; i++) {
+            views.push_back(std::move(saved[i]));
+        }
+        for (size_t j = start; j < new_end; j++) {
+            // Empty sibling ID inserts at the front
+            const std::string_view prev
+                = views.empty() ? std::string_view() : views.back()->id;
+            const size_t src = sources[j - start];
+            if (src == SIZE_MAX) {
+                auto& v = views.emplace_back(create_child(new_list[j]));
+                insert_child_after(View::id, prev, v->html());
+            } else {
+                auto& v = views.emplace_back(std::move(saved[src]));
+                if (!stable[j - start]) {
+                    move_child_after(View::id, prev, v->id);
+                }
+                if (deep) {
+                    v->patch();
+                }
+            }
+        }
+        for (size_t i = old_end; i < saved.size(); i++) {
+            if (deep) {
+                saved[i]->patch();
+            }
+            views.push_back(std::move(saved[i]));
+        }
+
+        saved = std::move(views);
+        saved_models = new_list;
+    }
 };
 
 // Combines multiple views as its children. The list and order of the child
@@ -320,7 +420,7 @@ public:
     // deep: should patching recurse to the view's child views
     void patch()
     {
-        saved_attrs.patch(attrs());
+        saved_attrs.patch(View::id, attrs());
         for (auto& v : saved) {
             v->patch();
         }
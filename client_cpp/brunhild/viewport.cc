@@ -0,0 +1,57 @@
+#include "viewport.hh"
+#include <emscripten.h>
+#include <emscripten/bind.h>
+#include <unordered_map>
+
+namespace brunhild {
+
+// All registered viewport handlers by ID
+static std::unordered_map<long, ViewportHandler> handlers;
+
+static long id_counter = 0;
+
+// Child heights of a measurement are written here by dom.js. Resized to fit
+// the measurement before each dispatch.
+static std::vector<int32_t> children;
+
+long watch_viewport(std::string id, ViewportHandler handler)
+{
+    const long watcher = id_counter++;
+    handlers[watcher] = std::move(handler);
+    EM_ASM({ brunhild.watchViewport($0, UTF8ToString($1)); }, watcher,
+        id.c_str());
+    return watcher;
+}
+
+void unwatch_viewport(long id)
+{
+    if (handlers.erase(id)) {
+        EM_ASM({ brunhild.unwatchViewport($0); }, id);
+    }
+}
+
+// Returns the address of the child height buffer resized to n entries
+static uintptr_t viewport_buffer(size_t n)
+{
+    children.resize(n);
+    return reinterpret_cast<uintptr_t>(children.data());
+}
+
+static void dispatch_viewport(long id, int top, int height)
+{
+    auto it = handlers.find(id);
+    if (it == handlers.end()) {
+        return;
+    }
+
+    // Handler might unwatch itself and destroy its own function
+    auto h = it->second;
+    h({ top, height, children });
+}
+
+EMSCRIPTEN_BINDINGS(module_viewport)
+{
+    emscripten::function("_viewport_buffer", &viewport_buffer);
+    emscripten::function("_dispatch_viewport", &dispatch_viewport);
+}
+}
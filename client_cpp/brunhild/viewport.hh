@@ -0,0 +1,35 @@
+#pragma once
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace brunhild {
+
+// Position of the viewport relative to a watched element and the layout of
+// the element's children, as measured on the main thread
+struct Viewport {
+    // Offset of the viewport from the top of the element in pixels
+    int top = 0;
+
+    // Height of the viewport in pixels
+    int height = 0;
+
+    // Distances between the tops of consecutive children of the element, so
+    // margins are included. The last child's entry is its own height.
+    const std::vector<int32_t>& children;
+};
+
+// Handles a viewport measurement
+typedef std::function<void(const Viewport&)> ViewportHandler;
+
+// Measure an element's viewport on the next frame and on every following
+// frame, in which the document was scrolled or resized. Measurements are
+// skipped, while the element is not in the DOM.
+// Returns watcher ID.
+long watch_viewport(std::string id, ViewportHandler handler);
+
+// Stop watching an element's viewport by watcher ID
+void unwatch_viewport(long id);
+}
@@ -0,0 +1,1469 @@
+// Native benchmark driver. Runs synthetic workloads through the client's
+// decoding, view and DOM mutation pipeline against RecordingDOM and reports
+// timings, heap allocations and the DOM commands each workload generates.
+//
+// Usage: bench [post_count] [trace]
+// trace: file of websocket messages to replay, one per line, as logged by the
+// client with debug=true
+
+#include "../brunhild/mutations.hh"
+#include "../brunhild/timer_wheel.hh"
+#include "../brunhild/view.hh"
+#include "../src/connection/connection.hh"
+#include "../src/lang.hh"
+#include "../src/options/options.hh"
+#include "../src/page/thread.hh"
+#include "../src/posts/hide.hh"
+#include "../src/state.hh"
+#include "encoder.hh"
+#include "lang_stub.hh"
+#include "recorder.hh"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <new>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using brunhild::Node;
+using std::string;
+
+// Heap allocations performed since program start
+static size_t allocations = 0;
+
+// The replacements below pair malloc() with free() consistently, but GCC can
+// not tell they replace the global allocation functions
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size)
+{
+    allocations++;
+    if (void* p = malloc(size ? size : 1); p) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+// Measures wall time and heap allocations of a scope
+class Measurement {
+public:
+    Measurement()
+        : start(std::chrono::steady_clock::now())
+        , start_allocs(allocations)
+    {
+    }
+
+    double ms() const
+    {
+        return std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start)
+            .count();
+    }
+
+    size_t allocs() const { return allocations - start_allocs; }
+
+private:
+    const std::chrono::steady_clock::time_point start;
+    const size_t start_allocs;
+};
+
+static RecordingDOM* dom;
+
+// Flush pending mutations into dom and return the number of commands applied
+static size_t flush_commands()
+{
+    const auto before = dom->command_count();
+    brunhild::flush();
+    return dom->command_count() - before;
+}
+
+static void print_header(const char* title)
+{
+    printf("\n%s\n%-28s %10s %10s %10s %10s\n", title, "workload", "ms",
+        "allocs", "commands", "bytes");
+}
+
+static void print_row(
+    const char* name, const Measurement& m, size_t commands, size_t bytes)
+{
+    printf("%-28s %10.3f %10zu %10zu %10zu\n", name, m.ms(), m.allocs(),
+        commands, bytes);
+}
+
+// Synthetic thread with its posts. The first post is the OP.
+struct Fixture {
+    Thread thread;
+    std::vector<Post> posts;
+};
+
+static Post make_post(unsigned long id, unsigned long op, std::mt19937& rng)
+{
+    static const char* const words[] = { "lorem", "ipsum", "dolor", "sit",
+        "amet", "consectetur", "adipiscing", "elit", "sed", "do", "eiusmod" };
+
+    Post p;
+    p.id = id;
+    p.op = op;
+    p.time = 1500000000 + id;
+    p.board = "a";
+    const int lines = 1 + rng() % 4;
+    for (int i = 0; i < lines; i++) {
+        if (i) {
+            p.body += '\n';
+        }
+        if (id > op && rng() % 4 == 0) {
+            // Quote an earlier post of the thread
+            const unsigned long target = op + rng() % (id - op);
+            p.body += ">>" + std::to_string(target) + ' ';
+            p.links[target] = { false, op, "a" };
+        }
+        const int n = 3 + rng() % 12;
+        for (int j = 0; j < n; j++) {
+            if (j) {
+                p.body += ' ';
+            }
+            p.body += words[rng() % (sizeof(words) / sizeof(*words))];
+        }
+    }
+    if (rng() % 4 == 0) {
+        p.name = "name" + std::to_string(rng() % 100);
+    }
+    if (rng() % 3 == 0) {
+        Image img;
+        img.file_type = FileType::jpg;
+        img.thumb_type = FileType::jpg;
+        img.dims[0] = 1280;
+        img.dims[1] = 720;
+        img.dims[2] = 150;
+        img.dims[3] = 84;
+        img.size = 100000 + rng() % 900000;
+        img.MD5 = "d41d8cd98f00b204e9800998ecf8427e";
+        img.SHA1 = "da39a3ee5e6b4b0d3255bfef95601890afd80709";
+        img.name = "image" + std::to_string(id);
+        p.image = std::move(img);
+    }
+    return p;
+}
+
+static Fixture make_thread(unsigned long id, size_t post_count)
+{
+    std::mt19937 rng(id);
+    Fixture f;
+    auto& t = f.thread;
+    t.id = id;
+    t.time = t.reply_time = t.bump_time = 1500000000 + id;
+    t.post_ctr = post_count;
+    t.image_ctr = 0;
+    t.board = "a";
+    t.subject = "Thread " + std::to_string(id);
+    f.posts.reserve(post_count);
+    for (size_t i = 0; i < post_count; i++) {
+        auto& p = f.posts.emplace_back(make_post(id + i, id, rng));
+        if (p.image) {
+            t.image_ctr++;
+        }
+    }
+    return f;
+}
+
+// Append a JSON string literal
+static void write_json_string(string& out, std::string_view s)
+{
+    out += '"';
+    for (char ch : s) {
+        switch (ch) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        default:
+            out += ch;
+        }
+    }
+    out += '"';
+}
+
+// Encode a fixture as a thread page JSON payload
+static string encode_json(const Fixture& f)
+{
+    auto& t = f.thread;
+    string s = "{\"id\":" + std::to_string(t.id)
+        + ",\"time\":" + std::to_string(t.time)
+        + ",\"postCtr\":" + std::to_string(t.post_ctr)
+        + ",\"imageCtr\":" + std::to_string(t.image_ctr)
+        + ",\"replyTime\":" + std::to_string(t.reply_time)
+        + ",\"bumpTime\":" + std::to_string(t.bump_time) + ",\"board\":";
+    write_json_string(s, t.board);
+    s += ",\"subject\":";
+    write_json_string(s, t.subject);
+    s += ",\"posts\":[";
+    for (auto& p : f.posts) {
+        if (&p != &f.posts.front()) {
+            s += ',';
+        }
+        s += "{\"editing\":false,\"id\":" + std::to_string(p.id)
+            + ",\"time\":" + std::to_string(p.time) + ",\"body\":";
+        write_json_string(s, p.body);
+        if (p.name) {
+            s += ",\"name\":";
+            write_json_string(s, *p.name);
+        }
+        if (p.image) {
+            auto& img = *p.image;
+            s += ",\"image\":{\"fileType\":"
+                + std::to_string(int(img.file_type))
+                + ",\"thumbType\":" + std::to_string(int(img.thumb_type))
+                + ",\"dims\":[";
+            for (int i = 0; i < 4; i++) {
+                s += (i ? "," : "") + std::to_string(img.dims[i]);
+            }
+            s += "],\"size\":" + std::to_string(img.size) + ",\"MD5\":";
+            write_json_string(s, img.MD5);
+            s += ",\"SHA1\":";
+            write_json_string(s, img.SHA1);
+            s += ",\"name\":";
+            write_json_string(s, img.name);
+            s += '}';
+        }
+        if (p.links.size()) {
+            s += ",\"links\":[";
+            bool first = true;
+            for (auto & [ id, l ] : p.links) {
+                if (!first) {
+                    s += ',';
+                }
+                first = false;
+                s += "{\"id\":" + std::to_string(id)
+                    + ",\"op\":" + std::to_string(l.op) + ",\"board\":";
+                write_json_string(s, l.board);
+                s += '}';
+            }
+            s += ']';
+        }
+        s += '}';
+    }
+    s += "]}";
+    return s;
+}
+
+static string encode_binary(const Fixture& f)
+{
+    BinaryEncoder e;
+    e.write_header(0, 1);
+    e.write_thread(f.thread, f.posts);
+    return e.buf;
+}
+
+static void bench_decode(const Fixture& f)
+{
+    print_header("decode");
+    const auto n = f.posts.size();
+    for (auto[name, payload] : { std::pair{ "json", encode_json(f) },
+             std::pair{ "binary", encode_binary(f) } }) {
+        clear_posts();
+
+        // JSON is unescaped in place, so decode a fresh copy
+        string buf = payload;
+        Measurement m;
+        load_posts(buf.data(), buf.size());
+        print_row(name, m, 0, payload.size());
+        if (posts.size() != n) {
+            fprintf(stderr, "%s: decoded %zu of %zu posts\n", name,
+                posts.size(), n);
+            exit(1);
+        }
+        for (auto& p : f.posts) {
+            if (auto field = compare_posts(p, *posts.find(p.id)); field) {
+                fprintf(stderr, "%s: post %lu: %s differs\n", name, p.id,
+                    field);
+                exit(1);
+            }
+        }
+    }
+}
+
+// Returns the text of the first text node of each child of an element
+static std::vector<string> child_texts(std::string_view id)
+{
+    std::vector<string> texts;
+    if (auto el = dom->get_element_by_id(id); el) {
+        for (auto& ch : el->children) {
+            texts.push_back(ch->children.size() ? ch->children[0]->text : "");
+        }
+    }
+    return texts;
+}
+
+// Exit with an error, if the children of an element do not contain the items
+// in order
+static void check_order(
+    const char* workload, std::string_view id, std::vector<unsigned long>& items)
+{
+    const auto texts = child_texts(id);
+    bool ok = texts.size() == items.size();
+    for (size_t i = 0; ok && i < items.size(); i++) {
+        ok = texts[i] == std::to_string(items[i]);
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: DOM does not match rendered list\n", workload);
+        exit(1);
+    }
+}
+
+// Named reordering of a list of items
+struct ListEdit {
+    const char* name;
+    void (*fn)(std::vector<unsigned long>&, std::mt19937&);
+};
+
+static const ListEdit list_edits[] = {
+    { "append", [](auto& l, auto&) { l.push_back(l.size() + 1000000); } },
+    { "prepend",
+        [](auto& l, auto&) { l.insert(l.begin(), l.size() + 2000000); } },
+    { "swap two",
+        [](auto& l, auto&) { std::swap(l[1], l[l.size() - 2]); } },
+    { "move last to front",
+        [](auto& l, auto&) { std::rotate(l.begin(), l.end() - 1, l.end()); } },
+    { "remove every 10th",
+        [](auto& l, auto&) {
+            size_t i = 0;
+            l.erase(std::remove_if(
+                        l.begin(), l.end(), [&](auto) { return i++ % 10 == 0; }),
+                l.end());
+        } },
+    { "reverse", [](auto& l, auto&) { std::reverse(l.begin(), l.end()); } },
+    { "shuffle",
+        [](auto& l, auto& rng) { std::shuffle(l.begin(), l.end(), rng); } },
+};
+
+// Keyed children of a VirtualView
+class KeyedList : public brunhild::VirtualView {
+public:
+    std::vector<unsigned long> items;
+
+    Node render()
+    {
+        Node n("ul");
+        n.children.reserve(items.size());
+        for (auto i : items) {
+            n.children.emplace_back("li", std::to_string(i)).key = i;
+        }
+        return n;
+    }
+};
+
+static void bench_keyed_children(size_t size)
+{
+    print_header("VirtualView keyed children");
+    std::mt19937 rng(1);
+    KeyedList v;
+    for (size_t i = 0; i < size; i++) {
+        v.items.push_back(i + 1);
+    }
+    brunhild::set_inner_html("root", v.html());
+    flush_commands();
+
+    for (auto& e : list_edits) {
+        e.fn(v.items, rng);
+        const auto bytes = dom->bytes;
+        Measurement m;
+        v.patch();
+        const auto commands = flush_commands();
+        print_row(e.name, m, commands, dom->bytes - bytes);
+        check_order(e.name, v.id, v.items);
+    }
+}
+
+// Model and child view of ItemList
+struct Item {
+    unsigned long id;
+};
+
+class ItemView : public brunhild::VirtualView {
+public:
+    ItemView(Item* item)
+        : item(item)
+    {
+    }
+
+    Node render() { return Node("li", std::to_string(item->id)); }
+
+private:
+    Item* const item;
+};
+
+class ItemList : public brunhild::ListView<Item, ItemView> {
+public:
+    std::vector<Item*> list;
+
+    ItemList()
+        : ListView("ul")
+    {
+    }
+
+protected:
+    const std::vector<Item*>& get_list() { return list; }
+
+    std::shared_ptr<ItemView> create_child(Item* item)
+    {
+        return std::make_shared<ItemView>(item);
+    }
+};
+
+static void bench_list_view(size_t size)
+{
+    print_header("ListView");
+    std::mt19937 rng(1);
+
+    // Items are identified by pointer, so allocate enough for all edits up
+    // front to keep them from relocating
+    std::vector<Item> items;
+    items.reserve(size * 2);
+    std::vector<unsigned long> ids;
+    ItemList v;
+    for (size_t i = 0; i < size; i++) {
+        v.list.push_back(&items.emplace_back(Item{ i + 1 }));
+        ids.push_back(i + 1);
+    }
+    brunhild::set_inner_html("root", v.html());
+    flush_commands();
+
+    for (auto& e : list_edits) {
+        e.fn(ids, rng);
+
+        // Map the edited IDs back to items, creating any new ones
+        v.list.clear();
+        for (auto id : ids) {
+            auto it = std::find_if(items.begin(), items.end(),
+                [=](auto& item) { return item.id == id; });
+            v.list.push_back(
+                it == items.end() ? &items.emplace_back(Item{ id }) : &*it);
+        }
+
+        const auto bytes = dom->bytes;
+        Measurement m;
+        v.patch();
+        const auto commands = flush_commands();
+        print_row(e.name, m, commands, dom->bytes - bytes);
+        check_order(e.name, v.id, ids);
+    }
+}
+
+// Byte by byte escaping for comparison with brunhild::escape()
+static string escape_bytewise(const string& s)
+{
+    string out;
+    out.reserve(s.size() * 1.1);
+    for (auto ch : s) {
+        switch (ch) {
+        case '&':
+            out += "&amp;";
+            break;
+        case '\'':
+            out += "&#39;";
+            break;
+        case '<':
+            out += "&lt;";
+            break;
+        case '>':
+            out += "&gt;";
+            break;
+        case '"':
+            out += "&#34;";
+            break;
+        default:
+            out += ch;
+        }
+    }
+    return out;
+}
+
+static void bench_escape(const Fixture& f)
+{
+    print_header("escape post bodies");
+    const int rounds = 20;
+    std::vector<string> bodies, expected;
+    size_t bytes = 0;
+    for (auto& p : f.posts) {
+        bodies.push_back(p.body);
+        expected.push_back(escape_bytewise(p.body));
+        bytes += p.body.size();
+    }
+    bytes *= rounds;
+
+    size_t sink = 0;
+    Measurement bm;
+    for (int r = 0; r < rounds; r++) {
+        for (auto& b : bodies) {
+            sink += escape_bytewise(b).size();
+        }
+    }
+    print_row("bytewise", bm, 0, bytes);
+
+    // Escape copies of the bodies to measure the allocations of escape()
+    // itself
+    std::vector<std::vector<string>> copies(rounds, bodies);
+    std::vector<string> escaped;
+    escaped.reserve(bodies.size());
+    Measurement em;
+    for (auto& c : copies) {
+        escaped.clear();
+        for (auto& b : c) {
+            escaped.push_back(brunhild::escape(std::move(b)));
+        }
+    }
+    print_row("escape", em, 0, bytes);
+    if (escaped != expected) {
+        fprintf(stderr, "escape: output does not match\n");
+        exit(1);
+    }
+
+    auto rope = brunhild::Rope::linear(bytes * 2 / rounds);
+    Measurement rm;
+    for (int r = 0; r < rounds; r++) {
+        for (auto& b : bodies) {
+            brunhild::escape(rope, b);
+        }
+        sink += rope.take().size();
+    }
+    print_row("escape into Rope", rm, 0, bytes);
+
+    // Keep the results observable
+    if (!sink) {
+        fprintf(stderr, "escape: no output\n");
+    }
+}
+
+// Render posts with the bodies built from random lines as both closed and
+// open posts and report body throughput
+static void bench_bodies(const char* title, const char* const* lines,
+    size_t line_count, const char* prefix, const char* suffix, size_t count)
+{
+    print_header(title);
+    clear_posts();
+    std::mt19937 rng(4);
+    std::vector<unsigned long> ids;
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        Post p;
+        p.id = 2 + i; // No thread is stored for the OP
+        p.op = 1;
+        p.time = 1500000000 + p.id;
+        p.board = "a";
+        p.body = prefix;
+        for (int j = 0; j < 32; j++) {
+            if (j) {
+                p.body += '\n';
+            }
+            p.body += lines[rng() % line_count];
+        }
+        p.body += suffix;
+        p.links[1] = { false, 1, "a" };
+        bytes += p.body.size();
+        ids.push_back(store_post(std::move(p)).id);
+    }
+
+    for (bool editing : { false, true }) {
+        for (auto id : ids) {
+            posts.find(id)->editing = editing;
+        }
+
+        size_t html = 0;
+        Measurement m;
+        for (auto id : ids) {
+            PostView v(id);
+            html += v.html().size();
+        }
+        const double ms = m.ms();
+        print_row(editing ? "open posts" : "closed posts", m, 0, html);
+        printf("%-28s %10.1f MB/s\n", "", bytes / ms / 1000);
+    }
+}
+
+// Bodies dense in formatting
+static void bench_body(size_t count)
+{
+    static const char* const lines[] = {
+        "plain text without any formatting, just words and punctuation.",
+        "some **spoilered** text with @@bold@@ and ~~italic~~ words",
+        ">quoted line with a >>1 link and an ~~italic **spoiler**~~",
+        "``for (int i = 0; i < n; i++) { sum += a[i] * 2; }``",
+        "mixed ``code`` and ^rred^r and ^bblue^b text, ``\"quoted\"``",
+        "",
+    };
+    bench_bodies("render formatted bodies", lines,
+        sizeof(lines) / sizeof(*lines), "", "", count);
+}
+
+// Bodies consisting of a single large code block
+static void bench_code(size_t count)
+{
+    static const char* const lines[] = {
+        "static int sum(const int* a, size_t n) // Sum of all elements",
+        "    for (size_t i = 0; i < n; i++) { total += a[i] * 2; }",
+        "    if (x != nullptr && *x >= 0) { return x->value; }",
+        "    const char* s = \"string literal with \\\"escapes\\\"\";",
+        "    while (!done) { done = step(&state) == -1 || i++ > 100; }",
+        "}",
+    };
+    bench_bodies("render code blocks", lines, sizeof(lines) / sizeof(*lines),
+        "``", "``", count);
+}
+
+static void bench_thread(const Fixture& f, size_t appends)
+{
+    print_header("thread page");
+    clear_posts();
+    auto payload = encode_binary(f);
+    load_posts(payload.data(), payload.size());
+    page.thread = f.thread.id;
+
+    ThreadView tv(f.thread.id, "thread-container");
+    auto bytes = dom->bytes;
+    Measurement m;
+    brunhild::set_inner_html("root", tv.html());
+    auto commands = flush_commands();
+    print_row("initial render", m, commands, dom->bytes - bytes);
+
+    // Live updates append posts one at a time
+    std::mt19937 rng(2);
+    const auto next_id = f.thread.id + f.posts.size();
+    bytes = dom->bytes;
+    commands = 0;
+    Measurement am;
+    for (size_t i = 0; i < appends; i++) {
+        store_post(make_post(next_id + i, f.thread.id, rng));
+        tv.patch();
+        commands += flush_commands();
+    }
+    print_row("append posts", am, commands, dom->bytes - bytes);
+
+    // Rerender every post without changes, like on an option toggle. Only
+    // rendering and diffing is measured, as nothing has to be mutated.
+    bytes = dom->bytes;
+    Measurement rm;
+    for (auto& p : f.posts) {
+        if (auto post = posts.find(p.id)) {
+            post->patch();
+        }
+    }
+    commands = flush_commands();
+    print_row("repatch posts", rm, commands, dom->bytes - bytes);
+
+    // Toggling an option changes every post. With a frame budget the
+    // mutations are spread over several flushes, but must produce the same
+    // document.
+    options.relative_time = !options.relative_time;
+    brunhild::invalidate_views();
+    for (auto& p : f.posts) {
+        if (auto post = posts.find(p.id)) {
+            post->patch();
+        }
+    }
+    brunhild::frame_budget = 0.05;
+    bytes = dom->bytes;
+    commands = 0;
+    size_t frames = 0;
+    Measurement bm;
+    for (size_t c; (c = flush_commands()); frames++) {
+        commands += c;
+    }
+    brunhild::frame_budget = 0;
+    char name[64];
+    snprintf(name, sizeof(name), "budgeted repatch (%zu frames)", frames);
+    print_row(name, bm, commands, dom->bytes - bytes);
+
+    const auto budgeted = dom->inner_html("thread-container");
+    for (int i = 0; i < 2; i++) {
+        options.relative_time = !options.relative_time;
+        brunhild::invalidate_views();
+        tv.patch();
+        for (auto& p : f.posts) {
+            if (auto post = posts.find(p.id)) {
+                post->patch();
+            }
+        }
+        flush_commands();
+    }
+    if (dom->inner_html("thread-container") != budgeted) {
+        fprintf(stderr, "thread: budgeted flush diverged\n");
+        exit(1);
+    }
+
+    const auto rendered
+        = dom->get_element_by_id("thread-container")->children.size();
+    if (rendered != f.posts.size() + appends) {
+        fprintf(stderr, "thread: rendered %zu of %zu posts\n", rendered,
+            f.posts.size() + appends);
+        exit(1);
+    }
+}
+
+static void bench_windowed_thread(const Fixture& f)
+{
+    print_header("windowed thread page");
+    clear_posts();
+    auto payload = encode_binary(f);
+    load_posts(payload.data(), payload.size());
+    page.thread = f.thread.id;
+
+    ThreadView tv(f.thread.id, "windowed-container", true);
+    auto bytes = dom->bytes;
+    Measurement m;
+    brunhild::set_inner_html("root", tv.html());
+    auto commands = flush_commands();
+    print_row("initial render", m, commands, dom->bytes - bytes);
+
+    // Scroll through the whole thread a viewport at a time. Nothing is
+    // measured natively, so all posts have the default estimated height.
+    const int viewport = 1000;
+    const int height = 200 * f.posts.size();
+    size_t max_rendered = 0;
+    bytes = dom->bytes;
+    commands = 0;
+    Measurement sm;
+    for (int top = viewport; top < height; top += viewport) {
+        tv.set_viewport(top, viewport);
+        commands += flush_commands();
+        max_rendered = std::max(max_rendered,
+            dom->get_element_by_id("windowed-container")->children.size());
+    }
+    print_row("scroll through", sm, commands, dom->bytes - bytes);
+
+    bytes = dom->bytes;
+    Measurement jm;
+    const auto target = f.posts[f.posts.size() / 2].id;
+    tv.scroll_to(target);
+    commands = flush_commands();
+    print_row("jump to post", jm, commands, dom->bytes - bytes);
+
+    // The window spans the viewport with a viewport high margin on each side
+    if (max_rendered > 3 * viewport / 200 + 2) {
+        fprintf(stderr, "windowed thread: rendered %zu posts at once\n",
+            max_rendered);
+        exit(1);
+    }
+    auto p = posts.find(target);
+    if (!p || p->views.empty() || !dom->get_element_by_id(p->views[0]->id)) {
+        fprintf(stderr, "windowed thread: post not rendered after jump\n");
+        exit(1);
+    }
+}
+
+// Type into an open post with a long body, one character per patch, like
+// live updates of Message::append do
+static void bench_typing(const Fixture& f, size_t keystrokes)
+{
+    print_header("typing into open post");
+    clear_posts();
+    auto payload = encode_binary(f);
+    load_posts(payload.data(), payload.size());
+    page.thread = f.thread.id;
+
+    ThreadView tv(f.thread.id, "typing-container");
+    brunhild::set_inner_html("root", tv.html());
+    flush_commands();
+
+    auto p = posts.find(f.posts[1].id);
+    p->editing = true;
+    p->body.clear();
+    for (int i = 0; i < 60; i++) {
+        p->body += i % 3 ? "some **spoilered** text with a >>1 link and "
+                           "``int code = 1;`` in it\n"
+                         : ">quoted line, that is a bit longer than the "
+                           "others and wraps\n";
+    }
+    p->touch();
+    p->patch();
+    flush_commands();
+
+    auto bytes = dom->bytes;
+    size_t commands = 0;
+    Measurement m;
+    for (size_t i = 0; i < keystrokes; i++) {
+        p->body += i % 40 == 39 ? '\n' : 'a';
+        p->touch();
+        p->patch();
+        commands += flush_commands();
+    }
+    print_row("append", m, commands, dom->bytes - bytes);
+
+    // Edit a line in the middle, which reparses the following lines
+    bytes = dom->bytes;
+    commands = 0;
+    Measurement sm;
+    for (size_t i = 0; i < keystrokes; i++) {
+        p->body[p->body.size() / 2] = 'a' + i % 26;
+        p->touch();
+        p->patch();
+        commands += flush_commands();
+    }
+    print_row("splice middle", sm, commands, dom->bytes - bytes);
+}
+
+// Prefix a websocket message with its two digit type
+static string wire_message(Message type, std::string_view data)
+{
+    char prefix[3];
+    snprintf(prefix, sizeof(prefix), "%02u", unsigned(type));
+    return prefix + string(data);
+}
+
+// Concatenate messages into one, like the server does for messages sent in
+// the same tick
+static string concat_messages(const std::vector<string>& msgs)
+{
+    string s = "[";
+    for (auto& m : msgs) {
+        if (s.size() > 1) {
+            s += ',';
+        }
+        write_json_string(s, m);
+    }
+    return wire_message(Message::concat, s + ']');
+}
+
+// Websocket message trace of users concurrently writing posts into a thread.
+// Each step returns the messages of one server tick.
+class Trace {
+public:
+    Trace(unsigned long first_id, size_t writers)
+        : first_id(first_id)
+        , writers(writers)
+        , bodies(writers)
+    {
+    }
+
+    std::vector<string> insert_posts()
+    {
+        std::vector<string> msgs;
+        for (size_t i = 0; i < writers; i++) {
+            msgs.push_back(wire_message(Message::insert_post,
+                "{\"id\":" + std::to_string(first_id + i)
+                    + ",\"time\":1500000000,\"editing\":true,\"body\":\"\"}"));
+        }
+        return msgs;
+    }
+
+    // Append a character to every open post. Includes multibyte and newline
+    // characters.
+    std::vector<string> append()
+    {
+        static const uint32_t chars[] = { 'a', 'b', ' ', 'c', '*', '>', 0xe9,
+            0x3042, '\n', 'd' };
+        std::vector<string> msgs;
+        for (size_t i = 0; i < writers; i++) {
+            const auto ch = chars[rng() % (sizeof(chars) / sizeof(*chars))];
+            bodies[i]++;
+            msgs.push_back(wire_message(Message::append,
+                '[' + std::to_string(first_id + i) + ',' + std::to_string(ch)
+                    + ']'));
+        }
+        return msgs;
+    }
+
+    std::vector<string> backspace()
+    {
+        std::vector<string> msgs;
+        for (size_t i = 0; i < writers; i++) {
+            if (bodies[i]) {
+                bodies[i]--;
+                msgs.push_back(wire_message(
+                    Message::backspace, std::to_string(first_id + i)));
+            }
+        }
+        return msgs;
+    }
+
+    // Replace a few characters in the middle of every open post
+    std::vector<string> splice()
+    {
+        std::vector<string> msgs;
+        for (size_t i = 0; i < writers; i++) {
+            const size_t len = std::min<size_t>(bodies[i], 3);
+            msgs.push_back(wire_message(Message::splice,
+                "{\"id\":" + std::to_string(first_id + i)
+                    + ",\"start\":" + std::to_string((bodies[i] - len) / 2)
+                    + ",\"len\":" + std::to_string(len)
+                    + ",\"text\":\"**x\\\"y\\u00e9**\"}"));
+            bodies[i] += 5 - len;
+        }
+        return msgs;
+    }
+
+    std::vector<string> close_posts()
+    {
+        std::vector<string> msgs;
+        for (size_t i = 0; i < writers; i++) {
+            msgs.push_back(wire_message(Message::close_post,
+                "{\"id\":" + std::to_string(first_id + i) + '}'));
+        }
+        return msgs;
+    }
+
+private:
+    const unsigned long first_id;
+    const size_t writers;
+
+    // Length of each open post body in code points
+    std::vector<size_t> bodies;
+
+    std::mt19937 rng{ 3 };
+};
+
+// Pass each message through on_message() and flush after each. Messages are
+// copied into one buffer beforehand, so only decoding and handling them is
+// measured.
+static void replay(const char* name, const std::vector<string>& msgs)
+{
+    string buf;
+    for (auto& m : msgs) {
+        buf += m;
+    }
+    auto bytes = dom->bytes;
+    size_t commands = 0;
+    Measurement m;
+    char* p = buf.data();
+    for (auto& msg : msgs) {
+        on_message(p, msg.size(), false);
+        p += msg.size();
+        commands += flush_commands();
+    }
+    print_row(name, m, commands, dom->bytes - bytes);
+}
+
+// Connect the client and synchronise a thread by feeding the connection state
+// machine and a synchronise message, like the websocket would
+static void sync_thread(const Fixture& f)
+{
+    static bool connected = false;
+    if (!connected) {
+        init_connectivity();
+        conn_SM.feed(ConnEvent::start);
+        conn_SM.feed(ConnEvent::open);
+        connected = true;
+    } else {
+        conn_SM.feed(ConnEvent::switch_sync);
+    }
+    clear_posts();
+    page.thread = f.thread.id;
+    auto msg = wire_message(Message::synchronise, encode_json(f));
+    on_message(msg.data(), msg.size(), false);
+    if (conn_SM.state() != ConnState::synced) {
+        fprintf(stderr, "websocket: thread not synced\n");
+        exit(1);
+    }
+}
+
+// Replay websocket message traces of users writing posts into a thread, both
+// as individual messages and concatenated per server tick
+static void bench_websocket(const Fixture& f, size_t ticks, const char* path)
+{
+    print_header("websocket messages");
+    const size_t writers = 10;
+    const auto first_id = f.thread.id + f.posts.size();
+    for (bool concat : { false, true }) {
+        sync_thread(f);
+        ThreadView tv(f.thread.id, "socket-container");
+        brunhild::set_inner_html("root", tv.html());
+        flush_commands();
+
+        // Messages of each tick are either passed one by one or as a single
+        // concatenated message
+        auto pack = [concat](std::vector<string>& out, std::vector<string> in) {
+            if (concat) {
+                out.push_back(concat_messages(in));
+            } else {
+                out.insert(out.end(), in.begin(), in.end());
+            }
+        };
+        auto run = [&](const char* name, auto step) {
+            std::vector<string> msgs;
+            for (size_t i = 0; i < ticks; i++) {
+                pack(msgs, step());
+            }
+            char row[64];
+            snprintf(row, sizeof(row), "%s%s", name, concat ? " (concat)" : "");
+            replay(row, msgs);
+        };
+
+        Trace trace(first_id, writers);
+        std::vector<string> msgs;
+        pack(msgs, trace.insert_posts());
+        replay(concat ? "insert posts (concat)" : "insert posts", msgs);
+        run("append", [&]() { return trace.append(); });
+        run("splice", [&]() { return trace.splice(); });
+        run("backspace", [&]() { return trace.backspace(); });
+
+        // Interleave all message types, like a live thread
+        size_t tick = 0;
+        run("mixed", [&]() {
+            auto step = trace.append();
+            std::vector<string> more;
+            switch (tick++ % 4) {
+            case 1:
+                more = trace.backspace();
+                break;
+            case 3:
+                more = trace.splice();
+                break;
+            default:
+                more = trace.append();
+            }
+            step.insert(step.end(), more.begin(), more.end());
+            return step;
+        });
+
+        msgs.clear();
+        pack(msgs, trace.close_posts());
+        replay(concat ? "close posts (concat)" : "close posts", msgs);
+
+        const auto rendered
+            = dom->get_element_by_id("socket-container")->children.size();
+        if (rendered != f.posts.size() + writers) {
+            fprintf(stderr, "websocket: rendered %zu of %zu posts\n", rendered,
+                f.posts.size() + writers);
+            exit(1);
+        }
+    }
+
+    // Messages recorded from a browser session, one per line, as logged with
+    // debug=true
+    if (path) {
+        FILE* file = fopen(path, "r");
+        if (!file) {
+            fprintf(stderr, "websocket: can not open %s\n", path);
+            exit(1);
+        }
+        std::vector<string> msgs;
+        char* line = nullptr;
+        size_t cap = 0;
+        for (ssize_t n; (n = getline(&line, &cap, file)) > 0;) {
+            std::string_view s(line, n);
+            while (s.size() && (s.back() == '\n' || s.back() == '\r')) {
+                s.remove_suffix(1);
+            }
+            if (s.substr(0, 2) == "> ") {
+                s.remove_prefix(2);
+            }
+            if (s.size() >= 2) {
+                msgs.emplace_back(s);
+            }
+        }
+        free(line);
+        fclose(file);
+
+        sync_thread(f);
+        ThreadView tv(f.thread.id, "socket-container");
+        brunhild::set_inner_html("root", tv.html());
+        flush_commands();
+        replay("recorded trace", msgs);
+    }
+}
+
+// Verify URL validation and embed detection
+static void check_urls()
+{
+    // Valid URLs and, if they should be rendered as an embed
+    static const std::pair<const char*, bool> cases[] = {
+        { "https://example.com/a?b=c#d", false },
+        { "http://user:pw@[::1]:8080/%20x", false },
+        { "ftp://example.com", false },
+        { "bitcoin:1BoatSLRHtKNngkdXEeobR76b53LETtpyT?amount=1", false },
+        { "https://www.youtube.com/watch?v=dQw4w9WgXcQ", true },
+        { "https://youtube.com/watch/?t=1&v=dQw4w9WgXcQ", true },
+        { "https://youtu.be/dQw4w9WgXcQ", true },
+        { "http://m.youtube.com/embed/dQw4w9WgXcQ", true },
+        { "https://soundcloud.com/artist/track", true },
+        { "https://vimeo.com/123", true },
+        { "https://a.b.youtube.com/watch?v=1", false },
+        { "https://www.youtube.com/watch?v=", false },
+        { "https://vimeo.com/", false },
+    };
+    static const char* const invalid[] = { "word", "javascript:alert(1)",
+        "http:/example.com", "https://", "http://example.com/a|b",
+        "http://example.com:80a", "https://example.com/%zz", "bitcoin:",
+        "magnet:?xt=1", "http://example.com/<b>" };
+
+    clear_posts();
+    auto render = [](const char* body) {
+        Post p;
+        p.id = 2;
+        p.op = 1;
+        p.time = 1500000000;
+        p.board = "a";
+        p.body = body;
+        const auto id = store_post(std::move(p)).id;
+        const auto html = PostView(id).html();
+        return html.substr(html.find("<blockquote"));
+    };
+    for (auto[url, is_embed] : cases) {
+        const auto html = render(url);
+        const bool linked = html.find("<a") != string::npos;
+        const bool embed = html.find("class=\"embed\"") != string::npos;
+        if (!linked || embed != is_embed) {
+            fprintf(stderr, "urls: %s not matched\n", url);
+            exit(1);
+        }
+    }
+    for (auto url : invalid) {
+        if (render(url).find("<a") != string::npos) {
+            fprintf(stderr, "urls: %s matched\n", url);
+            exit(1);
+        }
+    }
+    printf("\nurls: %zu valid and %zu invalid URLs classified\n",
+        sizeof(cases) / sizeof(*cases), sizeof(invalid) / sizeof(*invalid));
+}
+
+// Update the time-dependent elements of all posts of a thread page both by
+// rerendering the posts and by patching only the affected elements
+static void bench_timers(const Fixture& f)
+{
+    print_header("relative timestamps");
+    clear_posts();
+    auto payload = encode_binary(f);
+    load_posts(payload.data(), payload.size());
+    page.thread = f.thread.id;
+    options.relative_time = true;
+    brunhild::invalidate_views();
+
+    ThreadView tv(f.thread.id, "timers-container");
+    brunhild::set_inner_html("root", tv.html());
+    flush_commands();
+
+    auto bytes = dom->bytes;
+    Measurement m;
+    for (auto& p : f.posts) {
+        auto& post = *posts.find(p.id);
+        post.touch();
+        post.patch();
+    }
+    auto commands = flush_commands();
+    print_row("rerender posts", m, commands, dom->bytes - bytes);
+
+    bytes = dom->bytes;
+    Measurement tm;
+    for (auto& p : f.posts) {
+        posts.find(p.id)->patch_time();
+    }
+    commands = flush_commands();
+    print_row("patch time elements", tm, commands, dom->bytes - bytes);
+
+    options.relative_time = false;
+    brunhild::invalidate_views();
+}
+
+// Hide posts of a synthetic reply graph with long reply chains and verify
+// the hidden posts and the posts patched against a sweep in ID order. Posts
+// only link earlier posts, so a single sweep finds all posts linking hidden
+// ones.
+static void check_hidden(size_t count)
+{
+    print_header("hidden posts");
+    clear_posts();
+    std::mt19937 rng(6);
+    const unsigned long first = 2;
+    for (size_t i = 0; i < count; i++) {
+        Post p;
+        p.id = first + i;
+        p.op = 1;
+        p.board = "a";
+        p.time = 1500000000 + p.id;
+        if (i) {
+            // Mostly reply to the previous post, forming long chains
+            const auto n = rng() % 8;
+            const auto prev = p.id - 1;
+            if (n < 7) {
+                p.links[prev] = { false, 1, "a" };
+            }
+            if (n >= 2) {
+                p.links[prev - rng() % std::min<size_t>(i, 200)]
+                    = { false, 1, "a" };
+            }
+        }
+        store_post(std::move(p));
+    }
+
+    auto expect_hidden = [&](const std::vector<unsigned long>& seeds) {
+        std::vector<bool> hidden(count);
+        for (auto id : seeds) {
+            hidden[id - first] = true;
+        }
+        for (size_t i = 0; i < count; i++) {
+            for (auto && [ id, _ ] : posts.at(first + i).links) {
+                hidden[i] = hidden[i] || hidden[id - first];
+            }
+        }
+        return hidden;
+    };
+    auto verify = [&](const char* name, const std::vector<bool>& expected) {
+        for (size_t i = 0; i < count; i++) {
+            if (post_ids.hidden.count(first + i) != expected[i]) {
+                fprintf(stderr, "%s: post %zu hidden state diverged\n", name,
+                    first + i);
+                exit(1);
+            }
+        }
+    };
+
+    options.hide_recursively = true;
+    const std::vector<unsigned long> seeds
+        = { first + count / 10, first + count / 2, first + count - 20 };
+    post_ids.hidden.clear();
+    post_ids.hidden.insert(seeds.begin(), seeds.end());
+    Measurement rm;
+    recurse_hidden_posts();
+    print_row("recurse hidden posts", rm, 0, 0);
+    verify("recurse_hidden_posts", expect_hidden(seeds));
+
+    // Hide a post early in the thread. Only the newly hidden posts and the
+    // posts linking them or linked by them may change.
+    const auto target = first + count / 20;
+    std::vector<unsigned long> all_seeds = seeds;
+    all_seeds.push_back(target);
+    const auto expected = expect_hidden(all_seeds);
+    std::vector<bool> newly_hidden(count), changed(count);
+    for (size_t i = 0; i < count; i++) {
+        newly_hidden[i] = expected[i] && !post_ids.hidden.count(first + i);
+    }
+    for (size_t i = 0; i < count; i++) {
+        for (auto && [ id, _ ] : posts.at(first + i).links) {
+            if (newly_hidden[i] || newly_hidden[id - first]) {
+                changed[i] = changed[id - first] = true;
+            }
+        }
+        changed[i] = changed[i] || newly_hidden[i];
+    }
+    std::vector<uint64_t> versions(count);
+    for (size_t i = 0; i < count; i++) {
+        versions[i] = posts.at(first + i).version;
+    }
+    Measurement hm;
+    hide_recursively(posts.at(target));
+    print_row("hide post recursively", hm, 0, 0);
+    verify("hide_recursively", expected);
+    size_t patched = 0;
+    for (size_t i = 0; i < count; i++) {
+        const bool touched = posts.at(first + i).version != versions[i];
+        if (touched != changed[i]) {
+            fprintf(stderr, "hide_recursively: post %zu %s\n", first + i,
+                touched ? "patched needlessly" : "not patched");
+            exit(1);
+        }
+        patched += touched;
+    }
+    printf("%zu of %zu posts hidden, %zu patched, %zu links\n",
+        post_ids.hidden.size(), count, patched, link_graph.link_count());
+
+    options.hide_recursively = false;
+    post_ids.hidden.clear();
+}
+
+// Verify the timer wheel against a sorted map over random schedules,
+// cancellations and advances spanning all of its levels and on the ticks
+// levels cascade on
+static void check_timer_wheel()
+{
+    std::mt19937 rng(5);
+    int64_t now = 1500000000;
+    brunhild::TimerWheel wheel(now);
+    std::map<unsigned long, int64_t> due;
+    size_t fired = 0;
+    for (int i = 0; i < 20000; i++) {
+        const unsigned long key = rng() % 500;
+        switch (rng() % 4) {
+        case 0:
+        case 1: {
+            // Mostly near times with some beyond the span of the wheel
+            static const int64_t ranges[]
+                = { 2, 64, 4096, 1 << 18, int64_t(1) << 31 };
+            const int64_t at = now - 5 + rng() % ranges[rng() % 5];
+            wheel.schedule(key, at);
+            if (auto[it, inserted] = due.try_emplace(key, at);
+                !inserted && at < it->second) {
+                it->second = at;
+            }
+            break;
+        }
+        case 2:
+            wheel.cancel(key);
+            due.erase(key);
+            break;
+        case 3: {
+            static const int64_t steps[] = { 1, 10, 100, 5000, 300000 };
+            now += 1 + rng() % steps[rng() % 5];
+            std::vector<unsigned long> expected, got;
+            for (auto it = due.begin(); it != due.end();) {
+                if (it->second <= now) {
+                    expected.push_back(it->first);
+                    it = due.erase(it);
+                } else {
+                    it++;
+                }
+            }
+            wheel.advance(now, [&](unsigned long k) { got.push_back(k); });
+            std::sort(got.begin(), got.end());
+            if (got != expected || wheel.size() != due.size()) {
+                fprintf(stderr, "timer wheel: due keys diverged at %lld\n",
+                    (long long)now);
+                exit(1);
+            }
+            fired += got.size();
+            break;
+        }
+        }
+    }
+
+    // Keys due on ticks, where higher levels cascade, advancing one tick at a
+    // time, so they must fire exactly on their tick
+    brunhild::TimerWheel bounds(now);
+    std::map<unsigned long, int64_t> at_tick;
+    unsigned long key = 0;
+    for (int64_t span : { 64, 4096, 1 << 18 }) {
+        for (int64_t k = 1; k <= 3; k++) {
+            const int64_t aligned = (now / span + k) * span;
+            for (int64_t at : { now + k * span, aligned - 1, aligned,
+                     aligned + 1 }) {
+                bounds.schedule(key, at);
+                at_tick[key++] = at;
+            }
+        }
+    }
+    const int64_t last = std::max_element(at_tick.begin(), at_tick.end(),
+        [](auto& a, auto& b) { return a.second < b.second; })->second;
+    while (now < last) {
+        now++;
+        bounds.advance(now, [&](unsigned long k) {
+            if (at_tick.at(k) != now) {
+                fprintf(stderr, "timer wheel: key due at %lld fired at %lld\n",
+                    (long long)at_tick.at(k), (long long)now);
+                exit(1);
+            }
+            at_tick.erase(k);
+            fired++;
+        });
+    }
+    if (!at_tick.empty() || bounds.size()) {
+        fprintf(stderr, "timer wheel: %zu boundary keys not fired\n",
+            at_tick.size());
+        exit(1);
+    }
+
+    printf("\ntimer wheel: %zu keys fired as scheduled\n", fired);
+}
+
+// Applies command buffers directly and, like a worker posting them to the
+// main thread, detached from module memory to a second document
+class DetachingSink : public brunhild::DOMSink {
+public:
+    RecordingDOM direct, mirror;
+
+    DetachingSink(std::string_view body_html)
+        : direct(body_html)
+        , mirror(body_html)
+    {
+    }
+
+    void apply(const uint8_t* buf, size_t size) override
+    {
+        direct.apply(buf, size);
+        detached.clear();
+        brunhild::detach_commands(buf, size, detached);
+        mirror.apply(detached.data(), detached.size());
+    }
+
+private:
+    std::vector<uint8_t> detached;
+};
+
+// Verify detached command buffers produce the same document
+static void check_detached(const Fixture& f, size_t appends)
+{
+    clear_posts();
+    auto payload = encode_binary(f);
+    load_posts(payload.data(), payload.size());
+    page.thread = f.thread.id;
+
+    DetachingSink sink("<div id=\"root\"></div>");
+    brunhild::set_dom_sink(&sink);
+    ThreadView tv(f.thread.id, "detached-container");
+    brunhild::set_inner_html("root", tv.html());
+    brunhild::flush();
+
+    std::mt19937 rng(3);
+    const auto next_id = f.thread.id + f.posts.size();
+    for (size_t i = 0; i < appends; i++) {
+        store_post(make_post(next_id + i, f.thread.id, rng));
+        tv.patch();
+        brunhild::flush();
+    }
+    brunhild::set_dom_sink(dom);
+
+    const auto html = sink.direct.inner_html("root");
+    if (html.empty() || html != sink.mirror.inner_html("root")) {
+        fprintf(stderr, "detached command stream diverged\n");
+        exit(1);
+    }
+    printf("\ndetached command stream: %zu bytes of identical HTML\n",
+        html.size());
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t post_count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000;
+    if (post_count < 4) {
+        fprintf(stderr, "post_count must be at least 4\n");
+        return 1;
+    }
+
+    load_lang();
+    page.thread = 1;
+    // Status elements outside the page content are updated by websocket
+    // message handlers
+    RecordingDOM recorder("<div id=\"root\"></div><span id=\"sync\"></span>"
+                          "<span id=\"thread-post-counters\"></span>");
+    dom = &recorder;
+    brunhild::set_dom_sink(dom);
+
+    // Measure whole workloads instead of the first frame's worth
+    brunhild::frame_budget = 0;
+
+    const auto f = make_thread(1, post_count);
+    bench_decode(f);
+    bench_escape(f);
+    bench_body(post_count);
+    bench_code(post_count);
+    bench_keyed_children(post_count);
+    bench_list_view(post_count);
+    bench_thread(f, 100);
+    bench_windowed_thread(f);
+    bench_typing(f, 200);
+    bench_websocket(f, 100, argc > 2 ? argv[2] : nullptr);
+    bench_timers(f);
+    check_detached(f, 100);
+    check_urls();
+    check_timer_wheel();
+    check_hidden(10000);
+
+    printf("\ntotal: %zu flushes, %zu commands, %zu bytes, %zu misses\n",
+        dom->flushes, dom->command_count(), dom->bytes, dom->misses);
+    brunhild::set_dom_sink(nullptr);
+    return 0;
+}
@@ -0,0 +1,241 @@
+// Dumps the DOM command buffers of a thread rendering workload for
+// worker_test.js, which applies them with dom.js both like a module running
+// on the main thread and like one running in a worker does.
+//
+// Each flush is written as two streams:
+// - the buffer as the main thread applies it from the module's memory. The
+// buffer and the strings it references are copied into one blob with the
+// references rewritten to 4 byte offsets into it, like WASM pointers into
+// HEAPU8.
+// - the buffer detached with detach_commands(), as a worker posts it.
+//
+// Output format, all integers little-endian uint32:
+// flush count, then per flush: blob size, start and end offset of the
+// commands in the blob, blob, detached size, detached buffer. Followed by the
+// size and contents of the inner HTML of the root element as applied by
+// RecordingDOM.
+//
+// Usage: dump_commands out_file
+
+#include "../brunhild/mutations.hh"
+#include "../src/options/options.hh"
+#include "../src/page/thread.hh"
+#include "../src/state.hh"
+#include "lang_stub.hh"
+#include "recorder.hh"
+#include <random>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using brunhild::Op;
+using std::string;
+
+// Padding before the commands in the blob, so they do not start at offset 0
+const size_t blob_padding = 8;
+
+static void write_uint32(string& out, uint32_t n)
+{
+    for (int i = 0; i < 4; i++) {
+        out += char(n >> (i * 8));
+    }
+}
+
+// Copy a command buffer and the strings it references into one blob with the
+// references rewritten to offsets into the blob. Sets end to the end offset of
+// the commands.
+static string rebase(const uint8_t* buf, size_t size, size_t& end)
+{
+    string commands, strings;
+
+    // Positions of references in commands and the offsets of their strings
+    // in strings
+    std::vector<std::pair<size_t, size_t>> refs;
+
+    size_t i = 0;
+    auto read_uint32 = [&]() {
+        if (size - i < 4) {
+            throw std::runtime_error("truncated DOM command buffer");
+        }
+        uint32_t n;
+        memcpy(&n, buf + i, 4);
+        i += 4;
+        return n;
+    };
+    while (i < size) {
+        const auto op = Op(buf[i++]);
+        commands += char(op);
+        for (int j = 0; j < brunhild::operand_count(op); j++) {
+            const uint32_t len = read_uint32();
+            write_uint32(commands, len);
+            if (len & brunhild::string_ref_flag) {
+                const char* p;
+                memcpy(&p, buf + i, sizeof(p));
+                i += sizeof(p);
+                refs.push_back({ commands.size(), strings.size() });
+                write_uint32(commands, 0);
+                strings.append(p, len & ~brunhild::string_ref_flag);
+            } else {
+                commands.append(reinterpret_cast<const char*>(buf) + i, len);
+                i += len;
+            }
+        }
+    }
+
+    end = blob_padding + commands.size();
+    for (auto[pos, off] : refs) {
+        const uint32_t p = end + off;
+        memcpy(&commands[pos], &p, 4);
+    }
+    return string(blob_padding, '\0') + commands + strings;
+}
+
+// Applies command buffers to a RecordingDOM and records both streams of each
+class DumpingSink : public brunhild::DOMSink {
+public:
+    RecordingDOM dom;
+    uint32_t flushes = 0;
+    string out;
+
+    DumpingSink(std::string_view body_html)
+        : dom(body_html)
+    {
+    }
+
+    void apply(const uint8_t* buf, size_t size) override
+    {
+        dom.apply(buf, size);
+        flushes++;
+
+        size_t end;
+        const auto blob = rebase(buf, size, end);
+        write_uint32(out, blob.size());
+        write_uint32(out, blob_padding);
+        write_uint32(out, end);
+        out += blob;
+
+        detached.clear();
+        brunhild::detach_commands(buf, size, detached);
+        write_uint32(out, detached.size());
+        out.append(
+            reinterpret_cast<const char*>(detached.data()), detached.size());
+    }
+
+private:
+    std::vector<uint8_t> detached;
+};
+
+static Post make_post(unsigned long id, unsigned long op, std::mt19937& rng)
+{
+    static const char* const frags[] = { "lorem", "ipsum", " ", " ", "\n",
+        "**bold**", "~~del~~", "`code`", ">quote", "<b>&amp;\"'",
+        "https://example.com/?a=1&b=2", "ünïcödé", "日本語" };
+
+    Post p;
+    p.id = id;
+    p.op = op;
+    p.time = 1500000000 + id;
+    p.board = "a";
+    for (int i = 4 + rng() % 32; i; i--) {
+        p.body += frags[rng() % (sizeof(frags) / sizeof(*frags))];
+    }
+    if (id > op && rng() % 3 == 0) {
+        const unsigned long target = op + rng() % (id - op);
+        p.body += " >>" + std::to_string(target);
+        p.links[target] = { false, op, "a" };
+    }
+    if (rng() % 4 == 0) {
+        p.name = "name" + std::to_string(rng() % 100);
+    }
+    return p;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: dump_commands out_file\n");
+        return 1;
+    }
+
+    load_lang();
+    options.relative_time = false;
+    brunhild::frame_budget = 0;
+
+    const unsigned long op = 1;
+    page.thread = op;
+    {
+        Thread t;
+        t.id = op;
+        t.board = "a";
+        t.subject = "thread";
+        threads[op] = std::move(t);
+    }
+    std::mt19937 rng(1);
+    unsigned long next_id = op;
+    for (int i = 0; i < 50; i++, next_id++) {
+        store_post(make_post(next_id, op, rng));
+    }
+
+    DumpingSink sink("<div id=\"root\"></div><div id=\"ops\"></div>");
+    brunhild::set_dom_sink(&sink);
+    ThreadView tv(op, "thread-container");
+    brunhild::set_inner_html("root", tv.html());
+    brunhild::flush();
+
+    // Live updates
+    for (int i = 0; i < 20; i++, next_id++) {
+        store_post(make_post(next_id, op, rng));
+        tv.patch();
+        if (i % 5 == 4) {
+            brunhild::flush();
+        }
+    }
+    brunhild::flush();
+
+    // Operations thread rendering does not produce
+    brunhild::set_inner_html(
+        "ops", string("<p id=\"a\">a</p><p id=\"b\">b</p>"));
+    brunhild::append("ops", "<p id=\"c\">c</p>");
+    brunhild::prepend("ops", "<p id=\"d\">d</p>");
+    brunhild::flush();
+    brunhild::before("a", "<i id=\"e\">e</i>");
+    brunhild::after("b", "<i id=\"f\">f</i>");
+    brunhild::set_attr("a", "class", "x y");
+    brunhild::set_attr("b", "data-id", "\"q\"");
+    brunhild::remove_attr("a", "class");
+    brunhild::scroll_into_view("b");
+    brunhild::flush();
+    brunhild::move_prepend("ops", "c");
+    brunhild::move_after("a", "d");
+    brunhild::insert_child_after("ops", "b", "<p id=\"g\">g</p>");
+    brunhild::insert_child_after("ops", "", "<p id=\"h\">h</p>");
+    brunhild::move_child_after("ops", "g", "h");
+    brunhild::move_child_after("ops", "", "f");
+    brunhild::flush();
+    brunhild::set_outer_html("e", string("<b id=\"e2\">e2</b><b>tail</b>"));
+    brunhild::set_inner_html("b", string(100, 'x'));
+    brunhild::remove("c");
+    brunhild::flush();
+    brunhild::set_dom_sink(nullptr);
+
+    const auto html = sink.dom.inner_html("root") + sink.dom.inner_html("ops");
+    if (sink.dom.misses) {
+        fprintf(stderr, "%zu commands missed\n", sink.dom.misses);
+        return 1;
+    }
+
+    string out;
+    write_uint32(out, sink.flushes);
+    out += sink.out;
+    write_uint32(out, html.size());
+    out += html;
+
+    FILE* f = fopen(argv[1], "wb");
+    if (!f || fwrite(out.data(), 1, out.size(), f) != out.size() || fclose(f)) {
+        perror(argv[1]);
+        return 1;
+    }
+    return 0;
+}
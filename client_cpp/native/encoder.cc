@@ -0,0 +1,234 @@
+#include "encoder.hh"
+#include "../src/decoder.hh"
+#include <string.h>
+
+void BinaryEncoder::write_header(unsigned long page_total, size_t thread_count)
+{
+    write_byte(binary_payload_tag);
+    write_byte(binary_payload_version);
+    write_uint(page_total);
+    write_uint(thread_count);
+}
+
+void BinaryEncoder::write_thread(const Thread& t, const std::vector<Post>& posts)
+{
+    write_byte(t.deleted | t.locked << 1 | t.sticky << 2);
+    write_uint(t.id);
+    write_uint(t.time);
+    write_uint(t.post_ctr);
+    write_uint(t.image_ctr);
+    write_uint(t.reply_time);
+    write_uint(t.bump_time);
+    write_string(t.board);
+    write_string(t.subject);
+    write_uint(posts.size());
+    for (auto& p : posts) {
+        write_post(p);
+    }
+}
+
+void BinaryEncoder::write_byte(uint8_t b) { buf += char(b); }
+
+void BinaryEncoder::write_uint(uint64_t v)
+{
+    do {
+        uint8_t b = v & 0x7f;
+        v >>= 7;
+        if (v) {
+            b |= 0x80;
+        }
+        write_byte(b);
+    } while (v);
+}
+
+void BinaryEncoder::write_string(std::string_view s)
+{
+    write_uint(s.size());
+    buf += s;
+}
+
+void BinaryEncoder::write_post(const Post& p)
+{
+    const std::optional<std::string>* opt[]
+        = { &p.name, &p.trip, &p.auth, &p.flag, &p.poster_id };
+    uint64_t flags = p.editing | p.deleted << 1 | p.sage << 2 | p.banned << 3
+        | p.sticky << 4 | p.locked << 5 | bool(p.image) << 6;
+    for (int i = 0; i < 5; i++) {
+        flags |= uint64_t(bool(*opt[i])) << (7 + i);
+    }
+    write_uint(flags);
+    write_uint(p.id);
+    write_uint(p.time);
+    write_string(p.body);
+    if (p.image) {
+        write_image(*p.image);
+    }
+    for (auto o : opt) {
+        if (*o) {
+            write_string(**o);
+        }
+    }
+    write_uint(p.commands.size());
+    for (auto& c : p.commands) {
+        write_command(c);
+    }
+    write_uint(p.links.size());
+    for (auto & [ id, l ] : p.links) {
+        write_uint(id);
+        write_uint(l.op);
+        write_string(l.board);
+    }
+}
+
+void BinaryEncoder::write_image(const Image& img)
+{
+    write_byte(img.apng | img.audio << 1 | img.video << 2 | img.spoiler << 3
+        | bool(img.artist) << 4 | bool(img.title) << 5);
+    write_byte(uint8_t(img.file_type));
+    write_byte(uint8_t(img.thumb_type));
+    for (auto d : img.dims) {
+        write_uint(d);
+    }
+    write_uint(img.length);
+    write_uint(img.size);
+    if (img.artist) {
+        write_string(*img.artist);
+    }
+    if (img.title) {
+        write_string(*img.title);
+    }
+    write_string(img.MD5);
+    write_string(img.SHA1);
+    write_string(img.name);
+}
+
+void BinaryEncoder::write_command(const Command& c)
+{
+    write_byte(uint8_t(c.typ));
+    switch (c.typ) {
+    case Command::Type::flip:
+        write_byte(std::get<bool>(c.val));
+        break;
+    case Command::Type::eight_ball:
+        write_string(c.eight_ball);
+        break;
+    case Command::Type::pyu:
+    case Command::Type::pcount:
+    case Command::Type::rcount:
+        write_uint(std::get<unsigned long>(c.val));
+        break;
+    case Command::Type::sync_watch:
+        for (auto v : std::get<std::array<unsigned long, 5>>(c.val)) {
+            write_uint(v);
+        }
+        break;
+    case Command::Type::dice: {
+        // Unrolled dice are zero
+        auto& arr = std::get<std::array<uint16_t, 10>>(c.val);
+        uint8_t size = arr.size();
+        while (size && !arr[size - 1]) {
+            size--;
+        }
+        write_byte(size);
+        for (int i = 0; i < size; i++) {
+            write_uint(arr[i]);
+        }
+    } break;
+    case Command::Type::roulette:
+        for (auto v : std::get<std::array<uint8_t, 2>>(c.val)) {
+            write_byte(v);
+        }
+        break;
+    }
+}
+
+static bool equal_images(const Image& a, const Image& b)
+{
+    return a.apng == b.apng && a.audio == b.audio && a.video == b.video
+        && a.spoiler == b.spoiler && a.file_type == b.file_type
+        && a.thumb_type == b.thumb_type && !memcmp(a.dims, b.dims, sizeof(a.dims))
+        && a.length == b.length && a.size == b.size && a.artist == b.artist
+        && a.title == b.title && a.MD5 == b.MD5 && a.SHA1 == b.SHA1
+        && a.name == b.name;
+}
+
+static bool equal_commands(const Command& a, const Command& b)
+{
+    if (a.typ != b.typ) {
+        return false;
+    }
+    if (a.typ == Command::Type::eight_ball) {
+        return a.eight_ball == b.eight_ball;
+    }
+    return a.val == b.val;
+}
+
+const char* compare_posts(const Post& a, const Post& b)
+{
+#define COMPARE(field)                                                         \
+    if (!(a.field == b.field)) {                                               \
+        return #field;                                                         \
+    }
+    COMPARE(editing)
+    COMPARE(deleted)
+    COMPARE(sage)
+    COMPARE(banned)
+    COMPARE(sticky)
+    COMPARE(locked)
+    COMPARE(id)
+    COMPARE(op)
+    COMPARE(time)
+    COMPARE(body)
+    COMPARE(board)
+    COMPARE(name)
+    COMPARE(trip)
+    COMPARE(auth)
+    COMPARE(flag)
+    COMPARE(poster_id)
+#undef COMPARE
+
+    if (bool(a.image) != bool(b.image)
+        || (a.image && !equal_images(*a.image, *b.image))) {
+        return "image";
+    }
+    if (a.commands.size() != b.commands.size()) {
+        return "commands";
+    }
+    for (size_t i = 0; i < a.commands.size(); i++) {
+        if (!equal_commands(a.commands[i], b.commands[i])) {
+            return "commands";
+        }
+    }
+    if (a.links.size() != b.links.size()) {
+        return "links";
+    }
+    for (auto & [ id, l ] : a.links) {
+        auto it = b.links.find(id);
+        if (it == b.links.end() || it->second.op != l.op
+            || it->second.board != l.board) {
+            return "links";
+        }
+    }
+    return nullptr;
+}
+
+const char* compare_threads(const Thread& a, const Thread& b)
+{
+#define COMPARE(field)                                                         \
+    if (!(a.field == b.field)) {                                               \
+        return #field;                                                         \
+    }
+    COMPARE(deleted)
+    COMPARE(locked)
+    COMPARE(sticky)
+    COMPARE(id)
+    COMPARE(time)
+    COMPARE(post_ctr)
+    COMPARE(image_ctr)
+    COMPARE(reply_time)
+    COMPARE(bump_time)
+    COMPARE(board)
+    COMPARE(subject)
+#undef COMPARE
+    return nullptr;
+}
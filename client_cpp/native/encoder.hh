@@ -0,0 +1,34 @@
+#pragma once
+
+#include "../src/posts/models.hh"
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Encoder for the binary post payload described in decoder.hh. Counterpart of
+// BinaryDecoder for generating payloads in native drivers.
+class BinaryEncoder {
+public:
+    std::string buf;
+
+    // Write the payload header. Must be followed by thread_count threads.
+    void write_header(unsigned long page_total, size_t thread_count);
+
+    // Write a thread and its posts. The first post is the OP.
+    void write_thread(const Thread&, const std::vector<Post>&);
+
+    void write_byte(uint8_t);
+    void write_uint(uint64_t);
+    void write_string(std::string_view);
+    void write_post(const Post&);
+    void write_image(const Image&);
+    void write_command(const Command&);
+};
+
+// Returns the name of the first field differing between two posts or nullptr,
+// if they are equal. Only fields carried by the binary encoding are compared.
+const char* compare_posts(const Post&, const Post&);
+
+// Returns the name of the first differing field of two threads or nullptr
+const char* compare_threads(const Thread&, const Thread&);
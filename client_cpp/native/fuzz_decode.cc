@@ -0,0 +1,247 @@
+// Round-trip fuzzing driver for the binary post decoder. Encodes random
+// threads and posts with every optional field both set and unset, loads them
+// with load_posts() and compares the decoded models field by field. Every
+// truncated prefix of each payload must throw std::runtime_error. Build with
+// SANITIZE=address to also catch out of bounds reads.
+//
+// Usage: fuzz_decode [seed] [count]
+
+#include "../src/state.hh"
+#include "encoder.hh"
+#include <memory>
+#include <random>
+#include <stdarg.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using std::string;
+
+static std::mt19937_64 rng;
+
+static bool coin() { return rng() & 1; }
+
+// Random integer of random magnitude, so varints of all lengths are encoded
+static uint64_t number() { return rng() >> (rng() % 64); }
+
+// Random string of arbitrary bytes
+static string text()
+{
+    string s(rng() % 12, '\0');
+    for (auto& c : s) {
+        c = char(rng());
+    }
+    return s;
+}
+
+static std::optional<string> maybe_text()
+{
+    if (coin()) {
+        return text();
+    }
+    return std::nullopt;
+}
+
+static Image make_image()
+{
+    Image img;
+    img.apng = coin();
+    img.audio = coin();
+    img.video = coin();
+    img.spoiler = coin();
+    img.file_type = FileType(rng() % (int(FileType::txt) + 1));
+    img.thumb_type = FileType(rng() % (int(FileType::txt) + 1));
+    for (auto& d : img.dims) {
+        d = rng();
+    }
+    img.length = rng();
+    img.size = number();
+    img.artist = maybe_text();
+    img.title = maybe_text();
+    img.MD5 = text();
+    img.SHA1 = text();
+    img.name = text();
+    return img;
+}
+
+static Command make_command()
+{
+    Command c;
+    c.typ = Command::Type(rng() % (int(Command::Type::rcount) + 1));
+    switch (c.typ) {
+    case Command::Type::flip:
+        c.val = coin();
+        break;
+    case Command::Type::eight_ball:
+        c.eight_ball = text();
+        break;
+    case Command::Type::pyu:
+    case Command::Type::pcount:
+    case Command::Type::rcount:
+        c.val = (unsigned long)(number());
+        break;
+    case Command::Type::sync_watch: {
+        std::array<unsigned long, 5> arr;
+        for (auto& v : arr) {
+            v = number();
+        }
+        c.val = arr;
+    } break;
+    case Command::Type::dice: {
+        // Rolled dice are never zero
+        std::array<uint16_t, 10> arr = { { 0 } };
+        const size_t n = rng() % (arr.size() + 1);
+        for (size_t i = 0; i < n; i++) {
+            arr[i] = 1 + rng() % 0xffff;
+        }
+        c.val = arr;
+    } break;
+    case Command::Type::roulette:
+        c.val = std::array<uint8_t, 2>({ { uint8_t(rng()), uint8_t(rng()) } });
+        break;
+    }
+    return c;
+}
+
+static Post make_post(unsigned long id, const Thread& t)
+{
+    Post p;
+    p.editing = coin();
+    p.deleted = coin();
+    p.sage = coin();
+    p.banned = coin();
+    p.sticky = coin();
+    p.locked = coin();
+    p.id = id;
+    p.op = t.id;
+    p.board = t.board;
+    p.time = number() >> 1;
+    p.body = text();
+    if (coin()) {
+        p.image = make_image();
+    }
+    p.name = maybe_text();
+    p.trip = maybe_text();
+    p.auth = maybe_text();
+    p.flag = maybe_text();
+    p.poster_id = maybe_text();
+    for (size_t i = rng() % 4; i; i--) {
+        p.commands.push_back(make_command());
+    }
+    for (size_t i = rng() % 4; i; i--) {
+        auto& l = p.links[number()];
+        l.op = number();
+        l.board = text();
+    }
+    return p;
+}
+
+static Thread make_thread(unsigned long id)
+{
+    Thread t;
+    t.deleted = coin();
+    t.locked = coin();
+    t.sticky = coin();
+    t.id = id;
+    t.time = number();
+    t.post_ctr = number();
+    t.image_ctr = number();
+    t.reply_time = number();
+    t.bump_time = number();
+    t.board = text();
+    t.subject = text();
+    return t;
+}
+
+// Load a payload from an exactly sized heap buffer, so reads past its end are
+// caught by sanitizers
+static void load(std::string_view payload)
+{
+    clear_posts();
+    std::unique_ptr<char[]> buf(new char[payload.size()]);
+    memcpy(buf.get(), payload.data(), payload.size());
+    load_posts(buf.get(), payload.size());
+}
+
+[[noreturn]] static void fail(unsigned long iteration, const char* format, ...)
+{
+    fprintf(stderr, "iteration %lu: ", iteration);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+    rng.seed(argc > 1 ? strtoul(argv[1], nullptr, 10) : 1);
+    const unsigned long count = argc > 2 ? strtoul(argv[2], nullptr, 10) : 2000;
+
+    size_t bytes = 0;
+    for (unsigned long i = 0; i < count; i++) {
+        const unsigned page_total = rng();
+        std::vector<std::pair<Thread, std::vector<Post>>> threads_in;
+        unsigned long id = 1;
+        for (size_t j = rng() % 4; j; j--) {
+            auto t = make_thread(id);
+            std::vector<Post> posts_in;
+            for (size_t k = rng() % 5; k; k--) {
+                posts_in.push_back(make_post(id++, t));
+            }
+            threads_in.push_back({ std::move(t), std::move(posts_in) });
+            id++;
+        }
+
+        BinaryEncoder e;
+        e.write_header(page_total, threads_in.size());
+        for (auto & [ t, ps ] : threads_in) {
+            e.write_thread(t, ps);
+        }
+        bytes += e.buf.size();
+
+        try {
+            load(e.buf);
+        } catch (const std::exception& ex) {
+            fail(i, "%s", ex.what());
+        }
+        if (page.page_total != page_total) {
+            fail(i, "page_total %u decoded as %u", page_total,
+                page.page_total);
+        }
+        for (auto & [ t, ps ] : threads_in) {
+            auto it = threads.find(t.id);
+            if (it == threads.end()) {
+                fail(i, "thread %lu not decoded", t.id);
+            }
+            if (auto field = compare_threads(t, it->second); field) {
+                fail(i, "thread %lu: %s differs", t.id, field);
+            }
+            for (auto& p : ps) {
+                auto decoded = posts.find(p.id);
+                if (!decoded) {
+                    fail(i, "post %lu not decoded", p.id);
+                }
+                if (auto field = compare_posts(p, *decoded); field) {
+                    fail(i, "post %lu: %s differs", p.id, field);
+                }
+            }
+        }
+
+        for (size_t size = 1; size < e.buf.size(); size++) {
+            try {
+                load(std::string_view(e.buf).substr(0, size));
+            } catch (const std::runtime_error&) {
+                continue;
+            }
+            fail(i, "prefix of %zu bytes decoded without error", size);
+        }
+    }
+
+    printf("decode: %lu payloads, %zu bytes round-tripped\n", count, bytes);
+    return 0;
+}
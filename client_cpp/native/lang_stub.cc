@@ -0,0 +1,28 @@
+#include "lang_stub.hh"
+#include "../src/lang.hh"
+#include <string>
+
+using std::string;
+
+void load_lang()
+{
+    for (auto key : { "anon", "you", "banned", "in", "ago", "justNow", "and",
+             "omitted", "seeAll", "spoiler", "expand", "expandImages", "show",
+             "hide" }) {
+        lang.posts[key] = key;
+    }
+    for (auto key : { "bottom", "return", "catalog", "top", "lockedToBottom",
+             "last", "reply", "finished" }) {
+        lang.ui[key] = key;
+    }
+    for (auto key : { "post", "image", "second", "minute", "hour", "day",
+             "month", "year" }) {
+        lang.plurals[key] = { key, string(key) + 's' };
+    }
+    for (auto& s : lang.calendar) {
+        s = "Jan";
+    }
+    for (auto& s : lang.week) {
+        s = "Mon";
+    }
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// Populate the language pack with the strings used by post rendering
+void load_lang();
@@ -0,0 +1,534 @@
+#include "recorder.hh"
+#include <algorithm>
+#include <ctype.h>
+#include <stdexcept>
+#include <string.h>
+
+using brunhild::Op;
+
+// Elements without content or closing tag
+static bool is_void(std::string_view tag)
+{
+    static const char* const tags[] = { "area", "base", "br", "col", "embed",
+        "hr", "img", "input", "link", "meta", "source", "track", "wbr" };
+    for (auto t : tags) {
+        if (tag == t) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::string* DOMNode::attr(std::string_view key) const
+{
+    for (auto& a : attrs) {
+        if (a.first == key) {
+            return &a.second;
+        }
+    }
+    return nullptr;
+}
+
+void DOMNode::write_html(std::string& out) const
+{
+    if (tag.empty()) {
+        out += text;
+        return;
+    }
+
+    out += '<';
+    out += tag;
+    for (auto & [ key, val ] : attrs) {
+        out += ' ';
+        out += key;
+        if (val.size()) {
+            out += "=\"";
+            out += val;
+            out += '"';
+        }
+    }
+    out += '>';
+    if (is_void(tag)) {
+        return;
+    }
+    for (auto& ch : children) {
+        ch->write_html(out);
+    }
+    out += "</";
+    out += tag;
+    out += '>';
+}
+
+// Returns, if ch can be part of a tag or attribute name
+static bool is_name_char(char ch)
+{
+    return !isspace((unsigned char)ch) && ch != '>' && ch != '/' && ch != '='
+        && ch != '"' && ch != '\'';
+}
+
+// Read a tag or attribute name and convert it to lowercase
+static std::string read_name(std::string_view html, size_t& i)
+{
+    std::string name;
+    while (i < html.size() && is_name_char(html[i])) {
+        name += tolower((unsigned char)html[i++]);
+    }
+    return name;
+}
+
+static void skip_space(std::string_view html, size_t& i)
+{
+    while (i < html.size() && isspace((unsigned char)html[i])) {
+        i++;
+    }
+}
+
+// Parse the attributes of an opening tag up to and including the closing '>'.
+// Returns, if the tag was self-closing.
+static bool parse_attrs(std::string_view html, size_t& i, DOMNode& el)
+{
+    while (1) {
+        skip_space(html, i);
+        if (i == html.size()) {
+            return false;
+        }
+        switch (html[i]) {
+        case '>':
+            i++;
+            return false;
+        case '/':
+            if (i + 1 < html.size() && html[i + 1] == '>') {
+                i += 2;
+                return true;
+            }
+            i++;
+            continue;
+        }
+
+        auto key = read_name(html, i);
+        if (key.empty()) {
+            // Unexpected quote or '='
+            i++;
+            continue;
+        }
+        std::string val;
+        skip_space(html, i);
+        if (i < html.size() && html[i] == '=') {
+            i++;
+            skip_space(html, i);
+            if (i < html.size() && (html[i] == '"' || html[i] == '\'')) {
+                const char quote = html[i++];
+                const auto end = html.find(quote, i);
+                const auto stop = end == std::string_view::npos ? html.size() : end;
+                val = html.substr(i, stop - i);
+                i = end == std::string_view::npos ? stop : stop + 1;
+            } else {
+                while (i < html.size() && !isspace((unsigned char)html[i])
+                    && html[i] != '>') {
+                    val += html[i++];
+                }
+            }
+        }
+
+        // Duplicate attributes are ignored like in the browser
+        if (!el.attr(key)) {
+            el.attrs.emplace_back(std::move(key), std::move(val));
+        }
+    }
+}
+
+std::vector<std::unique_ptr<DOMNode>> parse_html(std::string_view html)
+{
+    DOMNode root;
+    std::vector<DOMNode*> open = { &root };
+
+    auto push = [&](std::unique_ptr<DOMNode> n) -> DOMNode& {
+        auto& parent = *open.back();
+        n->parent = &parent;
+        return *parent.children.emplace_back(std::move(n));
+    };
+    auto push_text = [&](std::string_view s) {
+        auto& parent = *open.back();
+        if (parent.children.size() && parent.children.back()->tag.empty()) {
+            parent.children.back()->text += s;
+        } else {
+            auto n = std::make_unique<DOMNode>();
+            n->text = s;
+            push(std::move(n));
+        }
+    };
+
+    size_t i = 0;
+    while (i < html.size()) {
+        if (html[i] != '<') {
+            auto end = html.find('<', i);
+            if (end == std::string_view::npos) {
+                end = html.size();
+            }
+            push_text(html.substr(i, end - i));
+            i = end;
+            continue;
+        }
+
+        if (html.substr(i, 4) == "<!--") {
+            const auto end = html.find("-->", i + 4);
+            i = end == std::string_view::npos ? html.size() : end + 3;
+            continue;
+        }
+
+        if (i + 1 < html.size() && html[i + 1] == '/') {
+            i += 2;
+            const auto name = read_name(html, i);
+            const auto end = html.find('>', i);
+            i = end == std::string_view::npos ? html.size() : end + 1;
+
+            // Close the innermost matching element and all elements inside it
+            for (size_t j = open.size() - 1; j > 0; j--) {
+                if (open[j]->tag == name) {
+                    open.resize(j);
+                    break;
+                }
+            }
+            continue;
+        }
+
+        if (i + 1 == html.size() || !isalpha((unsigned char)html[i + 1])) {
+            push_text("<");
+            i++;
+            continue;
+        }
+
+        i++;
+        auto el = std::make_unique<DOMNode>();
+        el->tag = read_name(html, i);
+        const bool self_closing = parse_attrs(html, i, *el);
+        auto& ref = push(std::move(el));
+        if (!self_closing && !is_void(ref.tag)) {
+            open.push_back(&ref);
+        }
+    }
+
+    for (auto& ch : root.children) {
+        ch->parent = nullptr;
+    }
+    return std::move(root.children);
+}
+
+RecordingDOM::RecordingDOM(std::string_view body_html)
+{
+    body.tag = "body";
+    set_children(body, body_html);
+}
+
+void RecordingDOM::index(DOMNode& n)
+{
+    if (auto id = n.attr("id"); id && id->size()) {
+        ids[*id] = &n;
+    }
+    for (auto& ch : n.children) {
+        index(*ch);
+    }
+}
+
+void RecordingDOM::unindex(DOMNode& n)
+{
+    if (auto id = n.attr("id"); id) {
+        if (auto it = ids.find(*id); it != ids.end() && it->second == &n) {
+            ids.erase(it);
+        }
+    }
+    for (auto& ch : n.children) {
+        unindex(*ch);
+    }
+}
+
+void RecordingDOM::insert(DOMNode& parent, size_t i, std::unique_ptr<DOMNode> n)
+{
+    n->parent = &parent;
+    index(*n);
+    parent.children.insert(parent.children.begin() + i, std::move(n));
+}
+
+// Returns the position of a node among its parent's children
+static size_t position(const DOMNode& n)
+{
+    auto& ch = n.parent->children;
+    return std::find_if(ch.begin(), ch.end(),
+               [&](auto& p) { return p.get() == &n; })
+        - ch.begin();
+}
+
+std::unique_ptr<DOMNode> RecordingDOM::detach(DOMNode& n)
+{
+    auto& ch = n.parent->children;
+    auto it = ch.begin() + position(n);
+    auto owned = std::move(*it);
+    ch.erase(it);
+    owned->parent = nullptr;
+    unindex(*owned);
+    return owned;
+}
+
+std::unique_ptr<DOMNode> RecordingDOM::detach_for_move(
+    std::string_view id, const DOMNode& target)
+{
+    auto n = get_element_by_id(id);
+    if (!n || !n->parent) {
+        return nullptr;
+    }
+    for (auto p = &target; p; p = p->parent) {
+        if (p == n) {
+            return nullptr;
+        }
+    }
+    return detach(*n);
+}
+
+void RecordingDOM::set_children(DOMNode& el, std::string_view html)
+{
+    for (auto& ch : el.children) {
+        unindex(*ch);
+    }
+    el.children.clear();
+    for (auto& n : parse_html(html)) {
+        insert(el, el.children.size(), std::move(n));
+    }
+}
+
+DOMNode* RecordingDOM::get_element_by_id(std::string_view id) const
+{
+    if (auto it = ids.find(std::string(id)); it != ids.end()) {
+        return it->second;
+    }
+    return nullptr;
+}
+
+std::string RecordingDOM::inner_html(std::string_view id) const
+{
+    std::string s;
+    if (auto el = get_element_by_id(id); el) {
+        for (auto& ch : el->children) {
+            ch->write_html(s);
+        }
+    }
+    return s;
+}
+
+std::string RecordingDOM::outer_html(std::string_view id) const
+{
+    std::string s;
+    if (auto el = get_element_by_id(id); el) {
+        el->write_html(s);
+    }
+    return s;
+}
+
+size_t RecordingDOM::command_count() const
+{
+    size_t n = 0;
+    for (auto c : op_counts) {
+        n += c;
+    }
+    return n;
+}
+
+// Count the nodes of a subtree excluding its root
+static size_t count_nodes(const DOMNode& n)
+{
+    size_t count = n.children.size();
+    for (auto& ch : n.children) {
+        count += count_nodes(*ch);
+    }
+    return count;
+}
+
+size_t RecordingDOM::node_count() const { return count_nodes(body); }
+
+void RecordingDOM::reset_stats()
+{
+    op_counts.fill(0);
+    flushes = bytes = misses = 0;
+}
+
+void RecordingDOM::apply(const uint8_t* buf, size_t size)
+{
+    flushes++;
+    bytes += size;
+
+    size_t i = 0;
+    auto read_string = [&]() {
+        uint32_t len;
+        if (size - i < sizeof(len)) {
+            throw std::runtime_error("truncated DOM command buffer");
+        }
+        memcpy(&len, buf + i, sizeof(len));
+        i += sizeof(len);
+        if (len & brunhild::string_ref_flag) {
+            const char* p;
+            if (size - i < sizeof(p)) {
+                throw std::runtime_error("truncated DOM command buffer");
+            }
+            memcpy(&p, buf + i, sizeof(p));
+            i += sizeof(p);
+            return std::string_view(p, len & ~brunhild::string_ref_flag);
+        }
+        if (size - i < len) {
+            throw std::runtime_error("truncated DOM command buffer");
+        }
+        std::string_view s(reinterpret_cast<const char*>(buf) + i, len);
+        i += len;
+        return s;
+    };
+
+    DOMNode* el = nullptr;
+    while (i < size) {
+        const auto op = static_cast<Op>(buf[i++]);
+        if (op > Op::move_child_after) {
+            throw std::runtime_error("unknown DOM command");
+        }
+        op_counts[size_t(op)]++;
+
+        std::string_view args[2];
+        for (int j = 0; j < brunhild::operand_count(op); j++) {
+            args[j] = read_string();
+        }
+        if (op == Op::select) {
+            el = get_element_by_id(args[0]);
+        } else if (!el) {
+            misses++;
+        } else {
+            apply(op, el, args);
+        }
+    }
+}
+
+void RecordingDOM::apply(Op op, DOMNode* el, std::string_view args[2])
+{
+    // Insert the first node of an HTML fragment into parent at position i,
+    // like the browser backend does
+    auto insert_html = [this](DOMNode& parent, size_t i, std::string_view s) {
+        auto nodes = parse_html(s);
+        if (nodes.empty()) {
+            misses++;
+        } else {
+            insert(parent, i, std::move(nodes.front()));
+        }
+    };
+
+    // Move the element with the passed ID into parent after sibling or to the
+    // front, if sibling is nullptr
+    auto move = [this](DOMNode& parent, std::string_view id,
+                    const DOMNode* sibling) {
+        if (sibling && sibling->parent != &parent) {
+            misses++;
+            return;
+        }
+        if (sibling && sibling == get_element_by_id(id)) {
+            return; // Already in place
+        }
+        auto n = detach_for_move(id, parent);
+        if (!n) {
+            misses++;
+            return;
+        }
+        insert(parent, sibling ? position(*sibling) + 1 : 0, std::move(n));
+    };
+
+    switch (op) {
+    case Op::select:
+        break;
+    case Op::before:
+    case Op::after:
+        if (!el->parent) {
+            misses++;
+        } else {
+            insert_html(*el->parent, position(*el) + (op == Op::after), args[0]);
+        }
+        break;
+    case Op::remove:
+        if (el->parent) {
+            detach(*el);
+        }
+        break;
+    case Op::set_outer_html:
+        if (!el->parent) {
+            misses++;
+        } else {
+            auto& parent = *el->parent;
+            size_t i = position(*el);
+            detach(*el);
+            for (auto& n : parse_html(args[0])) {
+                insert(parent, i++, std::move(n));
+            }
+        }
+        break;
+    case Op::set_inner_html:
+        set_children(*el, args[0]);
+        break;
+    case Op::append:
+        insert_html(*el, el->children.size(), args[0]);
+        break;
+    case Op::prepend:
+        insert_html(*el, 0, args[0]);
+        break;
+    case Op::move_prepend:
+        move(*el, args[0], nullptr);
+        break;
+    case Op::move_after:
+        if (!el->parent) {
+            misses++;
+        } else {
+            move(*el->parent, args[0], el);
+        }
+        break;
+    case Op::set_attr: {
+        const std::string key(args[0]);
+        if (key == "id") {
+            unindex(*el);
+        }
+        auto it = std::find_if(el->attrs.begin(), el->attrs.end(),
+            [&](auto& a) { return a.first == key; });
+        if (it == el->attrs.end()) {
+            el->attrs.emplace_back(key, std::string(args[1]));
+        } else {
+            it->second = args[1];
+        }
+        if (key == "id") {
+            index(*el);
+        }
+    } break;
+    case Op::remove_attr: {
+        const bool is_id = args[0] == "id";
+        if (is_id) {
+            unindex(*el);
+        }
+        el->attrs.erase(std::remove_if(el->attrs.begin(), el->attrs.end(),
+                            [&](auto& a) { return a.first == args[0]; }),
+            el->attrs.end());
+        if (is_id) {
+            index(*el);
+        }
+    } break;
+    case Op::scroll_into_view:
+        break;
+    case Op::insert_child_after:
+        if (args[0].empty()) {
+            insert_html(*el, 0, args[1]);
+        } else if (auto sib = get_element_by_id(args[0]);
+                   sib && sib->parent == el) {
+            insert_html(*el, position(*sib) + 1, args[1]);
+        } else {
+            misses++;
+        }
+        break;
+    case Op::move_child_after:
+        if (args[0].empty()) {
+            move(*el, args[1], nullptr);
+        } else if (auto sib = get_element_by_id(args[0]); sib) {
+            move(*el, args[1], sib);
+        } else {
+            misses++;
+        }
+        break;
+    }
+}
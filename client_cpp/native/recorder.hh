@@ -0,0 +1,105 @@
+#pragma once
+
+#include "../brunhild/commands.hh"
+#include <array>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Node of the in-memory document
+struct DOMNode {
+    // Lowercase tag name. Empty for text nodes.
+    std::string tag;
+
+    // Contents of text nodes
+    std::string text;
+
+    // Attribute values are stored and serialized as received. Character
+    // references are not decoded.
+    std::vector<std::pair<std::string, std::string>> attrs;
+
+    std::vector<std::unique_ptr<DOMNode>> children;
+    DOMNode* parent = nullptr;
+
+    // Returns the value of an attribute or nullptr, if not set
+    const std::string* attr(std::string_view key) const;
+
+    void write_html(std::string& out) const;
+};
+
+// DOM backend, that applies flushed command buffers to an in-memory document
+// instead of the browser's and records statistics about them. Used for
+// running and benchmarking the client natively.
+class RecordingDOM : public brunhild::DOMSink {
+public:
+    // Number of applied commands by opcode
+    std::array<size_t, size_t(brunhild::Op::move_child_after) + 1> op_counts{};
+
+    // Number of command buffers and their total size in bytes
+    size_t flushes = 0, bytes = 0;
+
+    // Commands, that targeted missing elements or would have thrown in the
+    // browser
+    size_t misses = 0;
+
+    // Create a document with the passed inner HTML of its <body>
+    RecordingDOM(std::string_view body_html = "");
+
+    void apply(const uint8_t* buf, size_t size) override;
+
+    // Returns the element with the passed ID or nullptr
+    DOMNode* get_element_by_id(std::string_view id) const;
+
+    // Serialize the inner or outer HTML of an element. Returns an empty
+    // string, if no such element exists.
+    std::string inner_html(std::string_view id) const;
+    std::string outer_html(std::string_view id) const;
+
+    // Returns the total number of applied commands
+    size_t command_count() const;
+
+    // Returns the number of nodes in the document
+    size_t node_count() const;
+
+    // Reset all recorded statistics
+    void reset_stats();
+
+private:
+    DOMNode body;
+
+    // Elements by ID. Elements with duplicate IDs shadow each other like in
+    // the browser, so only the last indexed is reachable.
+    std::unordered_map<std::string, DOMNode*> ids;
+
+    // Add or remove a subtree's IDs to or from the index
+    void index(DOMNode& n);
+    void unindex(DOMNode& n);
+
+    // Insert a parsed node into parent before position i and index it
+    void insert(DOMNode& parent, size_t i, std::unique_ptr<DOMNode> n);
+
+    // Detach a node from its parent and the index
+    std::unique_ptr<DOMNode> detach(DOMNode& n);
+
+    // Detach the element with the passed ID for moving it. Returns nullptr, if
+    // not found or an ancestor of target.
+    std::unique_ptr<DOMNode> detach_for_move(
+        std::string_view id, const DOMNode& target);
+
+    // Replace the children of an element with parsed HTML
+    void set_children(DOMNode& el, std::string_view html);
+
+    // Apply a single command to el
+    void apply(brunhild::Op op, DOMNode* el, std::string_view args[2]);
+};
+
+// Parse an HTML fragment into a list of nodes. Implements only the subset of
+// HTML brunhild and the client produce: elements, attributes, text, comments
+// and void elements. Unclosed elements are closed at the end of the fragment
+// and stray closing tags are ignored.
+std::vector<std::unique_ptr<DOMNode>> parse_html(std::string_view html);
@@ -0,0 +1,185 @@
+#include "reference_body.hh"
+#include "../src/state.hh"
+#include <functional>
+#include <string>
+
+using brunhild::Node;
+using std::function;
+using std::string;
+using std::string_view;
+
+// Opening tags for text formatting
+static const Node opening_tags[TextState::tag_depth] = {
+    { "del" }, { "b" }, { "i" }, { "span", { { "class", "red" } } },
+    { "span", { { "class", "blue" } } },
+};
+
+// Split string_view into subviews on delimiter D, call on_frag on each
+// fragment and call on_match after each matched delimiter
+template <class D>
+void parse_string(string_view frag, D sep, function<void(string_view)> on_frag,
+    function<void()> on_match = []() {})
+{
+    size_t i;
+    const size_t sep_s = brunhild::string_size(sep);
+    while (1) {
+        i = frag.find(sep);
+        on_frag(frag.substr(0, i));
+        if (i != string::npos) {
+            frag = frag.substr(i + sep_s);
+            on_match();
+        } else {
+            break;
+        }
+    }
+}
+
+Node ReferenceBody::render(PostView& v)
+{
+    Node n("blockquote");
+    if (!v.m->body.size()) {
+        return n;
+    }
+    v.state.reset(&n);
+
+    bool first = true;
+    parse_string(string_view(v.m->body), '\n', [&](string_view line) {
+        render_line(v, line, first);
+        first = false;
+    });
+    return n;
+}
+
+void ReferenceBody::render_line(PostView& v, string_view line, bool first)
+{
+    auto& state = v.state;
+    state.quote = false;
+
+    // Prevent successive empty lines
+    if (!first && state.successive_newlines < 2) {
+        state.append({ "br" });
+    }
+    if (!line.size()) {
+        state.successive_newlines++;
+        return;
+    }
+
+    state.successive_newlines = 0;
+    if (line[0] == '>') {
+        state.quote = true;
+        state.append({ "em" }, true);
+    }
+    auto states = state.as_array();
+    for (int i = 0; i < (int)states.size(); i++) {
+        if (states[i]) {
+            state.append(opening_tags[i], true);
+        }
+    }
+
+    parse_code(v, line);
+
+    // Close any unclosed tags
+    states = state.as_array(); // State might have changed during parsing
+    for (auto s : states) {
+        if (s) {
+            state.ascend();
+        }
+    }
+    if (state.quote) {
+        state.ascend();
+    }
+}
+
+// Splits on code tags like parse_string() does, but stops at a language hint
+// after a code tag, that starts the line
+void ReferenceBody::parse_code(PostView& v, string_view line)
+{
+    auto& state = v.state;
+    string_view frag = line;
+    while (1) {
+        const size_t i = frag.find("``");
+        auto f = frag.substr(0, i);
+        if (state.code) {
+            // Strip quotes
+            while (f.size() && f[0] == '>') {
+                f = f.substr(1);
+            }
+            v.highlight_syntax(f);
+        } else {
+            parse_spoilers(v, f);
+        }
+        if (i == string::npos) {
+            return;
+        }
+
+        const bool starts_line = frag.data() + i == line.data();
+        frag = frag.substr(i + 2);
+        state.code = !state.code;
+        if (state.code) {
+            state.code_lang = CodeLang::any;
+            if (starts_line) {
+                if (auto lang = parse_code_lang(frag)) {
+                    state.code_lang = *lang;
+                    return;
+                }
+            }
+        }
+    }
+}
+
+void ReferenceBody::parse_spoilers(PostView& v, string_view frag)
+{
+    parse_string(frag, "**", [&](string_view frag) { parse_bolds(v, frag); },
+        [&]() {
+            v.wrap_tags(0);
+            v.state.spoiler = !v.state.spoiler;
+        });
+}
+
+void ReferenceBody::parse_bolds(PostView& v, string_view frag)
+{
+    parse_string(frag, "@@", [&](string_view frag) { parse_italics(v, frag); },
+        [&]() {
+            v.wrap_tags(1);
+            v.state.bold = !v.state.bold;
+        });
+}
+
+void ReferenceBody::parse_italics(PostView& v, string_view frag)
+{
+    parse_string(frag, "~~", [&](string_view frag) { parse_reds(v, frag); },
+        [&]() {
+            v.wrap_tags(2);
+            v.state.italic = !v.state.italic;
+        });
+}
+
+void ReferenceBody::parse_reds(PostView& v, string_view frag)
+{
+    if (board_config.rb_text) {
+        parse_string(frag, "^r",
+            [&](string_view frag) { parse_blues(v, frag); },
+            [&]() {
+                v.wrap_tags(3);
+                v.state.red = !v.state.red;
+            });
+    } else {
+        parse_string(
+            frag, "^r", [&](string_view frag) { parse_blues(v, frag); });
+    }
+}
+
+void ReferenceBody::parse_blues(PostView& v, string_view frag)
+{
+    auto on_frag = [&](string_view frag) {
+        v.m->editing ? v.parse_temp_links(frag) : v.parse_fragment(frag);
+    };
+    if (board_config.rb_text) {
+        parse_string(frag, "^b", on_frag, [&]() {
+            v.wrap_tags(4);
+            v.state.blue = !v.state.blue;
+        });
+    } else {
+        parse_string(frag, "^b", on_frag);
+    }
+}
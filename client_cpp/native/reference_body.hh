@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../src/posts/view.hh"
+
+// Renders post bodies with the nested parse_string() chain, that the single
+// pass parser in src/posts/body.cc replaced. Kept as the reference fuzz_body
+// compares the parser against.
+class ReferenceBody {
+public:
+    // Render the body of a post, that has already been rendered by v
+    static brunhild::Node render(PostView& v);
+
+    // Render the body of a post, that has already been rendered by v, with
+    // PostView's own parser
+    static brunhild::Node render_current(PostView& v)
+    {
+        return v.render_body();
+    }
+
+private:
+    static void render_line(PostView& v, std::string_view line, bool first);
+    static void parse_code(PostView& v, std::string_view line);
+    static void parse_spoilers(PostView& v, std::string_view frag);
+    static void parse_bolds(PostView& v, std::string_view frag);
+    static void parse_italics(PostView& v, std::string_view frag);
+    static void parse_reds(PostView& v, std::string_view frag);
+    static void parse_blues(PostView& v, std::string_view frag);
+};
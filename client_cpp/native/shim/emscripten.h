@@ -0,0 +1,38 @@
+#pragma once
+
+// Minimal stand-in for the Emscripten runtime API, so the client compiles as a
+// native binary. Inline JavaScript is discarded and returns 0.
+
+#include <chrono>
+#include <stdint.h>
+
+// Result of discarded inline JavaScript. Opaque to the optimizer, so code
+// handling results does not get folded into warnings about constant nulls.
+inline intptr_t em_asm_result()
+{
+    static volatile intptr_t zero = 0;
+    return zero;
+}
+
+#define EM_ASM(...) ((void)0)
+#define EM_ASM_INT(...) em_asm_result()
+#define EM_ASM_DOUBLE(...) double(em_asm_result())
+#define EMSCRIPTEN_KEEPALIVE
+
+typedef void (*em_callback_func)(void);
+typedef void (*em_arg_callback_func)(void*);
+
+// The native build has no browser event loop. Drivers call
+// brunhild::flush() themselves.
+inline void emscripten_set_main_loop(em_callback_func, int, int) {}
+inline void emscripten_cancel_main_loop() {}
+inline void emscripten_async_call(em_arg_callback_func, void*, int) {}
+
+// Milliseconds since an arbitrary point in time
+inline double emscripten_get_now()
+{
+    using namespace std::chrono;
+    return duration<double, std::milli>(
+        steady_clock::now().time_since_epoch())
+        .count();
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "../emscripten.h"
+#include "val.h"
+
+// Bindings are only needed to call into the module from JavaScript, so the
+// native build compiles and discards them
+#define EMSCRIPTEN_BINDINGS(name) [[maybe_unused]] static void em_bind_##name()
+
+namespace emscripten {
+template <class F> void function(const char*, F) {}
+template <class T> void register_vector(const char*) {}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+namespace emscripten {
+
+// Handle to a JavaScript value. There are no JavaScript values in the native
+// build, so every lookup yields an undefined value and every conversion a
+// default constructed one.
+class val {
+public:
+    val() = default;
+
+    template <class T> explicit val(T&&) {}
+
+    static val global(const char* = nullptr) { return val(); }
+    static val object() { return val(); }
+    static val array() { return val(); }
+    static val null() { return val(); }
+    static val undefined() { return val(); }
+
+    template <class T> val operator[](const T&) const { return val(); }
+
+    template <class R = val, class... A> R call(const char*, A&&...) const
+    {
+        return R();
+    }
+
+    template <class T> T as() const { return T(); }
+
+    template <class... A> val operator()(A&&...) const { return val(); }
+
+    template <class K, class V> void set(const K&, const V&) {}
+
+    bool isNull() const { return false; }
+    bool isUndefined() const { return true; }
+};
+
+template <class T> std::vector<T> vecFromJSArray(const val&) { return {}; }
+}
@@ -0,0 +1,751 @@
+// Tests running the module in a worker against running it on the main thread.
+// Loads brunhild/dom.js into a main thread context and, connected to it, a
+// worker context, with an in-memory document and message passing with
+// structured cloning. Applies the command stream dumped by dump_commands both
+// directly and posted from the worker and compares the resulting documents
+// with each other and with RecordingDOM's. Also checks event dispatch and
+// main thread state access through the worker.
+//
+// Usage: node worker_test.js commands.bin
+
+'use strict';
+
+const fs = require('fs');
+const path = require('path');
+const vm = require('vm');
+
+const domJS = fs.readFileSync(path.join(__dirname, '../brunhild/dom.js'),
+    'utf8');
+
+function fail(msg)
+{
+    console.error('worker_test: ' + msg);
+    process.exit(1);
+}
+
+function assertEqual(got, expected, what)
+{
+    const a = JSON.stringify(got);
+    const b = JSON.stringify(expected);
+    if (a !== b) {
+        fail(what + ' differs:\n  got:      ' + a + '\n  expected: ' + b);
+    }
+}
+
+// Elements without content or closing tag
+const voidTags = new Set([ 'area', 'base', 'br', 'col', 'embed', 'hr', 'img',
+    'input', 'link', 'meta', 'source', 'track', 'wbr' ]);
+
+function isSpace(ch)
+{
+    return ch === ' ' || ch === '\t' || ch === '\n' || ch === '\v'
+        || ch === '\f' || ch === '\r';
+}
+
+function isNameChar(ch)
+{
+    return !isSpace(ch) && ch !== '>' && ch !== '/' && ch !== '='
+        && ch !== '"' && ch !== '\'';
+}
+
+function asciiLower(s)
+{
+    return s.replace(/[A-Z]/g, (c) => c.toLowerCase());
+}
+
+// Node of the in-memory document. Parses and serializes HTML exactly like
+// RecordingDOM, so documents can be compared with its output.
+class DOMNode {
+    constructor(doc, tag, text)
+    {
+        this.ownerDocument = doc;
+        this.tag = tag; // Empty for text nodes
+        this.text = text || '';
+        this.attrs = [];
+        this.childNodes = [];
+        this.parentNode = null;
+    }
+
+    get tagName() { return this.tag ? this.tag.toUpperCase() : undefined; }
+    get id() { return this.getAttribute('id') || ''; }
+
+    get parentElement() { return this.parentNode; }
+
+    get children() { return this.childNodes.filter((n) => n.tag); }
+
+    get firstChild() { return this.childNodes[0] || null; }
+
+    get nextSibling()
+    {
+        if (!this.parentNode) {
+            return null;
+        }
+        const ch = this.parentNode.childNodes;
+        return ch[ch.indexOf(this) + 1] || null;
+    }
+
+    get textContent()
+    {
+        return this.tag ? this.childNodes.map((n) => n.textContent).join('')
+                        : this.text;
+    }
+
+    get value()
+    {
+        return this.tag === 'input' ? this.getAttribute('value') || ''
+                                    : undefined;
+    }
+
+    get checked() { return this.getAttribute('checked') !== null; }
+
+    get href()
+    {
+        const h = this.getAttribute('href');
+        if (this.tag !== 'a' || h === null) {
+            return undefined;
+        }
+        return new URL(h, this.ownerDocument.location.href).href;
+    }
+
+    getAttribute(key)
+    {
+        const a = this.attrs.find((a) => a[0] === key);
+        return a ? a[1] : null;
+    }
+
+    setAttribute(key, val)
+    {
+        const a = this.attrs.find((a) => a[0] === key);
+        if (a) {
+            a[1] = String(val);
+        } else {
+            this.attrs.push([ key, String(val) ]);
+        }
+    }
+
+    removeAttribute(key)
+    {
+        this.attrs = this.attrs.filter((a) => a[0] !== key);
+    }
+
+    set innerHTML(html)
+    {
+        for (const n of this.childNodes) {
+            n.parentNode = null;
+        }
+        this.childNodes = [];
+        for (const n of parseHTML(this.ownerDocument, html)) {
+            this.insertBefore(n, null);
+        }
+    }
+
+    get innerHTML()
+    {
+        return this.childNodes.map((n) => n.html()).join('');
+    }
+
+    set outerHTML(html)
+    {
+        const parent = this.parentNode;
+        const next = this.nextSibling;
+        parent.removeChild(this);
+        for (const n of parseHTML(this.ownerDocument, html)) {
+            parent.insertBefore(n, next);
+        }
+    }
+
+    insertBefore(n, ref)
+    {
+        for (let p = this; p; p = p.parentNode) {
+            if (p === n) {
+                throw new Error('HierarchyRequestError');
+            }
+        }
+        if (n.parentNode) {
+            n.parentNode.removeChild(n);
+        }
+        const i = ref ? this.childNodes.indexOf(ref) : this.childNodes.length;
+        if (i < 0) {
+            throw new Error('NotFoundError');
+        }
+        this.childNodes.splice(i, 0, n);
+        n.parentNode = this;
+        return n;
+    }
+
+    appendChild(n) { return this.insertBefore(n, null); }
+
+    removeChild(n)
+    {
+        const i = this.childNodes.indexOf(n);
+        if (i < 0) {
+            throw new Error('NotFoundError');
+        }
+        this.childNodes.splice(i, 1);
+        n.parentNode = null;
+        return n;
+    }
+
+    scrollIntoView() { this.ownerDocument.scrolledTo = this.id; }
+
+    getBoundingClientRect()
+    {
+        return { top : 0, bottom : 0, left : 0, right : 0 };
+    }
+
+    // Supports comma-separated compound selectors of tag names, IDs, classes
+    // and attribute presence or equality
+    matches(sel)
+    {
+        return sel.split(',').some((s) => {
+            s = s.trim();
+            const re = /([#.]?)([\w-]+)|\[([\w-]+)(?:="?([^"\]]*)"?)?\]/gy;
+            let m;
+            while (re.lastIndex < s.length) {
+                if (!(m = re.exec(s))) {
+                    throw new Error('unsupported selector: ' + sel);
+                }
+                if (m[3]) {
+                    const v = this.getAttribute(m[3]);
+                    if (v === null || (m[4] !== undefined && v !== m[4])) {
+                        return false;
+                    }
+                } else if (m[1] === '#') {
+                    if (this.id !== m[2]) {
+                        return false;
+                    }
+                } else if (m[1] === '.') {
+                    const cls = (this.getAttribute('class') || '').split(' ');
+                    if (!cls.includes(m[2])) {
+                        return false;
+                    }
+                } else if (this.tag !== m[2]) {
+                    return false;
+                }
+            }
+            return true;
+        });
+    }
+
+    querySelectorAll(sel)
+    {
+        const out = [];
+        (function walk(n) {
+            for (const ch of n.children) {
+                if (ch.matches(sel)) {
+                    out.push(ch);
+                }
+                walk(ch);
+            }
+        })(this);
+        return out;
+    }
+
+    querySelector(sel) { return this.querySelectorAll(sel)[0] || null; }
+
+    html()
+    {
+        if (!this.tag) {
+            return this.text;
+        }
+        let s = '<' + this.tag;
+        for (const [ key, val ] of this.attrs) {
+            s += ' ' + key + (val ? '="' + val + '"' : '');
+        }
+        s += '>';
+        if (voidTags.has(this.tag)) {
+            return s;
+        }
+        return s + this.innerHTML + '</' + this.tag + '>';
+    }
+}
+
+// Parse an HTML fragment into a list of nodes like RecordingDOM
+function parseHTML(doc, html)
+{
+    const root = new DOMNode(doc, 'root');
+    const open = [ root ];
+    let i = 0;
+
+    function readName()
+    {
+        const start = i;
+        while (i < html.length && isNameChar(html[i])) {
+            i++;
+        }
+        return asciiLower(html.slice(start, i));
+    }
+
+    function skipSpace()
+    {
+        while (i < html.length && isSpace(html[i])) {
+            i++;
+        }
+    }
+
+    function pushText(s)
+    {
+        const parent = open[open.length - 1];
+        const last = parent.childNodes[parent.childNodes.length - 1];
+        if (last && !last.tag) {
+            last.text += s;
+        } else {
+            parent.appendChild(new DOMNode(doc, '', s));
+        }
+    }
+
+    // Parse attributes up to and including the closing '>'. Returns, if the
+    // tag was self-closing.
+    function parseAttrs(el)
+    {
+        while (true) {
+            skipSpace();
+            if (i === html.length) {
+                return false;
+            }
+            if (html[i] === '>') {
+                i++;
+                return false;
+            }
+            if (html[i] === '/') {
+                if (html[i + 1] === '>') {
+                    i += 2;
+                    return true;
+                }
+                i++;
+                continue;
+            }
+
+            const key = readName();
+            if (!key) {
+                i++;
+                continue;
+            }
+            let val = '';
+            skipSpace();
+            if (html[i] === '=') {
+                i++;
+                skipSpace();
+                if (html[i] === '"' || html[i] === '\'') {
+                    const end = html.indexOf(html[i++], i);
+                    const stop = end < 0 ? html.length : end;
+                    val = html.slice(i, stop);
+                    i = end < 0 ? stop : stop + 1;
+                } else {
+                    const start = i;
+                    while (i < html.length && !isSpace(html[i])
+                        && html[i] !== '>') {
+                        i++;
+                    }
+                    val = html.slice(start, i);
+                }
+            }
+            if (el.getAttribute(key) === null) {
+                el.attrs.push([ key, val ]);
+            }
+        }
+    }
+
+    while (i < html.length) {
+        if (html[i] !== '<') {
+            let end = html.indexOf('<', i);
+            if (end < 0) {
+                end = html.length;
+            }
+            pushText(html.slice(i, end));
+            i = end;
+            continue;
+        }
+
+        if (html.startsWith('<!--', i)) {
+            const end = html.indexOf('-->', i + 4);
+            i = end < 0 ? html.length : end + 3;
+            continue;
+        }
+
+        if (html[i + 1] === '/') {
+            i += 2;
+            const name = readName();
+            const end = html.indexOf('>', i);
+            i = end < 0 ? html.length : end + 1;
+            for (let j = open.length - 1; j > 0; j--) {
+                if (open[j].tag === name) {
+                    open.length = j;
+                    break;
+                }
+            }
+            continue;
+        }
+
+        if (i + 1 === html.length || !/[A-Za-z]/.test(html[i + 1])) {
+            pushText('<');
+            i++;
+            continue;
+        }
+
+        i++;
+        const el = new DOMNode(doc, readName());
+        const selfClosing = parseAttrs(el);
+        open[open.length - 1].appendChild(el);
+        if (!selfClosing && !voidTags.has(el.tag)) {
+            open.push(el);
+        }
+    }
+
+    for (const n of root.childNodes) {
+        n.parentNode = null;
+    }
+    return root.childNodes;
+}
+
+// Event target with listeners of an in-memory document
+// Listeners are registered with an own method, so a context's global scope can
+// be a Target.
+class Target {
+    constructor()
+    {
+        const listeners = this.listeners = {};
+        this.addEventListener = (type, fn) => {
+            (listeners[type] = listeners[type] || []).push(fn);
+        };
+    }
+
+    fire(type, e)
+    {
+        for (const fn of this.listeners[type] || []) {
+            fn(e);
+        }
+    }
+}
+
+// Create the global scope of a main thread with a document, whose body has
+// the passed inner HTML
+function mainThread(bodyHTML)
+{
+    const doc = new Target();
+    const g = new Target();
+    Object.assign(doc, {
+        hidden : false,
+        location : null,
+        body : null,
+        createElement : (tag) => new DOMNode(doc, tag),
+        getElementById(id)
+        {
+            return (function find(n) {
+                for (const ch of n.children) {
+                    const el = ch.id === id ? ch : find(ch);
+                    if (el) {
+                        return el;
+                    }
+                }
+                return null;
+            })(this.body);
+        },
+        querySelectorAll(sel) { return this.body.querySelectorAll(sel); },
+    });
+    doc.body = new DOMNode(doc, 'body');
+    doc.body.innerHTML = bodyHTML;
+
+    const storage = new Map();
+    const location = {
+        href : 'https://example.com/a/1',
+        set hash(h)
+        {
+            const u = new URL(this.href);
+            u.hash = h;
+            this.href = u.href;
+        },
+        reload() { g.reloaded = true; },
+    };
+    doc.location = location;
+
+    Object.assign(g, {
+        document : doc,
+        location : location,
+        history : {
+            scrollRestoration : 'auto',
+            pushState(state, title, url)
+            {
+                location.href = new URL(url, location.href).href;
+            },
+        },
+        localStorage : {
+            get length() { return storage.size; },
+            key : (i) => Array.from(storage.keys())[i],
+            getItem : (k) => storage.has(k) ? storage.get(k) : null,
+            setItem : (k, v) => storage.set(k, String(v)),
+        },
+        innerHeight : 720,
+        innerWidth : 1280,
+        requestAnimationFrame : (fn) => fn(),
+        alert : (msg) => { g.alerted = msg; },
+        TextDecoder : TextDecoder,
+        URL : URL,
+        console : console,
+    });
+    g.window = g;
+    vm.createContext(g);
+    vm.runInContext(domJS, g, { filename : 'dom.js' });
+    return g;
+}
+
+// Messages in flight between the main thread and the worker
+const queue = [];
+
+// Deliver all queued messages, including ones posted while delivering
+function pump()
+{
+    while (queue.length) {
+        const [ target, data, transfer ] = queue.shift();
+        target.fire('message',
+            { data : structuredClone(data, { transfer : transfer || [] }) });
+    }
+}
+
+// Handle the main thread passes to brunhild.connect() and the global scope of
+// the worker it runs
+function spawnWorker()
+{
+    const handle = new Target();
+    const g = new Target();
+    handle.postMessage = (data, transfer) => queue.push([ g, data, transfer ]);
+    const dependencies = new Set();
+    Object.assign(g, {
+        Module : { dispatched : [] },
+        postMessage : (data, transfer) => queue.push([ handle, data, transfer ]),
+        addRunDependency : (dep) => dependencies.add(dep),
+        removeRunDependency : (dep) => dependencies.delete(dep),
+        dependencies : dependencies,
+        TextDecoder : TextDecoder,
+        URL : URL,
+        console : console,
+    });
+    vm.createContext(g);
+    vm.runInContext(domJS, g, { filename : 'dom.js' });
+    return { handle, g };
+}
+
+// Give a global scope the exports of the module dom.js calls into. Dispatched
+// events are recorded.
+function stubModule(g)
+{
+    const M = g.Module = g.Module || {};
+    M.dispatched = [];
+    g.HEAP32 = new Int32Array(64);
+    M._dispatch_event = function(e, type, targetId, dataId, modifiers, button,
+        x, y, value, name, checked, href, path, n) {
+        M.dispatched.push({
+            args : [ type, targetId, dataId, modifiers, button, x, y, value,
+                name, checked, href, path ],
+            ids : Array.from(g.HEAP32.subarray(4, 4 + n)),
+        });
+    };
+    M.calls = [];
+    M.on_test = function() { M.calls.push(Array.from(arguments)); };
+}
+
+// Read the flushes dumped by dump_commands
+function readDump(file)
+{
+    const buf = fs.readFileSync(file);
+    let i = 0;
+    function uint32()
+    {
+        const n = buf.readUInt32LE(i);
+        i += 4;
+        return n;
+    }
+    function bytes(n)
+    {
+        const b = new Uint8Array(buf.subarray(i, i + n));
+        i += n;
+        return b;
+    }
+
+    const flushes = [];
+    for (let n = uint32(); n; n--) {
+        const size = uint32();
+        const start = uint32();
+        const end = uint32();
+        const blob = bytes(size);
+        flushes.push({ blob, start, end, detached : bytes(uint32()) });
+    }
+    const expected = Buffer.from(bytes(uint32())).toString('utf8');
+    if (i !== buf.length) {
+        fail('trailing bytes in ' + file);
+    }
+    return { flushes, expected };
+}
+
+const bodyHTML = '<div id="root"></div><div id="ops"></div>'
+    + '<script type="application/json" id="conf">{"a":1}</script>';
+
+function serialize(g)
+{
+    const doc = g.document;
+    return doc.getElementById('root').innerHTML
+        + doc.getElementById('ops').innerHTML;
+}
+
+// Returns the first position, at which two strings differ, and some context
+function firstDifference(a, b)
+{
+    let i = 0;
+    while (i < a.length && a[i] === b[i]) {
+        i++;
+    }
+    const from = Math.max(0, i - 40);
+    return 'at ' + i + ':\n  ' + a.slice(from, i + 40) + '\n  '
+        + b.slice(from, i + 40);
+}
+
+// Apply the dumped command stream directly and through a worker
+function testCommands(file, single, main, worker)
+{
+    const { flushes, expected } = readDump(file);
+    if (!flushes.length) {
+        fail('no flushes dumped');
+    }
+    flushes.forEach((f, n) => {
+        single.brunhild.apply(f.blob, f.start, f.end);
+        worker.g.brunhild.post(f.detached, 0, f.detached.length);
+        pump();
+        const a = serialize(single);
+        const b = serialize(main);
+        if (a !== b) {
+            fail('documents of the main thread and worker differ after flush '
+                + n + ' ' + firstDifference(a, b));
+        }
+    });
+    const got = serialize(single);
+    if (got !== expected) {
+        fail('documents of dom.js and RecordingDOM differ '
+            + firstDifference(got, expected));
+    }
+    if (main.document.scrolledTo !== 'b') {
+        fail('scroll_into_view not applied');
+    }
+    return flushes.length;
+}
+
+// Register the same handlers on both sides and compare dispatched events
+function testEvents(single, main, worker)
+{
+    const sides = [ [ single, single ], [ worker.g, main ] ];
+    for (const [ g ] of sides) {
+        stubModule(g);
+        const b = g.brunhild;
+
+        // The buffer fits 4 IDs, so matches are dispatched in batches
+        b.listen('click', 1, '', '', 16, 4);
+        for (let id = 2; id <= 9; id++) {
+            b.listen('click', id, 'p', '', 0, 0);
+        }
+        b.listen('click', 10, 'div', '', 0, 0);
+        b.listen('click', 11, '', 'ops', 0, 0);
+        b.listen('click', 12, '#a', 'ops', 0, 0);
+        b.listen('click', 13, '', 'root', 0, 0);
+        b.unlisten('click', 3, '');
+        b.unlisten('click', 12, 'ops');
+
+        // Unknown types and scopes are ignored
+        b.unlisten('nonexistent', 1, '');
+        b.unlisten('click', 1, 'nonexistent');
+    }
+    pump();
+
+    for (const [ , m ] of sides) {
+        const el = m.document.getElementById('a');
+        if (!el) {
+            fail('#a missing');
+        }
+        m.document.fire('click', {
+            target : el,
+            button : 0,
+            shiftKey : true,
+            clientX : 5,
+            clientY : 7,
+        });
+    }
+    pump();
+
+    const a = single.Module.dispatched;
+    const b = worker.g.Module.dispatched;
+    assertEqual(b, a, 'events dispatched from the worker');
+    assertEqual(a.map((d) => d.ids), [ [ 11, 1, 2, 4 ], [ 5, 6, 7, 8 ], [ 9 ] ],
+        'matched handler batches');
+    assertEqual(a[0].args,
+        [ 'click', 'a', '', 1, 0, 5, 7, '', '', false, '', 'a ops' ],
+        'event properties');
+}
+
+// Check main thread state is readable and writable from the worker
+function testEnv(main, worker)
+{
+    const b = worker.g.brunhild;
+    assertEqual(b.location().href, main.location.href, 'location');
+    assertEqual(b.pageData('conf'), '{"a":1}', 'page data');
+    assertEqual(b.pageData('missing'), null, 'missing page data');
+    assertEqual(b.innerHeight(), 720, 'innerHeight');
+
+    main.localStorage.setItem('k', 'v');
+    main.fire('storage', { key : 'k', newValue : 'v' });
+    pump();
+    assertEqual(b.getStorage('k'), 'v', 'storage set on the main thread');
+
+    // Own changes are visible before reaching the main thread
+    b.call('setStorage', [ 'x', '1' ]);
+    b.call('pushState', [ '/a/2' ]);
+    assertEqual(b.getStorage('x'), '1', 'storage set by the worker');
+    assertEqual(b.location().href, 'https://example.com/a/2', 'pushed state');
+    b.call('setHash', [ '#p3' ]);
+    assertEqual(b.location().hash, '#p3', 'hash');
+    pump();
+    assertEqual(main.localStorage.getItem('x'), '1', 'main thread storage');
+    assertEqual(main.location.href, 'https://example.com/a/2#p3',
+        'main thread location');
+
+    main.innerHeight = 500;
+    main.fire('resize', {});
+    main.location.href = 'https://example.com/a/1';
+    main.fire('popstate', {});
+    pump();
+    assertEqual(b.innerHeight(), 500, 'resized innerHeight');
+    assertEqual(b.location().href, 'https://example.com/a/1', 'popped state');
+
+    // Global listeners call exported module functions in the worker
+    b.call('listenGlobal', [ 'window', 'online', 'on_test' ]);
+    pump();
+    main.fire('online', {});
+    pump();
+    assertEqual(worker.g.Module.calls, [ [] ], 'global listener calls');
+}
+
+function main()
+{
+    if (process.argv.length < 3) {
+        fail('usage: node worker_test.js commands.bin');
+    }
+
+    const single = mainThread(bodyHTML);
+    const main = mainThread(bodyHTML);
+    const worker = spawnWorker();
+
+    // The module must wait for the main thread's state
+    for (const fn of worker.g.Module.preRun) {
+        fn();
+    }
+    assertEqual(Array.from(worker.g.dependencies), [ 'brunhild' ],
+        'run dependencies before connecting');
+    main.brunhild.connect(worker.handle);
+    pump();
+    assertEqual(Array.from(worker.g.dependencies), [],
+        'run dependencies after connecting');
+
+    const n = testCommands(process.argv[2], single, main, worker);
+    testEvents(single, main, worker);
+    testEnv(main, worker);
+    console.log('worker_test: ' + n + ' flushes applied identically');
+}
+
+main();
@@ -1,6 +1,7 @@
 #include "connection.hh"
 #include "../../brunhild/mutations.hh"
 #include "../../utf8/utf8.h"
+#include "../json_reader.hh"
 #include "../lang.hh"
 #include "../page/thread.hh"
 #include "../posts/commands.hh"
@@ -40,24 +41,81 @@ static string encode_message(Message type, const string& msg)
 static void if_post_exists(
     const unsigned long id, std::function<void(Post&)> fn)
 {
-    if (posts.count(id)) {
-        auto& p = posts.at(id);
-        fn(p);
+    if (auto p = posts.find(id); p) {
+        fn(*p);
     }
 }
 
-// Same for posts with JSON object messages and an "id" attribute, that defines
-// the post ID
-static void if_post_exists(
-    std::string_view data, std::function<void(json&, Post&)> fn)
-{
-    auto j = json::parse(data);
-    if_post_exists(j["id"].get<unsigned long>(), [&](auto& p) { fn(j, p); });
-}
+// Decoded splice message
+struct SpliceMessage {
+    unsigned long id = 0;
+    int start = 0, len = 0;
+    std::string_view text; // Points into the message buffer
+
+    SpliceMessage(JSONReader& r)
+    {
+        r.read_object([&](std::string_view key) {
+            if (key == "id") {
+                id = r.read_uint();
+            } else if (key == "start") {
+                start = r.read_int();
+            } else if (key == "len") {
+                len = r.read_int();
+            } else if (key == "text") {
+                text = r.read_string();
+            } else {
+                r.skip();
+            }
+        });
+    }
+};
+
+// Decoded close_post message
+struct ClosePostMessage {
+    unsigned long id = 0;
+    bool has_links = false, has_commands = false;
+
+    // Parsed links and commands
+    Post parsed;
+
+    ClosePostMessage(JSONReader& r)
+    {
+        r.read_object([&](std::string_view key) {
+            if (key == "id") {
+                id = r.read_uint();
+            } else if (key == "links") {
+                has_links = true;
+                parsed.parse_links(r);
+            } else if (key == "commands") {
+                has_commands = true;
+                parsed.parse_commands(r);
+            } else {
+                r.skip();
+            }
+        });
+    }
+};
+
+// Decoded insert_image message
+struct InsertImageMessage {
+    unsigned long id = 0;
+    Image image;
+
+    InsertImageMessage(JSONReader& r)
+    {
+        r.read_object([&](std::string_view key) {
+            if (key == "id") {
+                id = r.read_uint();
+            } else if (!image.decode_field(key, r)) {
+                r.skip();
+            }
+        });
+    }
+};
 
 // Mimics JS Array.splice() method for inserting and removing text from UTF-8
 // strings at a certain position, but in place
-static void splice(string& s, int start, int len, string text)
+static void splice(string& s, int start, int len, std::string_view text)
 {
     auto start_pos = s.begin();
     utf8::advance(start_pos, start, s.end());
@@ -80,11 +138,10 @@ static void render_sync_count(unsigned n)
     brunhild::set_inner_html("sync-counter", s);
 }
 
-// Handler for messages received from the server.
-// extracted specifies, the mesage was extracted from a larger concatenated
-// message.
-static void on_message(std::string_view msg, bool extracted)
+void on_message(char* buf, size_t size, bool extracted)
 {
+    const std::string_view msg(buf, size);
+
     if (debug) {
         string s;
         s.reserve(msg.size() + 3);
@@ -111,18 +168,35 @@ static void on_message(std::string_view msg, bool extracted)
     }
 
     auto data = msg.substr(2);
+    JSONReader r(buf + 2, size - 2);
     switch (type) {
     case Message::invalid:
         alert(string(data));
         conn_SM.feed(ConnEvent::error);
         break;
     case Message::insert_post:
-        insert_post(data);
+        insert_post(r);
         break;
     case Message::append: {
-        auto j = json::parse(data);
-        if_post_exists(j[0].get<unsigned long>(), [&](auto& p) {
-            utf8::unchecked::append(j[1], std::back_inserter(p.body));
+        // [post_id, code_point]
+        unsigned long id = 0;
+        uint32_t ch = 0;
+        int i = 0;
+        r.read_array([&]() {
+            switch (i++) {
+            case 0:
+                id = r.read_uint();
+                break;
+            case 1:
+                ch = r.read_uint();
+                break;
+            default:
+                r.skip();
+            }
+        });
+        if_post_exists(id, [&](auto& p) {
+            utf8::unchecked::append(ch, std::back_inserter(p.body));
+            p.touch();
             p.patch();
         });
     } break;
@@ -132,28 +206,38 @@ static void on_message(std::string_view msg, bool extracted)
             auto it = p.body.end();
             utf8::unchecked::prior(it);
             p.body = p.body.substr(0, it - p.body.begin());
+            p.touch();
             p.patch();
         });
         break;
-    case Message::splice:
-        if_post_exists(data, [](auto& j, auto& p) {
-            splice(p.body, j["start"], j["len"], j["text"]);
+    case Message::splice: {
+        const SpliceMessage m(r);
+        if_post_exists(m.id, [&](auto& p) {
+            splice(p.body, m.start, m.len, m.text);
+            p.touch();
             p.patch();
         });
-        break;
-    case Message::close_post:
-        if_post_exists(data, [](auto& j, auto& p) {
-            if (j.count("links")) {
-                p.parse_links(j);
+    } break;
+    case Message::close_post: {
+        ClosePostMessage m(r);
+        if_post_exists(m.id, [&](auto& p) {
+            if (m.has_links) {
+                for (auto & [ id, data ] : m.parsed.links) {
+                    p.links[id] = std::move(data);
+                }
                 p.propagate_links();
             }
-            p.parse_commands(j);
+            if (m.has_commands) {
+                p.commands = std::move(m.parsed.commands);
+            }
             p.close();
         });
-        break;
-    case Message::insert_image:
-        if_post_exists(data, [](auto& j, auto& p) {
-            p.image = Image(j);
+    } break;
+    case Message::insert_image: {
+        InsertImageMessage m(r);
+        if_post_exists(m.id, [&](auto& p) {
+            set_post_image(p, std::move(m.image));
+            p.touch();
             p.patch();
             threads.at(page.thread).image_ctr++;
             render_post_counter();
@@ -161,33 +245,37 @@ static void on_message(std::string_view msg, bool extracted)
             // TODO: Image auto expansion
 
         });
-        break;
+    } break;
     case Message::spoiler:
         if_post_exists(std::stoul(string(data)), [](auto& p) {
             p.image->spoiler = true;
+            p.touch();
             p.patch();
         });
         break;
     case Message::delete_post:
         if_post_exists(std::stoul(string(data)), [](auto& p) {
             p.deleted = true;
+            p.touch();
             p.patch();
         });
         break;
     case Message::banned:
         if_post_exists(std::stoul(string(data)), [](auto& p) {
             p.banned = true;
+            p.touch();
             p.patch();
         });
         break;
     case Message::delete_image:
         if_post_exists(std::stoul(string(data)), [](auto& p) {
-            p.image = std::nullopt;
+            set_post_image(p, std::nullopt);
+            p.touch();
             p.patch();
         });
         break;
     case Message::synchronise:
-        load_posts(data);
+        load_posts(buf + 2, size - 2);
         conn_SM.feed(ConnEvent::sync);
         break;
     case Message::configs:
@@ -195,20 +283,19 @@ static void on_message(std::string_view msg, bool extracted)
         break;
     // TODO: reclaim
     // TODO: post_id
-    case Message::concat: {
-        // Split several concatenated messages
-        string s;
-        for (auto& msg : json::parse(data)) {
-            s = msg;
-            on_message(std::string_view(s), true);
-        }
+    case Message::concat:
+        // Split several concatenated messages. Each message is a JSON string,
+        // that is unescaped in place and handled directly from the buffer.
+        r.read_array([&]() {
+            const auto s = r.read_string();
+            on_message(buf + (s.data() - buf), s.size(), true);
+        });
         return;
-    }
     case Message::sync_count:
         render_sync_count(std::stoul(string(data)));
         break;
     case Message::server_time:
-        server_time_offset = json::parse(data);
+        server_time_offset = r.read_int();
         break;
     // TODO: redirect
     // TODO: notification
@@ -228,7 +315,7 @@ static void on_message_raw(int msg_ptr)
     // Binding to a variable keeps the underlying char* from dealocating till
     // scope exit
     auto v = c_string_view((char*)(msg_ptr));
-    on_message(v.substr(), false);
+    on_message((char*)(msg_ptr), v.size(), false);
 }
 
 static void retry_to_connect() { conn_SM.feed(ConnEvent::retry); }
@@ -250,6 +337,25 @@ static void resync_conn_SM()
     }
 }
 
+// Resynchronise, when the page becomes visible again
+static void on_visibility_change()
+{
+    if (EM_ASM_INT({ return !brunhild.isHidden() && navigator.onLine; })) {
+        resync_conn_SM();
+    }
+}
+
+// Close the socket, when the browser goes offline
+static void close_socket()
+{
+    EM_ASM({
+        if (self.__socket) {
+            self.__socket.close();
+            self.__socket = null;
+        }
+    });
+}
+
 EMSCRIPTEN_BINDINGS(module_conn)
 {
     using namespace emscripten;
@@ -259,17 +365,20 @@ EMSCRIPTEN_BINDINGS(module_conn)
     function("on_socket_message", &on_message_raw);
     function("retry_to_connect", &retry_to_connect);
     function("resync_conn_SM", &resync_conn_SM);
+    function("on_visibility_change", &on_visibility_change);
+    function("close_socket", &close_socket);
 }
 
 static void connect()
 {
     EM_ASM({
-        if (window.__socket) {
-            window.__socket.close();
+        if (self.__socket) {
+            self.__socket.close();
         }
-        var path = (location.protocol == 'https:' ? 'wss' : 'ws') + '://'
-            + location.host + '/api/socket';
-        var s = window.__socket = new WebSocket(path);
+        var loc = brunhild.location();
+        var path = (loc.protocol == 'https:' ? 'wss' : 'ws') + '://' + loc.host
+            + '/api/socket';
+        var s = self.__socket = new WebSocket(path);
         s.onopen = function() { Module.on_socket_open(); };
         s.onclose = function() { Module.on_socket_close(); };
         s.onmessage = function(e)
@@ -294,7 +403,7 @@ void send_message(Message type, string msg)
     if (debug) {
         console::log("< " + s);
     }
-    EM_ASM_INT({ window.__socket.send(UTF8ToString($0)); }, s.c_str());
+    EM_ASM_INT({ self.__socket.send(UTF8ToString($0)); }, s.c_str());
 }
 
 // Render connection status indicator
@@ -313,7 +422,7 @@ static void schedule_reconnect()
     EM_ASM({
         // Wait maxes out at ~1min
         var wait
-            = Math.min(Math.floor(++window.__connection_attempt_count / 2), 12);
+            = Math.min(Math.floor(++self.__connection_attempt_count / 2), 12);
         wait = 500 * Math.pow(1.5, wait);
         setTimeout(Module.retry_to_connect, wait);
     });
@@ -321,21 +430,13 @@ static void schedule_reconnect()
 
 void init_connectivity()
 {
-    // Define some JS-side functions and listeners
+    // Listeners are bound on the main thread, as the module can run in a
+    // worker
     EM_ASM({
-        document.addEventListener('visibilitychange', function() {
-            if (!document.hidden && navigator.onLine) {
-                Module.resync_conn_SM();
-            }
-        });
-        window.addEventListener(
-            'online', function() { Module.retry_to_connect(); });
-        window.addEventListener('offline', function() {
-            if (window.__socket) {
-                window.__socket.close();
-                window.__socket = null;
-            }
-        });
+        brunhild.call('listenGlobal',
+            [ 'document', 'visibilitychange', 'on_visibility_change' ]);
+        brunhild.call('listenGlobal', [ 'window', 'online', 'retry_to_connect' ]);
+        brunhild.call('listenGlobal', [ 'window', 'offline', 'close_socket' ]);
     });
 
     // Define transition rules for the connection FSM
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "../fsm.hh"
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
 
 // Websocket connection and synchronization with server states
 enum class SyncStatus {
@@ -87,3 +90,9 @@ void init_connectivity();
 
 // Send a websocket message the server
 void send_message(Message, std::string);
+
+// Handler for messages received from the server.
+// The message buffer is writable and is modified during decoding.
+// extracted specifies, the mesage was extracted from a larger concatenated
+// message.
+void on_message(char* buf, size_t size, bool extracted);
@@ -3,16 +3,12 @@
 #include "../page/thread.hh"
 #include "../posts/models.hh"
 #include "../state.hh"
-#include <nlohmann/json.hpp>
 
-using nlohmann::json;
-
-void insert_post(std::string_view msg)
+void insert_post(JSONReader& r)
 {
     // TODO: R/a/dio song name override
 
-    auto j = json::parse(msg);
-    Post p(j);
+    Post p(r);
 
     // TODO: Existing post (created by this client) handling
 
@@ -21,8 +17,7 @@ void insert_post(std::string_view msg)
 
     // Need to ensure the post is queued to render and in the global collection
     // for all further operations
-    (posts)[p.id] = p;
-    auto& ref = posts.at(p.id);
+    auto& ref = store_post(std::move(p));
     if (!ref.editing) {
         ref.propagate_links();
     }
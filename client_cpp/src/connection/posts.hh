@@ -2,7 +2,7 @@
 
 #pragma once
 
-#include <string_view>
+#include "../json_reader.hh"
 
 // Insert a post into the thread from JSON
-void insert_post(std::string_view);
+void insert_post(JSONReader&);
@@ -20,7 +20,7 @@ void open_db(WaitGroup* wg)
     EM_ASM_INT(
         {
             // Expiring post ID object stores
-            window.postStores = ([
+            self.postStores = ([
                 // Posts created by this client
                 'mine',
                 // Replies to the user's posts that have already been seen
@@ -32,12 +32,12 @@ void open_db(WaitGroup* wg)
             ]);
 
             // Expiring thread data stores
-            window.threadStores = ([
+            self.threadStores = ([
                 // Threads currently watched
                 'watchedThreads',
             ]);
 
-            window.handle_db_error = function(e)
+            self.handle_db_error = function(e)
             {
                 Module._handle_db_error(e.toString(), $1);
             };
@@ -90,14 +90,14 @@ void open_db(WaitGroup* wg)
             };
             r.onsuccess = function()
             {
-                window.db = r.result;
+                self.db = r.result;
                 db.onerror = handle_db_error;
 
                 // Reload this tab, if another tab requires a DB upgrade
                 db.onversionchange = function()
                 {
                     db.close();
-                    location.reload(true);
+                    brunhild.call('reload', []);
                 };
 
                 Module.db_is_ready($1);
@@ -0,0 +1,179 @@
+#include "decoder.hh"
+#include <stdexcept>
+
+// Throw on malformed payloads
+[[noreturn]] static void malformed()
+{
+    throw std::runtime_error("malformed binary post payload");
+}
+
+uint8_t BinaryDecoder::read_byte()
+{
+    if (pos == buf.size()) {
+        malformed();
+    }
+    return buf[pos++];
+}
+
+uint64_t BinaryDecoder::read_uint()
+{
+    uint64_t val = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        const uint8_t b = read_byte();
+        val |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return val;
+        }
+    }
+    malformed();
+}
+
+size_t BinaryDecoder::read_count()
+{
+    const auto n = read_uint();
+    if (n > buf.size() - pos) {
+        malformed();
+    }
+    return n;
+}
+
+std::string_view BinaryDecoder::read_string()
+{
+    const auto size = read_count();
+    const auto s = buf.substr(pos, size);
+    pos += size;
+    return s;
+}
+
+Thread BinaryDecoder::read_thread()
+{
+    Thread t;
+    const uint8_t flags = read_byte();
+    t.deleted = flags & 1;
+    t.locked = flags & (1 << 1);
+    t.sticky = flags & (1 << 2);
+    t.id = read_uint();
+    t.time = read_uint();
+    t.post_ctr = read_uint();
+    t.image_ctr = read_uint();
+    t.reply_time = read_uint();
+    t.bump_time = read_uint();
+    t.board = read_string();
+    t.subject = read_string();
+    return t;
+}
+
+Post BinaryDecoder::read_post()
+{
+    Post p;
+    const auto flags = read_uint();
+    auto flag = [flags](int i) -> bool { return flags & (1 << i); };
+    p.editing = flag(0);
+    p.deleted = flag(1);
+    p.sage = flag(2);
+    p.banned = flag(3);
+    p.sticky = flag(4);
+    p.locked = flag(5);
+
+    p.id = read_uint();
+    p.time = read_uint();
+    p.body = read_string();
+    if (flag(6)) {
+        p.image = read_image();
+    }
+
+    std::optional<std::string>* opt[]
+        = { &p.name, &p.trip, &p.auth, &p.flag, &p.poster_id };
+    for (int i = 0; i < 5; i++) {
+        if (flag(7 + i)) {
+            *opt[i] = std::string(read_string());
+        }
+    }
+
+    const auto command_count = read_count();
+    p.commands.reserve(command_count);
+    for (size_t i = 0; i < command_count; i++) {
+        p.commands.push_back(read_command());
+    }
+
+    const auto link_count = read_count();
+    p.links.reserve(link_count);
+    for (size_t i = 0; i < link_count; i++) {
+        const unsigned long id = read_uint();
+        auto& l = p.links[id];
+        l.op = read_uint();
+        l.board = read_string();
+    }
+
+    return p;
+}
+
+Image BinaryDecoder::read_image()
+{
+    Image img;
+    const uint8_t flags = read_byte();
+    img.apng = flags & 1;
+    img.audio = flags & (1 << 1);
+    img.video = flags & (1 << 2);
+    img.spoiler = flags & (1 << 3);
+    img.file_type = static_cast<FileType>(read_byte());
+    img.thumb_type = static_cast<FileType>(read_byte());
+    for (auto& d : img.dims) {
+        d = read_uint();
+    }
+    img.length = read_uint();
+    img.size = read_uint();
+    if (flags & (1 << 4)) {
+        img.artist = std::string(read_string());
+    }
+    if (flags & (1 << 5)) {
+        img.title = std::string(read_string());
+    }
+    img.MD5 = read_string();
+    img.SHA1 = read_string();
+    img.name = read_string();
+    return img;
+}
+
+Command BinaryDecoder::read_command()
+{
+    Command c;
+    c.typ = static_cast<Command::Type>(read_byte());
+    switch (c.typ) {
+    case Command::Type::flip:
+        c.val = bool(read_byte());
+        break;
+    case Command::Type::eight_ball:
+        c.eight_ball = read_string();
+        break;
+    case Command::Type::pyu:
+    case Command::Type::pcount:
+    case Command::Type::rcount:
+        c.val = (unsigned long)(read_uint());
+        break;
+    case Command::Type::sync_watch: {
+        std::array<unsigned long, 5> arr;
+        for (auto& v : arr) {
+            v = read_uint();
+        }
+        c.val = arr;
+    } break;
+    case Command::Type::dice: {
+        std::array<uint16_t, 10> arr = { { 0 } };
+        const uint8_t size = read_byte();
+        if (size > arr.size()) {
+            malformed();
+        }
+        for (int i = 0; i < size; i++) {
+            arr[i] = read_uint();
+        }
+        c.val = arr;
+    } break;
+    case Command::Type::roulette:
+        c.val = std::array<uint8_t, 2>({ { read_byte(), read_byte() } });
+        break;
+    default:
+        malformed();
+    }
+    return c;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "posts/models.hh"
+#include <stdint.h>
+#include <string_view>
+
+// Leading byte of binary post payloads. Distinguishes them from JSON, which
+// can never start with a NUL byte.
+constexpr char binary_payload_tag = '\0';
+
+// Version of the binary post encoding
+constexpr uint8_t binary_payload_version = 1;
+
+// Compact binary encoding of threads and their posts. All integers are
+// unsigned LEB128 varints and all strings are a varint byte length followed by
+// UTF-8 bytes, unless noted otherwise. Optional fields are only present, if
+// their bit is set in the preceding flags.
+//
+//  payload = tag:u8 version:u8 page_total thread_count thread*
+//  thread  = flags:u8(deleted, locked, sticky) id time post_ctr image_ctr
+//            reply_time bump_time board subject post_count post*
+//  post    = flags(editing, deleted, sage, banned, sticky, locked, image, name,
+//            trip, auth, flag, poster_id) id time body image? name? trip?
+//            auth? flag? poster_id? command_count command* link_count link*
+//  image   = flags:u8(apng, audio, video, spoiler, artist, title)
+//            file_type:u8 thumb_type:u8 dims[4] length size artist? title?
+//            MD5 SHA1 name
+//  command = type:u8 value, where value is a u8 for flip, a string for
+//            eight_ball, 5 varints for sync_watch, a u8 count followed by that
+//            many varints for dice, 2 u8 for roulette and a varint otherwise
+//  link    = id op board
+//
+// The first post of a thread is its OP. Post op and board fields are inherited
+// from the thread.
+//
+// Reads values directly from the payload without intermediate copies. Throws
+// std::runtime_error on truncated or malformed input.
+class BinaryDecoder {
+public:
+    BinaryDecoder(std::string_view buf)
+        : buf(buf)
+    {
+    }
+
+    // Returns, if the entire payload has been read
+    bool done() const { return pos == buf.size(); }
+
+    uint8_t read_byte();
+    uint64_t read_uint();
+
+    // Read an element count. Every element takes at least one byte, so counts
+    // exceeding the remaining payload are rejected before anything is
+    // allocated for them.
+    size_t read_count();
+
+    // Returns a view into the payload
+    std::string_view read_string();
+
+    // Read thread metadata up to, but not including, the post count
+    Thread read_thread();
+
+    Post read_post();
+    Image read_image();
+    Command read_command();
+
+private:
+    std::string_view buf;
+    size_t pos = 0;
+};
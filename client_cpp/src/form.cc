@@ -1,6 +1,5 @@
 #include "form.hh"
 #include "lang.hh"
-#include <emscripten/val.h>
 
 Form::Form(bool no_buttons)
     : no_buttons(no_buttons)
@@ -48,13 +47,3 @@ brunhild::Node Form::render_controls()
 }
 
 brunhild::Node Form::render_footer() { return {}; }
-
-std::vector<emscripten::val> Form::get_inputs()
-{
-    using namespace emscripten;
-
-    return vecFromJSArray<val>(val::global("document")
-                                   .call<val>("getElementById", id)
-                                   .call<val>("querySelectorAll",
-                                       std::string("input,textarea,select")));
-}
@@ -1,7 +1,6 @@
 #pragma once
 
 #include "../brunhild/view.hh"
-#include <emscripten/val.h>
 
 // Generic input form view with optional captcha support
 // TODO: Captcha support
@@ -18,7 +17,7 @@ protected:
     virtual brunhild::Attrs attrs();
 
     // Handles sumbit event
-    virtual void on_submit(emscripten::val&){};
+    virtual void on_submit(const brunhild::Event&){};
 
     // Render submit and cancel buttons
     virtual brunhild::Node render_controls();
@@ -31,9 +30,6 @@ protected:
 
     brunhild::Node render();
 
-    // Query all form input elements
-    std::vector<emscripten::val> get_inputs();
-
 private:
     const bool no_buttons;
 };
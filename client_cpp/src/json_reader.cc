@@ -0,0 +1,253 @@
+#include "json_reader.hh"
+#include <stdexcept>
+#include <string.h>
+
+void JSONReader::error() { throw std::runtime_error("malformed JSON"); }
+
+char JSONReader::peek()
+{
+    while (pos != end) {
+        switch (*pos) {
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+            pos++;
+            break;
+        default:
+            return *pos;
+        }
+    }
+    return '\0';
+}
+
+void JSONReader::expect(char ch)
+{
+    if (peek() != ch) {
+        error();
+    }
+    pos++;
+}
+
+bool JSONReader::next(char close)
+{
+    const char ch = peek();
+    if (ch == ',') {
+        pos++;
+        return true;
+    }
+    if (ch != close) {
+        error();
+    }
+    pos++;
+    return false;
+}
+
+void JSONReader::expect_literal(std::string_view lit)
+{
+    peek();
+    if (size_t(end - pos) < lit.size() || memcmp(pos, lit.data(), lit.size())) {
+        error();
+    }
+    pos += lit.size();
+}
+
+bool JSONReader::read_null()
+{
+    if (peek() != 'n') {
+        return false;
+    }
+    expect_literal("null");
+    return true;
+}
+
+bool JSONReader::read_bool()
+{
+    if (peek() == 't') {
+        expect_literal("true");
+        return true;
+    }
+    expect_literal("false");
+    return false;
+}
+
+uint64_t JSONReader::read_uint()
+{
+    peek();
+    if (pos == end || *pos < '0' || *pos > '9') {
+        error();
+    }
+    uint64_t val = 0;
+    while (pos != end && *pos >= '0' && *pos <= '9') {
+        val = val * 10 + (*pos++ - '0');
+    }
+    return val;
+}
+
+int64_t JSONReader::read_int()
+{
+    bool negative = false;
+    if (peek() == '-') {
+        negative = true;
+        pos++;
+    }
+    const int64_t val = read_uint();
+    if (pos != end && *pos == '.') {
+        pos++;
+        while (pos != end && *pos >= '0' && *pos <= '9') {
+            pos++;
+        }
+    }
+    return negative ? -val : val;
+}
+
+uint32_t JSONReader::read_hex4()
+{
+    if (end - pos < 4) {
+        error();
+    }
+    uint32_t val = 0;
+    for (int i = 0; i < 4; i++) {
+        const char ch = *pos++;
+        val <<= 4;
+        if (ch >= '0' && ch <= '9') {
+            val |= ch - '0';
+        } else if (ch >= 'a' && ch <= 'f') {
+            val |= ch - 'a' + 10;
+        } else if (ch >= 'A' && ch <= 'F') {
+            val |= ch - 'A' + 10;
+        } else {
+            error();
+        }
+    }
+    return val;
+}
+
+std::string_view JSONReader::read_string()
+{
+    expect('"');
+
+    // Fast path for strings without escapes
+    char* const start = pos;
+    while (pos != end && *pos != '"' && *pos != '\\') {
+        pos++;
+    }
+    if (pos == end) {
+        error();
+    }
+    if (*pos == '"') {
+        return std::string_view(start, pos++ - start);
+    }
+
+    // Unescape in place. Decoded escapes are never longer than their encoded
+    // form, so the write position never overtakes the read position.
+    char* out = pos;
+    while (1) {
+        if (pos == end) {
+            error();
+        }
+        char ch = *pos++;
+        if (ch == '"') {
+            return std::string_view(start, out - start);
+        }
+        if (ch != '\\') {
+            *out++ = ch;
+            continue;
+        }
+
+        if (pos == end) {
+            error();
+        }
+        switch (ch = *pos++) {
+        case '"':
+        case '\\':
+        case '/':
+            *out++ = ch;
+            break;
+        case 'b':
+            *out++ = '\b';
+            break;
+        case 'f':
+            *out++ = '\f';
+            break;
+        case 'n':
+            *out++ = '\n';
+            break;
+        case 'r':
+            *out++ = '\r';
+            break;
+        case 't':
+            *out++ = '\t';
+            break;
+        case 'u': {
+            uint32_t cp = read_hex4();
+            if (cp >= 0xD800 && cp <= 0xDBFF && end - pos >= 6 && pos[0] == '\\'
+                && pos[1] == 'u') {
+                pos += 2;
+                const uint32_t low = read_hex4();
+                if (low < 0xDC00 || low > 0xDFFF) {
+                    error();
+                }
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            }
+
+            // Encode as UTF-8
+            if (cp < 0x80) {
+                *out++ = cp;
+            } else if (cp < 0x800) {
+                *out++ = 0xC0 | (cp >> 6);
+                *out++ = 0x80 | (cp & 0x3F);
+            } else if (cp < 0x10000) {
+                *out++ = 0xE0 | (cp >> 12);
+                *out++ = 0x80 | ((cp >> 6) & 0x3F);
+                *out++ = 0x80 | (cp & 0x3F);
+            } else {
+                *out++ = 0xF0 | (cp >> 18);
+                *out++ = 0x80 | ((cp >> 12) & 0x3F);
+                *out++ = 0x80 | ((cp >> 6) & 0x3F);
+                *out++ = 0x80 | (cp & 0x3F);
+            }
+        } break;
+        default:
+            error();
+        }
+    }
+}
+
+void JSONReader::skip()
+{
+    switch (peek()) {
+    case '{':
+        read_object([this](auto) { skip(); });
+        break;
+    case '[':
+        read_array([this]() { skip(); });
+        break;
+    case '"':
+        read_string();
+        break;
+    case 't':
+    case 'f':
+        read_bool();
+        break;
+    case 'n':
+        read_null();
+        break;
+    default: {
+        // Number
+        const char* start = pos;
+        while (pos != end) {
+            const char ch = *pos;
+            if ((ch >= '0' && ch <= '9') || ch == '-' || ch == '+' || ch == '.'
+                || ch == 'e' || ch == 'E') {
+                pos++;
+            } else {
+                break;
+            }
+        }
+        if (pos == start) {
+            error();
+        }
+    }
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+// Forward-only pull parser for JSON, that decodes values directly from the
+// buffer without building an intermediate DOM. Strings are unescaped in place,
+// so the buffer must be writable and views returned by read_string() point
+// into it. Throws std::runtime_error on malformed input.
+class JSONReader {
+public:
+    JSONReader(char* buf, size_t size)
+        : pos(buf)
+        , end(buf + size)
+    {
+    }
+
+    JSONReader(std::string& s)
+        : JSONReader(s.data(), s.size())
+    {
+    }
+
+    // Returns the first character of the next value without consuming it or
+    // '\0' at the end of input
+    char peek();
+
+    // Consumes the next value and returns true, if it is null
+    bool read_null();
+
+    bool read_bool();
+    uint64_t read_uint();
+
+    // Read an integer. Any fractional part is truncated.
+    int64_t read_int();
+
+    // Read a string and return a view into the buffer
+    std::string_view read_string();
+
+    // Read an object. fn(std::string_view key) is called for each key and must
+    // consume exactly one value.
+    template <class F> void read_object(F fn)
+    {
+        expect('{');
+        if (peek() == '}') {
+            pos++;
+            return;
+        }
+        do {
+            const auto key = read_string();
+            expect(':');
+            fn(key);
+        } while (next('}'));
+    }
+
+    // Read an array. fn() is called for each element and must consume exactly
+    // one value.
+    template <class F> void read_array(F fn)
+    {
+        expect('[');
+        if (peek() == ']') {
+            pos++;
+            return;
+        }
+        do {
+            fn();
+        } while (next(']'));
+    }
+
+    // Skip the next value of any type
+    void skip();
+
+private:
+    char* pos;
+    char* const end;
+
+    [[noreturn]] void error();
+
+    // Consume the next non-whitespace character, which must be ch
+    void expect(char ch);
+
+    // Consume either a ',' and return true or close and return false
+    bool next(char close);
+
+    // Consume a literal like "true"
+    void expect_literal(std::string_view lit);
+
+    // Consume the 4 hex digits of a \u escape
+    uint32_t read_hex4();
+};
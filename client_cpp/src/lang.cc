@@ -6,7 +6,7 @@ using nlohmann::json;
 
 void LanguagePack::load()
 {
-    auto j = json::parse(get_inner_html("lang-data"));
+    auto j = json::parse(get_page_data("lang-data"));
     auto& t = j["time"];
 
     load_map(posts, j["posts"]);
@@ -6,10 +6,10 @@ using std::string;
 
 void local_storage_set(const string& key, const string& val)
 {
-    EM_ASM_INT(
+    EM_ASM(
         {
-            localStorage.setItem(UTF8ToString($0), UTF8ToString($1));
-            return 0;
+            brunhild.call(
+                'setStorage', [ UTF8ToString($0), UTF8ToString($1) ]);
         },
         key.c_str(), val.c_str());
 }
@@ -18,7 +18,7 @@ std::optional<string> local_storage_get(const string& key)
 {
     char* val = (char*)EM_ASM_INT(
         {
-            var s = localStorage.getItem(UTF8ToString($0));
+            var s = brunhild.getStorage(UTF8ToString($0));
             if (!s) {
                 return null;
             }
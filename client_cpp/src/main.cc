@@ -6,10 +6,9 @@
 #include "page/header.hh"
 #include "page/navigation.hh"
 #include "page/page.hh"
-#include "posts/commands.hh"
 #include "posts/init.hh"
+#include "posts/timers.hh"
 #include "state.hh"
-#include <emscripten.h>
 
 static void start()
 {
@@ -25,7 +24,7 @@ static void start()
 
 int main()
 {
-    brunhild::before_flush = &rerender_syncwatches;
+    brunhild::before_flush = &update_post_timers;
     brunhild::init();
     load_state();
     init_posts();
@@ -34,28 +33,5 @@ int main()
 
     start();
 
-    // Block all clicks on <a> from exhibiting browser default behavior, unless
-    // the user intends to navigate to a new tab or open a browser menu.
-    // Also block navigation on form sumbition.
-    EM_ASM({
-        document.addEventListener('click', function(e) {
-            if (e.which != 1 || e.ctrlKey) {
-                return;
-            }
-            var t = e.target;
-            switch (t.tagName) {
-            case 'A':
-                if (t.getAttribute('target') == '_blank'
-                    || t.getAttribute('download')) {
-                    return;
-                }
-            case 'IMG':
-                e.preventDefault();
-            }
-        });
-        document.addEventListener(
-            'submit', function(e) { e.preventDefault(); });
-    });
-
     return 0;
 }
@@ -1,4 +1,5 @@
 #include "options.hh"
+#include "../../brunhild/view.hh"
 #include "../local_storage.hh"
 
 // TODO: Implement observer pattern. We don't actually need unregistering
@@ -49,6 +50,8 @@ void Options::load()
 
     load_string(theme, "theme");
     load_string(custom_css, "customCSS");
+
+    brunhild::invalidate_views();
 }
 
 void Options::load_bool(bool& val, const std::string& key)
@@ -148,7 +148,7 @@ static Node render_thread_form()
             });
         }
 
-        form.children.push_back(sel);
+        form.children.push_back(std::move(sel));
         form.children.push_back({ "br" });
     } else {
         form.children.push_back({
@@ -232,7 +232,7 @@ static Node render_thread_form()
 // Render board index page
 static void render_index_page()
 {
-    Rope s;
+    auto s = Rope::linear();
 
     // Render a random banner, if any
     if (auto const& b = board_config.banners; b.size()) {
@@ -284,7 +284,7 @@ static void render_index_page()
 
     aside_container.write_html(s);
 
-    brunhild::set_inner_html("threads", s.str());
+    brunhild::set_inner_html("threads", s.take());
 }
 
 void render_board()
@@ -105,15 +105,15 @@ BoardSelectionForm::BoardSelectionForm()
     board_navigation_view.patch();
 
     on("input", "input[name=search]", [this](auto& event) {
-        filter = to_lower(event["target"]["value"].template as<std::string>());
+        filter = to_lower(event.value);
         patch();
     });
 
     // Add or remove board to selected board for display or toggle catalog
     // linking
     on("change", "input[type=checkbox]", [this](auto& e) {
-        auto name = e["target"]["name"].template as<std::string>();
-        bool checked = e["target"]["checked"].template as<bool>();
+        const auto& name = e.name;
+        const bool checked = e.checked;
 
         if (name == "pointToCatalog") {
             local_storage_set("pointToCatalog", checked ? "true" : "false");
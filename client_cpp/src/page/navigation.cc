@@ -1,6 +1,8 @@
+#include "../../brunhild/events.hh"
 #include "../connection/connection.hh"
 #include "../connection/sync.hh"
 #include "../db.hh"
+#include "../options/options.hh"
 #include "../page/page.hh"
 #include "../page/thread.hh"
 #include "../state.hh"
@@ -8,49 +10,13 @@
 #include "scroll.hh"
 #include <emscripten.h>
 #include <emscripten/bind.h>
+#include <emscripten/val.h>
 #include <string>
 
-void init_navigation()
+// Set the hash of the page location
+static void set_hash(const std::string& hash)
 {
-    EM_ASM({
-        history.scrollRestoration = 'manual';
-
-        window.onpopstate = function(e)
-        {
-            var loc = e.target.location;
-            Module.try_navigate_page(loc.href.slice(loc.origin.length), false);
-        };
-
-        document.addEventListener("click",
-            function(e) {
-                var t = e.target;
-                if (e.which != 1 || e.ctrlKey || t.tagName != 'A'
-                    || t.getAttribute('target') == '_blank'
-                    || t.getAttribute('download')
-                    || !t.href.startsWith(location.origin)) {
-                    return;
-                }
-                switch (t.getAttribute('href')) {
-                case '#bottom':
-                case '#top':
-                    location.hash = t.getAttribute('href');
-                    return;
-                }
-                if (t.classList.contains('post-link')) {
-                    if (t.classList.contains("strikethrough")
-                        || localStorage.getItem('postInlineExpand') == 'true') {
-                        return;
-                    }
-                } else if (t.classList.contains('hash-link')
-                    && t.classList.contains("strikethrough")) {
-                    return;
-                }
-
-                Module.try_navigate_page(
-                    t.href.slice(location.origin.length), true);
-            },
-            { passive : true });
-    });
+    EM_ASM({ brunhild.call('setHash', [ UTF8ToString($0) ]); }, hash.c_str());
 }
 
 // Determine, if href points to a resource on the.
@@ -73,7 +39,7 @@ static void try_navigate_page(std::string href, bool need_push)
         }
         scroll_to_post(next_state.post);
         if (need_push) {
-            EM_ASM_INT({ location.hash = '#p' + $0; }, next_state.post);
+            set_hash("#p" + std::to_string(next_state.post));
         }
         page = next_state;
         return;
@@ -81,8 +47,7 @@ static void try_navigate_page(std::string href, bool need_push)
 
     // TODO: Reset postform
     page = next_state;
-    posts.clear();
-    threads.clear();
+    clear_posts();
     ThreadView::clear();
 
     // TODO: New server configuration propagation. Need hash comparison on
@@ -94,7 +59,7 @@ static void try_navigate_page(std::string href, bool need_push)
         = new WaitGroup(2, [ full_href = location_origin + href, need_push ]() {
               render_page();
               if (need_push) {
-                  EM_ASM({ history.pushState(null, null, UTF8ToString($0)); },
+                  EM_ASM({ brunhild.call('pushState', [ UTF8ToString($0) ]); },
                       full_href.c_str());
               }
           });
@@ -103,7 +68,57 @@ static void try_navigate_page(std::string href, bool need_push)
     conn_SM.once(ConnState::synced, [=]() { wg->done(); });
 }
 
+// Handle clicks on links to pages of this site without reloading the page
+static void on_link_click(const brunhild::Event& e)
+{
+    if (e.button != 0 || e.modifiers & brunhild::ctrl_key
+        || e.href.compare(0, location_origin.size(), location_origin)) {
+        return;
+    }
+    try_navigate_page(e.href.substr(location_origin.size()), true);
+}
+
+void init_navigation()
+{
+    EM_ASM({
+        brunhild.call('takeOverNavigation', []);
+        brunhild.call('listenGlobal', [ 'window', 'popstate', 'on_popstate' ]);
+    });
+
+    // Scroll to the top or bottom of the page
+    brunhild::register_handler("click",
+        [](auto& e) {
+            if (e.button == 0 && !(e.modifiers & brunhild::ctrl_key)) {
+                set_hash(e.href.substr(e.href.find('#')));
+            }
+        },
+        "a[href=\"#bottom\"], a[href=\"#top\"]");
+
+    // Links to hidden posts are not followed. Post links are expanded
+    // inline instead, if enabled.
+    brunhild::register_handler("click",
+        [](auto& e) {
+            if (!options.post_inline_expand) {
+                on_link_click(e);
+            }
+        },
+        "a.post-link:not(.strikethrough)");
+    brunhild::register_handler("click", &on_link_click,
+        "a:not(.post-link):not(.strikethrough):not([target=_blank])"
+        ":not([download]):not([href=\"#bottom\"]):not([href=\"#top\"])");
+}
+
+// Navigate to the page the browser's history was moved to
+static void on_popstate()
+{
+    auto href = emscripten::val::global("brunhild")
+                    .call<emscripten::val>("location")["href"]
+                    .as<std::string>();
+    try_navigate_page(href.substr(location_origin.size()), false);
+}
+
 EMSCRIPTEN_BINDINGS(module_navigation)
 {
     emscripten::function("try_navigate_page", &try_navigate_page);
+    emscripten::function("on_popstate", &on_popstate);
 }
@@ -36,8 +36,9 @@ void render_page()
     if (page.post) {
         scroll_to_post(page.post);
     } else {
-        const string s
-            = emscripten::val::global("location")["hash"].as<string>();
+        const string s = emscripten::val::global("brunhild")
+                             .call<emscripten::val>("location")["hash"]
+                             .as<string>();
         if (s == "#top" || s == "#bottom") {
             brunhild::scroll_into_view(s.substr(1));
         }
@@ -1,16 +1,23 @@
 #include "scroll.hh"
 #include "../posts/view.hh"
 #include "../state.hh"
+#include "thread.hh"
 #include <emscripten.h>
 #include <string>
 
 void scroll_to_post(unsigned id)
 {
-    if (!posts.count(id)) {
+    auto p = posts.find(id);
+    if (!p) {
         return;
     }
-    auto& p = posts.at(id);
-    if (p.views.size()) {
-        p.views[0]->scroll_into_view();
+
+    // Windowed threads might need to render the post first
+    if (auto it = ThreadView::instances.find(p->op);
+        it != ThreadView::instances.end() && it->second->scroll_to(id)) {
+        return;
+    }
+    if (p->views.size()) {
+        p->views[0]->scroll_into_view();
     }
 }
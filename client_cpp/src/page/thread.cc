@@ -3,6 +3,7 @@
 #include "../lang.hh"
 #include "../state.hh"
 #include "page.hh"
+#include <algorithm>
 #include <ctime>
 #include <optional>
 #include <sstream>
@@ -15,7 +16,7 @@ void render_thread()
     // TODO: Disable live posting toggle in non-live threads
 
     const Thread& thread = threads.at(page.thread);
-    brunhild::Rope s;
+    auto s = brunhild::Rope::linear();
 
     Node n("span", { { "class", "aside-container top-margin" } },
         {
@@ -55,7 +56,7 @@ void render_thread()
     });
     n.write_html(s);
 
-    brunhild::set_inner_html("threads", s.str());
+    brunhild::set_inner_html("threads", s.take());
 }
 
 void render_post_counter()
@@ -93,23 +94,51 @@ void render_post_counter()
     brunhild::set_inner_html("thread-post-counters", s.str());
 }
 
-ThreadView::ThreadView(unsigned long thread_id, std::string id)
+// Number of posts in the window before the viewport is first measured
+static const size_t initial_window = 50;
+
+// Height of posts in pixels assumed, before any are measured
+static const int default_height = 200;
+
+ThreadView::ThreadView(unsigned long thread_id, std::string id, bool windowed)
     : ListView("section", id)
     , thread_id(thread_id)
+    , windowed(windowed)
 {
     ThreadView::instances[thread_id] = this;
+    if (!windowed) {
+        return;
+    }
+
+    window_end = initial_window;
+    watcher = brunhild::watch_viewport(
+        this->id, [this](auto& v) { on_viewport(v); });
 }
 
-std::vector<Post*> ThreadView::get_list()
+ThreadView::~ThreadView()
 {
-    std::vector<Post*> re;
-    re.reserve(1 << 9);
-    for (auto & [ _, p ] : posts) {
-        if (p.op == thread_id) {
-            re.push_back(&posts.at(p.id));
-        }
+    if (windowed) {
+        brunhild::unwatch_viewport(watcher);
+    }
+    if (auto it = instances.find(thread_id);
+        it != instances.end() && it->second == this) {
+        instances.erase(it);
     }
-    return re;
+}
+
+const std::vector<Post*>& ThreadView::get_list()
+{
+    const auto& all = get_thread_posts(thread_id).posts;
+    if (!windowed) {
+        return all;
+    }
+
+    if (at_end || window_end > all.size()) {
+        window_end = all.size();
+    }
+    window_start = std::min(window_start, window_end);
+    window.assign(all.begin() + window_start, all.begin() + window_end);
+    return window;
 }
 
 std::shared_ptr<PostView> ThreadView::create_child(Post* p)
@@ -117,6 +146,171 @@ std::shared_ptr<PostView> ThreadView::create_child(Post* p)
     return p->views.emplace_back(new PostView(p->id));
 }
 
+void ThreadView::remove_child(PostView* v)
+{
+    v->remove();
+
+    // Views of posts outside the window must not be patched anymore
+    if (auto p = posts.find(v->model_id); p) {
+        auto& views = p->views;
+        views.erase(std::remove_if(views.begin(), views.end(),
+                        [=](auto& pv) { return pv.get() == v; }),
+            views.end());
+    }
+}
+
+brunhild::Attrs ThreadView::attrs()
+{
+    if (!windowed) {
+        return {};
+    }
+
+    const auto size = get_thread_posts(thread_id).posts.size();
+    std::ostringstream s;
+    s << "padding-top: " << sum_heights(0, window_start)
+      << "px; padding-bottom: "
+      << sum_heights(std::min(window_end, size), size) << "px;";
+    return { { "style", s.str() } };
+}
+
+int ThreadView::height_of(const Post* p) const
+{
+    if (auto it = heights.find(p->id); it != heights.end()) {
+        return it->second;
+    }
+    if (heights.empty()) {
+        return default_height;
+    }
+    return measured_total / long(heights.size());
+}
+
+long ThreadView::sum_heights(size_t start, size_t end) const
+{
+    const auto& all = get_thread_posts(thread_id).posts;
+    long sum = 0;
+    for (size_t i = start; i < end; i++) {
+        sum += height_of(all[i]);
+    }
+    return sum;
+}
+
+std::pair<size_t, size_t> ThreadView::range(int lo, int hi) const
+{
+    const auto& all = get_thread_posts(thread_id).posts;
+    size_t start = 0;
+    long y = 0;
+    for (; start < all.size(); start++) {
+        const int h = height_of(all[start]);
+        if (y + h > lo) {
+            break;
+        }
+        y += h;
+    }
+
+    // Viewport below the estimated end of the thread. Render the last posts.
+    if (start == all.size()) {
+        return { all.size() - std::min(all.size(), initial_window),
+            all.size() };
+    }
+
+    size_t end = start;
+    for (; end < all.size() && y < hi; end++) {
+        y += height_of(all[end]);
+    }
+    return { start, end };
+}
+
+void ThreadView::measure(const std::vector<int32_t>& measured)
+{
+    // The DOM might not have caught up with the window yet, if mutations were
+    // deferred to later frames
+    if (window.empty() || measured.size() != window.size()) {
+        return;
+    }
+
+    for (size_t i = 0; i < window.size(); i++) {
+        if (measured[i] <= 0) {
+            continue;
+        }
+        auto[it, inserted] = heights.try_emplace(window[i]->id, measured[i]);
+        if (!inserted) {
+            measured_total -= it->second;
+            it->second = measured[i];
+        }
+        measured_total += measured[i];
+    }
+}
+
+void ThreadView::set_viewport(int top, int height)
+{
+    if (!windowed) {
+        return;
+    }
+
+    // Only move the window, once the viewport with half the margin is no
+    // longer covered, so it is not patched on every scrolled pixel
+    const int margin = height;
+    const auto[need_start, need_end]
+        = range(top - margin / 2, top + height + margin / 2);
+    if (fitted && need_start >= window_start && need_end <= window_end) {
+        return;
+    }
+    const auto[start, end] = range(top - margin, top + height + margin);
+    fitted = true;
+    set_window(start, end);
+}
+
+void ThreadView::on_viewport(const brunhild::Viewport& v)
+{
+    measure(v.children);
+    set_viewport(v.top, v.height);
+}
+
+void ThreadView::set_window(size_t start, size_t end)
+{
+    const auto size = get_thread_posts(thread_id).posts.size();
+    at_end = end >= size;
+    if (start == window_start && end == window_end) {
+        return;
+    }
+    window_start = start;
+    window_end = end;
+    patch();
+}
+
+bool ThreadView::scroll_to(unsigned long id)
+{
+    const auto& all = get_thread_posts(thread_id).posts;
+    const auto it = std::find_if(
+        all.begin(), all.end(), [=](auto p) { return p->id == id; });
+    if (it == all.end()) {
+        return false;
+    }
+
+    // Center the window on the post
+    const size_t i = it - all.begin();
+    if (windowed && (i < window_start || i >= window_end)) {
+        const auto size = std::max(window_end - window_start, initial_window);
+        const auto start = i - std::min(i, size / 2);
+        set_window(start, std::min(start + size, all.size()));
+    }
+
+    for (auto& v : saved) {
+        if (v->model_id == id) {
+            v->scroll_into_view();
+            break;
+        }
+    }
+    return true;
+}
+
+brunhild::View* ThreadPageView::thread_container()
+{
+    const bool windowed = get_thread_posts(page.thread).posts.size()
+        > ThreadView::window_threshold;
+    return new ThreadView(page.thread, brunhild::new_string_id(), windowed);
+}
+
 std::vector<brunhild::View*> ThreadPageView::top_controls()
 {
     return { new Button(lang.ui.at("bottom"), "#bottom"),
@@ -1,10 +1,15 @@
 #pragma once
 
 #include "../../brunhild/view.hh"
+#include "../../brunhild/viewport.hh"
 #include "../posts/models.hh"
 #include "../posts/view.hh"
 #include "../state.hh"
 #include "page.hh"
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 // Render thread post count and expiration indicator
 void render_post_counter();
@@ -12,25 +17,89 @@ void render_post_counter();
 // Render a thread page
 void render_thread();
 
+// Renders the posts of a thread.
+// A windowed ThreadView only renders the posts in and around the viewport.
+// The space of posts outside the window is reserved with padding on the
+// container, sized from the measured heights of previously rendered posts.
 class ThreadView : public brunhild::ListView<Post, PostView> {
 public:
     const unsigned long thread_id;
 
-    ThreadView(unsigned long thread_id, std::string id = brunhild::new_id());
+    // Threads with more posts are rendered windowed
+    static const size_t window_threshold = 300;
+
+    // windowed: only render the posts in and around the viewport
+    ThreadView(unsigned long thread_id,
+        std::string id = brunhild::new_string_id(), bool windowed = false);
+    ~ThreadView();
 
     // All existing instaces
     static inline std::map<unsigned long, ThreadView*> instances;
     static void clear() { ThreadView::instances.clear(); }
 
+    // Move the window of a windowed thread to the viewport.
+    // top: offset of the viewport from the top of the thread in pixels
+    // height: height of the viewport in pixels
+    void set_viewport(int top, int height);
+
+    // Scroll a post of the thread into the viewport, rendering it first, if
+    // outside the window. Returns false, if the post is not in the thread.
+    bool scroll_to(unsigned long id);
+
 protected:
-    virtual std::vector<Post*> get_list();
+    virtual const std::vector<Post*>& get_list();
     std::shared_ptr<PostView> create_child(Post* p);
+    void remove_child(PostView* v);
+    brunhild::Attrs attrs();
+
+private:
+    const bool windowed;
+
+    // Window follows posts appended to the end of the thread
+    bool at_end = false;
+
+    // Window was fitted to the viewport at least once
+    bool fitted = false;
+
+    // Range of indices of the thread's posts in the window
+    size_t window_start = 0, window_end = 0;
+
+    // Posts in the window
+    std::vector<Post*> window;
+
+    // Measured heights of rendered posts in pixels by post ID
+    std::unordered_map<unsigned long, int> heights;
+
+    // Sum of all measured heights, for estimating the height of posts never
+    // rendered
+    long measured_total = 0;
+
+    // Returns the measured or, if never rendered, estimated height of a post
+    int height_of(const Post* p) const;
+
+    // Returns the range of post indices covering the pixel range [lo, hi)
+    std::pair<size_t, size_t> range(int lo, int hi) const;
+
+    // ID of the viewport watcher of a windowed thread
+    long watcher = 0;
+
+    // Record the measured heights of the rendered posts in the window
+    void measure(const std::vector<int32_t>& heights);
+
+    // Measure the window and move it to the viewport
+    void on_viewport(const brunhild::Viewport&);
+
+    // Set the window and patch the view, if changed
+    void set_window(size_t start, size_t end);
+
+    // Returns the sum of the heights of the posts in [start, end)
+    long sum_heights(size_t start, size_t end) const;
 };
 
 // Contains the post-related portion of the thread page
 class ThreadPageView : public PageView {
 protected:
-    brunhild::View* thread_container() { return new ThreadView(page.thread); }
+    brunhild::View* thread_container();
     std::vector<brunhild::View*> top_controls();
     std::vector<brunhild::View*> bottom_controls();
 };
@@ -4,7 +4,9 @@
 #include "etc.hh"
 #include "url.hh"
 #include "view.hh"
+#include <algorithm>
 #include <cctype>
+#include <functional>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -12,7 +14,12 @@
 #include <type_traits>
 #include <utility>
 
-using std::function;
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 using std::nullopt;
 using std::optional;
 using std::string;
@@ -25,79 +32,202 @@ static const Node opening_tags[TextState::tag_depth] = {
     { "span", { { "class", "blue" } } },
 };
 
-// Split string_view into subviews on delimiter D, call on_frag on each
-// fragment and call on_match after each matched delimiter
-template <class D>
-void parse_string(string_view frag, D sep, function<void(string_view)> on_frag,
-    function<void()> on_match = []() {})
+// Formatting tag toggled by a delimiter. Tags below code are numbered by
+// their level in TextState::as_array().
+enum Delimiter { spoiler, bold, italic, red, blue, code, none };
+
+// Return position of the first byte at or after i in s, that can start a
+// formatting delimiter, or s.size(), if none
+static size_t find_delimiter_byte(string_view s, size_t i)
 {
-    size_t i;
-    const size_t sep_s = brunhild::string_size(sep);
-    while (1) {
-        i = frag.find(sep);
-        on_frag(frag.substr(0, i));
-        if (i != string::npos) {
-            frag = frag.substr(i + sep_s);
-            on_match();
-        } else {
+    const char* const p = s.data();
+    const size_t n = s.size();
+
+#if defined(__wasm_simd128__)
+    const v128_t tick = wasm_i8x16_splat('`'), star = wasm_i8x16_splat('*'),
+                 at = wasm_i8x16_splat('@'), tilde = wasm_i8x16_splat('~'),
+                 caret = wasm_i8x16_splat('^');
+    for (; i + 16 <= n; i += 16) {
+        const v128_t v = wasm_v128_load(p + i);
+        const v128_t m = wasm_v128_or(
+            wasm_v128_or(wasm_v128_or(wasm_i8x16_eq(v, tick),
+                             wasm_i8x16_eq(v, star)),
+                wasm_v128_or(wasm_i8x16_eq(v, at), wasm_i8x16_eq(v, tilde))),
+            wasm_i8x16_eq(v, caret));
+        if (const uint32_t mask = wasm_i8x16_bitmask(m)) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i tick = _mm_set1_epi8('`'), star = _mm_set1_epi8('*'),
+                  at = _mm_set1_epi8('@'), tilde = _mm_set1_epi8('~'),
+                  caret = _mm_set1_epi8('^');
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v
+            = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        const __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, tick),
+                             _mm_cmpeq_epi8(v, star)),
+                _mm_or_si128(_mm_cmpeq_epi8(v, at), _mm_cmpeq_epi8(v, tilde))),
+            _mm_cmpeq_epi8(v, caret));
+        if (const int mask = _mm_movemask_epi8(m)) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        switch (p[i]) {
+        case '`':
+        case '*':
+        case '@':
+        case '~':
+        case '^':
+            return i;
+        }
+    }
+    return n;
+}
+
+// Find the first formatting delimiter in s. Returns its position and type or
+// s.size() and none, if not found.
+// No delimiter can overlap another, so the leftmost one is always the one the
+// tags would be split on, if each were split on in turn.
+static std::pair<size_t, Delimiter> find_delimiter(string_view s)
+{
+    for (size_t i = find_delimiter_byte(s, 0); i + 1 < s.size();
+         i = find_delimiter_byte(s, i + 1)) {
+        const char next = s[i + 1];
+        switch (s[i]) {
+        case '`':
+            if (next == '`') {
+                return { i, code };
+            }
+            break;
+        case '*':
+            if (next == '*') {
+                return { i, spoiler };
+            }
+            break;
+        case '@':
+            if (next == '@') {
+                return { i, bold };
+            }
+            break;
+        case '~':
+            if (next == '~') {
+                return { i, italic };
+            }
+            break;
+        case '^':
+            if (next == 'r') {
+                return { i, red };
+            }
+            if (next == 'b') {
+                return { i, blue };
+            }
             break;
         }
     }
+    return { s.size(), none };
 }
 
 Node PostView::render_body()
 {
     Node n("blockquote");
+
+    // Lines of open posts only depend on their text and the text state, so
+    // they can be cached. Closed posts also depend on links and commands of
+    // the model and are rarely rerendered.
+    const bool use_cache = m->editing;
+    if (!use_cache || line_cache_epoch != brunhild::render_epoch) {
+        line_cache.clear();
+        line_cache_epoch = brunhild::render_epoch;
+    }
     if (!m->body.size()) {
         return n;
     }
     state.reset(&n);
 
-    bool first = true;
-    parse_string(string_view(m->body), '\n', [this, &first](string_view line) {
-        state.quote = false;
-
-        // Prevent successive empty lines
-        if (!first) {
-            if (state.successive_newlines < 2) {
-                state.append({ "br" });
-            }
-        } else {
-            first = false;
-        }
-        if (!line.size()) {
-            state.successive_newlines++;
+    size_t i = 0;
+    auto render = [&](string_view line) {
+        const bool first = i++ == 0;
+        if (!use_cache) {
+            render_line(line, first);
             return;
         }
 
-        state.successive_newlines = 0;
-        if (line[0] == '>') {
-            state.quote = true;
-            state.append({ "em" }, true);
-        }
-        auto states = state.as_array();
-        for (int i = 0; i < (int)states.size(); i++) {
-            if (states[i]) {
-                state.append(opening_tags[i], true);
+        const size_t hash = std::hash<string_view>()(line);
+        const auto in = state.line_state();
+        if (i <= line_cache.size()) {
+            auto& c = line_cache[i - 1];
+            if (c.hash == hash && c.first == first && c.in == in) {
+                n.children.insert(
+                    n.children.end(), c.nodes.begin(), c.nodes.end());
+                state.set_line_state(c.out);
+                return;
             }
         }
 
-        parse_code(line, [this](string_view frag) {
-            m->editing ? parse_temp_links(frag) : parse_fragment(frag);
-        });
+        // Lines only append to the root, as all tags are closed at line end
+        const auto start = n.children.size();
+        render_line(line, first);
+        line_cache.resize(std::max(line_cache.size(), i));
+        line_cache[i - 1] = { hash, first, in, state.line_state(),
+            brunhild::Children(n.children.begin() + start, n.children.end()) };
+    };
+    string_view body(m->body);
+    while (1) {
+        const size_t end = body.find('\n');
+        render(body.substr(0, end));
+        if (end == string::npos) {
+            break;
+        }
+        body = body.substr(end + 1);
+    }
+    if (use_cache) {
+        line_cache.resize(i);
+    }
+    return n;
+}
 
-        // Close any unclosed tags
-        states = state.as_array(); // State might have changed during parsing
-        for (auto s : states) {
-            if (s) {
-                state.ascend();
-            }
+void PostView::render_line(string_view line, bool first)
+{
+    state.quote = false;
+
+    // Prevent successive empty lines
+    if (!first && state.successive_newlines < 2) {
+        state.append({ "br" });
+    }
+    if (!line.size()) {
+        state.successive_newlines++;
+        return;
+    }
+
+    state.successive_newlines = 0;
+    if (line[0] == '>') {
+        state.quote = true;
+        state.append({ "em" }, true);
+    }
+    auto states = state.as_array();
+    for (int i = 0; i < (int)states.size(); i++) {
+        if (states[i]) {
+            state.append(opening_tags[i], true);
         }
-        if (state.quote) {
+    }
+
+    parse_formatting(line);
+
+    // Close any unclosed tags
+    states = state.as_array(); // State might have changed during parsing
+    for (auto s : states) {
+        if (s) {
             state.ascend();
         }
-    });
-    return n;
+    }
+    if (state.quote) {
+        state.ascend();
+    }
 }
 
 void PostView::wrap_tags(int level)
@@ -119,87 +249,76 @@ void PostView::wrap_tags(int level)
     }
 }
 
-void PostView::parse_code(string_view frag, PostView::OnFrag fn)
+void PostView::parse_formatting(string_view line)
 {
-    parse_string(frag, "``",
-        [this, fn](string_view frag) {
-            if (state.code) {
-                // Strip quotes
-                size_t num_quotes = 0;
-                while (frag.size() && frag[0] == '>') {
-                    frag = frag.substr(1);
-                }
-                if (num_quotes) {
-                    string s;
-                    s.reserve(4 * num_quotes);
-                    for (size_t i = 0; i <= num_quotes; i++) {
-                        s += "&gt;";
-                    }
-                    state.append({ "span", s });
-                }
+    const char* const line_start = line.data();
+    while (1) {
+        if (state.code) {
+            const size_t i = line.find("``");
 
-                highlight_syntax(frag);
-            } else {
-                parse_spoilers(frag, fn);
+            // Strip quotes
+            auto frag = line.substr(0, i);
+            while (frag.size() && frag[0] == '>') {
+                frag = frag.substr(1);
             }
-        },
-        [this]() { state.code = !state.code; });
-}
+            highlight_syntax(frag);
 
-void PostView::parse_spoilers(string_view frag, PostView::OnFrag fn)
-{
-    parse_string(frag, "**",
-        [this, fn](string_view frag) { parse_bolds(frag, fn); },
-        [this]() {
-            wrap_tags(0);
-            state.spoiler = !state.spoiler;
-        });
-}
+            if (i == string::npos) {
+                return;
+            }
+            state.code = false;
+            line = line.substr(i + 2);
+            continue;
+        }
 
-void PostView::parse_bolds(string_view frag, PostView::OnFrag fn)
-{
-    parse_string(frag, "@@",
-        [this, fn](string_view frag) { parse_italics(frag, fn); },
-        [this]() {
-            wrap_tags(1);
+        const auto[i, delim] = find_delimiter(line);
+        const auto frag = line.substr(0, i);
+        const bool tag_starts_line = !i && line.data() == line_start;
+        m->editing ? parse_temp_links(frag) : parse_fragment(frag);
+        if (delim == none) {
+            return;
+        }
+        line = line.substr(i + 2);
+
+        switch (delim) {
+        case code:
+            state.code = true;
+            state.code_lang = CodeLang::any;
+
+            // A language hint after a code tag on its own line selects the
+            // keywords of the code block
+            if (tag_starts_line) {
+                if (auto lang = parse_code_lang(line)) {
+                    state.code_lang = *lang;
+                    return;
+                }
+            }
+            continue;
+        case red:
+        case blue:
+            // Still split on, but not formatted
+            if (!board_config.rb_text) {
+                continue;
+            }
+        }
+        wrap_tags(delim);
+        switch (delim) {
+        case spoiler:
+            state.spoiler = !state.spoiler;
+            break;
+        case bold:
             state.bold = !state.bold;
-        });
-}
-
-void PostView::parse_italics(string_view frag, PostView::OnFrag fn)
-{
-    parse_string(frag, "~~",
-        [this, fn](string_view frag) { parse_reds(frag, fn); },
-        [this]() {
-            wrap_tags(2);
+            break;
+        case italic:
             state.italic = !state.italic;
-        });
-}
-
-void PostView::parse_reds(string_view frag, PostView::OnFrag fn)
-{
-    if (board_config.rb_text) {
-        parse_string(frag, "^r",
-            [this, fn](string_view frag) { parse_blues(frag, fn); },
-            [this]() {
-                wrap_tags(3);
-                state.red = !state.red;
-            });
-    } else {
-        parse_string(frag, "^r",
-            [this, fn](string_view frag) { parse_blues(frag, fn); });
-    }
-}
-
-void PostView::parse_blues(string_view frag, PostView::OnFrag fn)
-{
-    if (board_config.rb_text) {
-        parse_string(frag, "^b", fn, [this]() {
-            wrap_tags(4);
+            break;
+        case red:
+            state.red = !state.red;
+            break;
+        case blue:
             state.blue = !state.blue;
-        });
-    } else {
-        parse_string(frag, "^b", fn);
+            break;
+        }
     }
 }
 
@@ -243,20 +362,15 @@ static inline tuple<char, string_view, char> split_punctuation(string_view word)
     return { lead, word, trail };
 }
 
-void PostView::parse_words(string_view frag, PostView::OnFrag fn)
+template <class F> void PostView::parse_words(string_view frag, F fn)
 {
-    bool first = true;
     state.buf.reserve(frag.size());
-
-    parse_string(frag, " ", [this, &first, fn](string_view frag) {
-        if (!first) {
-            state.buf += ' ';
-        } else {
-            first = false;
-        }
+    while (1) {
+        const size_t i = frag.find(' ');
 
         // Split leading and trailing punctuation, if any
-        auto[lead_punct, word, trail_punct] = split_punctuation(frag);
+        auto[lead_punct, word, trail_punct]
+            = split_punctuation(frag.substr(0, i));
         if (lead_punct) {
             state.buf += lead_punct;
         }
@@ -264,7 +378,13 @@ void PostView::parse_words(string_view frag, PostView::OnFrag fn)
         if (trail_punct) {
             state.buf += trail_punct;
         }
-    });
+
+        if (i == string::npos) {
+            break;
+        }
+        state.buf += ' ';
+        frag = frag.substr(i + 1);
+    }
 
     // Append any leftover text
     state.flush_text();
@@ -374,8 +494,8 @@ void PostView::parse_fragment(string_view frag)
 
             // Internal and custom reference URLs
             if (auto l = parse_reference(word)) {
-                auto[count, n] = *l;
-                state.append(n, false, count);
+                auto& [count, n] = *l;
+                state.append(std::move(n), false, count);
                 matched = true;
             }
             break;
@@ -385,14 +505,14 @@ void PostView::parse_fragment(string_view frag)
             }
             // Hash commands
             if (auto n = parse_commands(word)) {
-                state.append(*n);
+                state.append(std::move(*n));
                 matched = true;
             }
             break;
         default:
             // Generic HTTP(S)/FTP(S) URLs, magnet links and embeds
             if (auto n = parse_url(word)) {
-                state.append(*n);
+                state.append(std::move(*n));
                 matched = true;
             }
         }
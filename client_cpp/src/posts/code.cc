@@ -1,12 +1,259 @@
 #include "view.hh"
-#include <algorithm>
+#include <array>
 #include <cctype>
-#include <iterator>
-#include <unordered_set>
+#include <stdint.h>
+#include <string_view>
 
 using std::string;
+using std::string_view;
 
-enum token_type { unmatched, identifier, quoted, double_quoted, comment };
+enum token_type { unmatched, quoted, double_quoted, comment };
+
+// Set of keywords with a perfect hash table generated at compile time.
+// Keywords are split into buckets by their hash and each bucket is assigned a
+// displacement, that places all of its keywords into free slots of the table.
+// Lookups hash the word once and compare it to at most one keyword.
+class KeywordSet {
+public:
+    static constexpr size_t max_keys = 255;
+    static constexpr uint32_t table_size = 512, bucket_count = 128;
+
+    template <size_t N>
+    constexpr KeywordSet(const string_view (&keys)[N])
+        : keys(keys)
+    {
+        static_assert(N <= max_keys, "too many keywords");
+
+        // Order keywords by bucket
+        std::array<size_t, bucket_count + 1> starts = {};
+        for (auto k : keys) {
+            starts[hash(k).bucket + 1]++;
+        }
+        size_t largest = 0;
+        for (size_t i = 0; i < bucket_count; i++) {
+            largest = std::max(largest, starts[i + 1]);
+            starts[i + 1] += starts[i];
+        }
+        std::array<size_t, bucket_count + 1> next = starts;
+        std::array<Hash, max_keys> hashes = {};
+        std::array<uint8_t, max_keys> order = {};
+        for (size_t i = 0; i < N; i++) {
+            const auto h = hash(keys[i]);
+            hashes[next[h.bucket]] = h;
+            order[next[h.bucket]++] = i;
+        }
+
+        for (auto& s : slots) {
+            s = empty;
+        }
+
+        // Place the largest buckets first, while most slots are still free
+        for (size_t size = largest; size; size--) {
+            for (size_t b = 0; b < bucket_count; b++) {
+                if (starts[b + 1] - starts[b] == size) {
+                    place(b, starts[b], starts[b + 1], hashes, order);
+                }
+            }
+        }
+    }
+
+    // Return, if word is in the set
+    constexpr bool contains(string_view word) const
+    {
+        const auto h = hash(word);
+        const uint8_t i = slots[slot(h, displacements[h.bucket])];
+        return i != empty && keys[i] == word;
+    }
+
+private:
+    static constexpr uint8_t empty = 0xff;
+
+    struct Hash {
+        uint32_t bucket, base, step;
+    };
+
+    const string_view* keys;
+
+    // Indices into keys by slot
+    std::array<uint8_t, table_size> slots = {};
+
+    // Displacements of each bucket's keys in slots
+    std::array<uint16_t, bucket_count> displacements = {};
+
+    static constexpr Hash hash(string_view s)
+    {
+        // FNV-1a for the bucket and its finalized mix for the slot
+        uint32_t h = 2166136261u;
+        for (char ch : s) {
+            h = (h ^ uint8_t(ch)) * 16777619u;
+        }
+        uint32_t x = h;
+        x = (x ^ (x >> 16)) * 0x7feb352du;
+        x = (x ^ (x >> 15)) * 0x846ca68bu;
+        x ^= x >> 16;
+
+        // Odd steps visit all slots of the table
+        return { h % bucket_count, x % table_size,
+            (x / table_size) % table_size | 1 };
+    }
+
+    static constexpr size_t slot(const Hash& h, uint32_t displacement)
+    {
+        return (h.base + displacement * h.step) % table_size;
+    }
+
+    // Find a displacement, that places all keys of bucket b in free distinct
+    // slots
+    constexpr void place(size_t b, size_t start, size_t end,
+        const std::array<Hash, max_keys>& hashes,
+        const std::array<uint8_t, max_keys>& order)
+    {
+        for (uint32_t d = 0; d < table_size; d++) {
+            bool free = true;
+            for (size_t i = start; i < end && free; i++) {
+                const auto s = slot(hashes[i], d);
+                free = slots[s] == empty;
+                for (size_t j = start; j < i && free; j++) {
+                    free = slot(hashes[j], d) != s;
+                }
+            }
+            if (free) {
+                for (size_t i = start; i < end; i++) {
+                    slots[slot(hashes[i], d)] = order[i];
+                }
+                displacements[b] = d;
+                return;
+            }
+        }
+        throw "no displacement found for keyword bucket";
+    }
+};
+
+// Keywords of most common languages
+static constexpr string_view any_keywords[] = { "NULL", "NaN", "abstract",
+    "alias", "and", "arguments", "array", "asm", "assert", "async", "auto",
+    "await", "base", "begin", "bool", "boolean", "break", "byte", "case",
+    "catch", "char", "checked", "class", "clone", "compl", "const",
+    "constexpr", "continue", "debugger", "decimal", "declare", "default",
+    "defer", "deinit", "delegate", "delete", "do", "double", "echo", "elif",
+    "else", "elseif", "elsif", "end", "ensure", "enum", "event", "except",
+    "exec", "explicit", "export", "extends", "extension", "extern",
+    "fallthrough", "false", "final", "finally", "fixed", "float", "fn", "for",
+    "foreach", "friend", "from", "func", "function", "global", "go", "goto",
+    "guard", "if", "impl", "implements", "implicit", "import", "in",
+    "include", "inline", "inout", "instanceof", "int", "interface",
+    "internal", "is", "lambda", "let", "lock", "long", "module", "mut",
+    "mutable", "namespace", "native", "new", "next", "nil", "not", "null",
+    "object", "operator", "or", "out", "override", "package", "params",
+    "private", "protected", "protocol", "pub", "public", "raise", "readonly",
+    "redo", "ref", "register", "repeat", "require", "rescue", "restrict",
+    "retry", "return", "sbyte", "sealed", "short", "signed", "sizeof",
+    "static", "str", "string", "struct", "subscript", "super", "switch",
+    "synchronized", "template", "then", "throws", "transient", "true", "try",
+    "type", "typealias", "typedef", "typeid", "typename", "typeof", "uint",
+    "unchecked", "undef", "undefined", "union", "unless", "unsigned", "until",
+    "use", "using", "var", "virtual", "void", "volatile", "when", "where",
+    "while", "with", "xor", "yield" };
+
+static constexpr string_view c_keywords[] = { "NULL", "_Bool", "auto",
+    "bool", "break", "case", "char", "const", "continue", "default", "do",
+    "double", "else", "enum", "extern", "false", "float", "for", "goto", "if",
+    "inline", "int", "long", "register", "restrict", "return", "short",
+    "signed", "sizeof", "static", "struct", "switch", "true", "typedef",
+    "union", "unsigned", "void", "volatile", "while" };
+
+static constexpr string_view cpp_keywords[] = { "NULL", "alignas", "alignof",
+    "and", "asm", "auto", "bool", "break", "case", "catch", "char", "class",
+    "co_await", "co_return", "co_yield", "compl", "concept", "const",
+    "const_cast", "consteval", "constexpr", "constinit", "continue",
+    "decltype", "default", "delete", "do", "double", "dynamic_cast", "else",
+    "enum", "explicit", "export", "extern", "false", "final", "float", "for",
+    "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace",
+    "new", "noexcept", "not", "nullptr", "operator", "or", "override",
+    "private", "protected", "public", "register", "reinterpret_cast",
+    "requires", "return", "short", "signed", "sizeof", "static",
+    "static_assert", "static_cast", "struct", "switch", "template", "this",
+    "thread_local", "throw", "true", "try", "typedef", "typeid", "typename",
+    "union", "unsigned", "using", "virtual", "void", "volatile", "wchar_t",
+    "while", "xor" };
+
+static constexpr string_view go_keywords[] = { "bool", "break", "byte",
+    "case", "chan", "const", "continue", "default", "defer", "else", "error",
+    "fallthrough", "false", "float64", "for", "func", "go", "goto", "if",
+    "import", "int", "interface", "iota", "map", "nil", "package", "range",
+    "return", "rune", "select", "string", "struct", "switch", "true", "type",
+    "uint", "var" };
+
+static constexpr string_view js_keywords[] = { "NaN", "arguments", "async",
+    "await", "break", "case", "catch", "class", "const", "continue",
+    "debugger", "default", "delete", "do", "else", "export", "extends",
+    "false", "finally", "for", "from", "function", "if", "import", "in",
+    "instanceof", "let", "new", "null", "of", "return", "static", "super",
+    "switch", "this", "throw", "true", "try", "typeof", "undefined", "var",
+    "void", "while", "with", "yield" };
+
+static constexpr string_view py_keywords[] = { "False", "None", "True",
+    "and", "as", "assert", "async", "await", "break", "class", "continue",
+    "def", "del", "elif", "else", "except", "finally", "for", "from",
+    "global", "if", "import", "in", "is", "lambda", "nonlocal", "not", "or",
+    "pass", "raise", "return", "self", "try", "while", "with", "yield" };
+
+static constexpr string_view rust_keywords[] = { "Err", "None", "Ok", "Self",
+    "Some", "as", "async", "await", "break", "const", "continue", "crate",
+    "dyn", "else", "enum", "extern", "false", "fn", "for", "if", "impl", "in",
+    "let", "loop", "match", "mod", "move", "mut", "pub", "ref", "return",
+    "self", "static", "struct", "super", "trait", "true", "type", "unsafe",
+    "use", "where", "while" };
+
+// Keyword sets by CodeLang
+static constexpr KeywordSet keyword_sets[] = {
+    any_keywords,
+    c_keywords,
+    cpp_keywords,
+    go_keywords,
+    js_keywords,
+    py_keywords,
+    rust_keywords,
+};
+
+// Return, if set contains all keys
+template <size_t N>
+static constexpr bool contains_all(
+    const KeywordSet& set, const string_view (&keys)[N])
+{
+    for (auto k : keys) {
+        if (!set.contains(k)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(contains_all(keyword_sets[0], any_keywords)
+        && contains_all(keyword_sets[1], c_keywords)
+        && contains_all(keyword_sets[2], cpp_keywords)
+        && contains_all(keyword_sets[3], go_keywords)
+        && contains_all(keyword_sets[4], js_keywords)
+        && contains_all(keyword_sets[5], py_keywords)
+        && contains_all(keyword_sets[6], rust_keywords),
+    "keyword missing from perfect hash table");
+
+std::optional<CodeLang> parse_code_lang(string_view name)
+{
+    static constexpr std::pair<string_view, CodeLang> names[] = {
+        { "c", CodeLang::c }, { "c++", CodeLang::cpp },
+        { "cpp", CodeLang::cpp }, { "go", CodeLang::go },
+        { "javascript", CodeLang::js }, { "js", CodeLang::js },
+        { "py", CodeLang::py }, { "python", CodeLang::py },
+        { "rs", CodeLang::rust }, { "rust", CodeLang::rust },
+    };
+    for (auto & [ n, lang ] : names) {
+        if (n == name) {
+            return lang;
+        }
+    }
+    return std::nullopt;
+}
 
 // Return, if char could be a part of an identifier in most languages
 static bool is_identifier_char(const char b)
@@ -14,47 +261,44 @@ static bool is_identifier_char(const char b)
     return isalnum(b) || b == '_' || b == '$';
 }
 
-// Return, if word is one of the supported keywords
-static bool is_keyword(const std::string& word)
+// Return, if char is one of the supported operators
+static bool is_operator(const char b)
 {
-    // Sorted for fast binary searching
-    const static string keywords[] = { "NULL", "NaN", "abstract", "alias",
-        "and", "arguments", "array", "asm", "assert", "async", "auto", "await",
-        "base", "begin", "bool", "boolean", "break", "byte", "case", "catch",
-        "char", "checked", "class", "clone", "compl", "const", "constexpr",
-        "continue", "debugger", "decimal", "declare", "default", "defer",
-        "deinit", "delegate", "delete", "do", "double", "echo", "elif", "else",
-        "elseif", "elsif", "end", "ensure", "enum", "event", "except", "exec",
-        "explicit", "export", "extends", "extension", "extern", "fallthrough",
-        "false", "final", "finally", "fixed", "float", "fn", "for", "foreach",
-        "friend", "from", "func", "function", "global", "go", "goto", "guard",
-        "if", "impl", "implements", "implicit", "import", "in", "include",
-        "inline", "inout", "instanceof", "int", "interface", "internal", "is",
-        "lambda", "let", "lock", "long", "module", "mut", "mutable",
-        "namespace", "native", "new", "next", "nil", "not", "null", "object",
-        "operator", "or", "out", "override", "package", "params", "private",
-        "protected", "protocol", "pub", "public", "raise", "readonly", "redo",
-        "ref", "register", "repeat", "require", "rescue", "restrict", "retry",
-        "return", "sbyte", "sealed", "short", "signed", "sizeof", "static",
-        "str", "string", "struct", "subscript", "super", "switch",
-        "synchronized", "template", "then", "throws", "transient", "true",
-        "try", "type", "typealias", "typedef", "typeid", "typename", "typeof",
-        "uint", "unchecked", "undef", "undefined", "union", "unless",
-        "unsigned", "until", "use", "using", "var", "virtual", "void",
-        "volatile", "when", "where", "while", "with", "xor", "yield" };
-
-    return std::binary_search(std::begin(keywords), std::end(keywords), word);
+    switch (b) {
+    case '!':
+    case '%':
+    case '&':
+    case '*':
+    case '+':
+    case '-':
+    case '/':
+    case ':':
+    case '<':
+    case '=':
+    case '>':
+    case '?':
+    case '@':
+    case '^':
+    case '|':
+    case '~':
+        return true;
+    default:
+        return false;
+    }
 }
 
-// Return, if char is one of the supported operators
-static bool is_operator(const char b)
+// Return length of the run of operators starting at i. Stops before a comment.
+static size_t operator_run(string_view frag, size_t i)
 {
-    const static char operators[] = { '!', '%', '&', '*', '+', '-', '/', ':',
-        '<', '=', '>', '?', '@', '^', '|', '~' };
-    return std::binary_search(std::begin(operators), std::end(operators), b);
+    size_t end = i + 1;
+    while (end < frag.size() && is_operator(frag[end])
+        && frag.substr(end, 2) != "//") {
+        end++;
+    }
+    return end - i;
 }
 
-void PostView::highlight_syntax(std::string_view frag)
+void PostView::highlight_syntax(string_view frag)
 {
     if (!frag.size()) {
         return;
@@ -62,35 +306,19 @@ void PostView::highlight_syntax(std::string_view frag)
     state.append({ "code", { { "class", "code-tag" } } }, true);
     state.buf.reserve(64);
 
-    auto wrap_operator = [this](char op) {
-        state.append(
-            { "span", { { "class", "ms-operator" } }, string(1, op), true });
+    const auto& keywords = keyword_sets[size_t(state.code_lang)];
+    auto wrap = [this](const char* cls, string_view text) {
+        state.append({ "span", { { "class", cls } }, string(text), true });
     };
 
-    string token;
-    token.reserve(64);
     token_type type = unmatched;
     char prev = 0;
-    char b = 0;
-    char next = 0;
     for (size_t i = 0; i < frag.size(); i++) {
-        b = frag[i];
-        next = i != frag.size() - 1 ? frag[i + 1] : 0;
+        const char b = frag[i];
 
         switch (type) {
         case unmatched:
             switch (b) {
-            case '/':
-                if (next == '/') {
-                    type = comment;
-                    state.append(
-                        { "span", { { "class", "ms-comment" } } }, true);
-                    state.buf += "//";
-                    i++;
-                } else {
-                    wrap_operator('/');
-                }
-                break;
             case '\'':
                 type = quoted;
                 state.append({ "span", { { "class", "ms-string" } } }, true);
@@ -102,32 +330,39 @@ void PostView::highlight_syntax(std::string_view frag)
                 state.buf += b;
                 break;
             default:
-                if (is_operator(b)) {
-                    wrap_operator(b);
+                if (frag.substr(i, 2) == "//") {
+                    // We only have line-terminated comments and those are
+                    // terminated upstream the call stack
+                    type = comment;
+                    state.append(
+                        { "span", { { "class", "ms-comment" } } }, true);
+                    state.buf += frag.substr(i);
+                    i = frag.size();
+                } else if (is_operator(b)) {
+                    // Adjacent operators share a tag
+                    const size_t n = operator_run(frag, i);
+                    wrap("ms-operator", frag.substr(i, n));
+                    i += n - 1;
                 } else if (is_identifier_char(b)) {
-                    type = identifier;
-                    token += b;
+                    size_t n = 1;
+                    while (i + n < frag.size()
+                        && is_identifier_char(frag[i + n])) {
+                        n++;
+                    }
+                    const auto word = frag.substr(i, n);
+                    if (i + n < frag.size() && frag[i + n] == '(') {
+                        wrap("ms-function", word);
+                    } else if (keywords.contains(word)) {
+                        wrap("ms-operator", word);
+                    } else {
+                        state.buf += word;
+                    }
+                    i += n - 1;
                 } else {
                     state.buf += b;
                 }
             }
             break;
-        case identifier:
-            token += b;
-            if (!is_identifier_char(next)) {
-                if (next == '(') {
-                    state.append({ "span", { { "class", "ms-function" } },
-                        token, true });
-                } else if (is_keyword(token)) {
-                    state.append({ "span", { { "class", "ms-operator" } },
-                        token, true });
-                } else {
-                    state.buf += token;
-                }
-                type = unmatched;
-                token.clear();
-            }
-            break;
         case quoted:
             state.buf += b;
             if (b == '\'' && prev != '\\') {
@@ -142,21 +377,11 @@ void PostView::highlight_syntax(std::string_view frag)
                 state.ascend();
             }
             break;
-        case comment:
-            state.buf += b;
-            // We only have line-terminated commnets and those are terminated
-            // upstream the call stack
-            break;
         }
 
         prev = b;
     }
 
-    // Flush any remaining buffer
-    if (type == identifier) {
-        state.buf += token;
-    }
-
     // Close open tags
     if (type != unmatched) {
         state.ascend();
@@ -3,12 +3,12 @@
 #include "commands.hh"
 #include "../lang.hh"
 #include "../state.hh"
+#include "timers.hh"
 #include "view.hh"
 #include <cctype>
 #include <ctime>
 #include <iomanip>
 #include <sstream>
-#include <unordered_map>
 #include <utility>
 
 using std::nullopt;
@@ -16,34 +16,6 @@ using std::optional;
 using std::ostringstream;
 using std::string;
 using std::string_view;
-using std::unordered_map;
-
-// IDs of posts, that are pending a rerender to update the syncwatch and the
-// time they should be rerender at. Specifying a timestamp helps avoid useless
-// subtree diffs.
-static unordered_map<unsigned long, time_t> pending_rerender;
-
-void rerender_syncwatches()
-{
-    if (!pending_rerender.size()) {
-        return;
-    }
-
-    // Prevent modifications from patching affecting the iterated map
-    unordered_map<unsigned long, time_t> m(pending_rerender);
-    const auto now = std::time(0);
-
-    for (auto[id, when] : m) {
-        if (now >= when) {
-            pending_rerender.erase(id);
-
-            // Posts might have been removed by now
-            if (posts.count(id)) {
-                posts.at(id).patch();
-            }
-        }
-    }
-}
 
 // Read any digit from string_view and return it, if any.
 // Rejects numbers longer than 5 digits.
@@ -251,13 +223,8 @@ optional<Node> PostView::parse_commands(string_view word)
     return { { "strong", { { "class", cls } }, os.str(), true } };
 }
 
-// TODO: Also need to figure out, how to handle updating these on countdown.
-// Perhaps a global registry, that gets flushed on page re-render?
-// Probably a good idea to hook these before RAF execution.
 optional<Node> PostView::parse_syncwatch(std::string_view frag)
 {
-    using std::setw;
-
     // Parse and validate
     if (!frag.size()) {
         return nullopt;
@@ -298,11 +265,19 @@ optional<Node> PostView::parse_syncwatch(std::string_view frag)
         }
     }
 
+    const auto& args = syncwatches.emplace_back(
+        std::get<std::array<unsigned long, 5>>(
+            m->commands[state.dice_index++].val));
+    return { { "em", {}, { render_syncwatch(args) } } };
+}
+
+Node PostView::render_syncwatch(const std::array<unsigned long, 5>& args)
+{
+    using std::setw;
+
     // Format inner string
     // TODO: Apply offset from server clock
-    const auto[hours, min, sec, start, end]
-        = std::get<std::array<unsigned long, 5>>(
-            m->commands[state.dice_index++].val);
+    const auto[hours, min, sec, start, end] = args;
     const unsigned long now = std::time(0) + server_time_offset;
     ostringstream s;
     if (now > end) {
@@ -322,18 +297,9 @@ optional<Node> PostView::parse_syncwatch(std::string_view frag)
               << hours << ':' << setw(2) << min << ':' << setw(2) << sec;
         }
 
-        // Schedule next render to update counter
-        pending_rerender[m->id] = now + 1;
+        // Schedule next update of the counter
+        schedule_post_update(m->id, std::time(0) + 1);
     }
 
-    return {
-        {
-            "em", {},
-            {
-                {
-                    "strong", { { "class", "embed syncwatch" } }, s.str(),
-                },
-            },
-        },
-    };
+    return { "strong", { { "class", "embed syncwatch" } }, s.str() };
 }
@@ -19,29 +19,36 @@ static string ago(time_t n, string units, bool is_future)
                      : count + " " + lang.posts.at("ago");
 }
 
-string relative_time(time_t then)
+string relative_time(time_t then, time_t* next_change)
 {
-    auto now = (float)std::time(0);
-    auto t = (now - (float)then) / 60;
-    auto is_future = false;
-    if (t < 1) {
-        if (t > -5) { // Assume to be client clock imprecision
-            return lang.posts.at("justNow");
-        }
-        is_future = true;
-        t = -t;
+    time_t next;
+    if (!next_change) {
+        next_change = &next;
     }
 
-    const int divide[4] = { 60, 24, 30, 12 };
-    const static string unit[4] = { "minute", "hour", "day", "month" };
-    for (int i = 0; i < 4; i++) {
-        if (t < divide[i]) {
-            return ago(t, unit[i], is_future);
-        }
-        t /= divide[i];
+    auto d = std::time(0) - then;
+    if (d < 60 && d > -300) { // Assume to be client clock imprecision
+        *next_change = then + 60;
+        return lang.posts.at("justNow");
+    }
+    const bool is_future = d < 0;
+    if (is_future) {
+        d = -d;
+    }
+
+    // Lengths of units in seconds. Months are 30 days and years 12 months.
+    const static time_t lengths[5] = { 60, 3600, 86400, 2592000, 31104000 };
+    const static string units[5] = { "minute", "hour", "day", "month", "year" };
+    int i = 0;
+    while (i < 4 && d >= lengths[i + 1]) {
+        i++;
     }
+    const auto n = d / lengths[i];
 
-    return ago(t, "year", is_future);
+    // Past counts grow and future ones shrink
+    *next_change = is_future ? then - n * lengths[i] + 1
+                             : then + (n + 1) * lengths[i];
+    return ago(n, units[i], is_future);
 }
 
 std::string absolute_thread_url(unsigned long id, string board)
@@ -110,31 +117,30 @@ Node render_link(string_view url, string_view text, bool new_tab)
     return n;
 }
 
-Post* match_post(emscripten::val& event)
+Post* match_post(const brunhild::Event& event)
 {
-    string attr
-        = event["target"].call<string>("getAttribute", string("data-id"));
-    if (attr == "") {
+    if (event.data_id == "") {
         return 0;
     }
-    const unsigned long id = std::stoul(attr);
-    if (!posts.count(id)) {
-        return 0;
-    }
-    return &posts.at(id);
+    const unsigned long id = std::stoul(event.data_id);
+    return posts.find(id);
 }
 
-std::optional<std::tuple<Post*, PostView*>> match_view(emscripten::val& event)
+std::optional<std::tuple<Post*, PostView*>> match_view(
+    const brunhild::Event& event)
 {
     auto model = match_post(event);
-    if (!model) {
+    if (!model || model->views.empty()) {
         return {};
     }
-    const string id = event["target"]
-                          .call<emscripten::val>("closest", string("article"))
-                          .call<string>("getAttribute", string("id"));
+
+    // Most posts are only rendered once, so the containing view only needs to
+    // be looked up from the event target's ancestors, if there are several
+    if (model->views.size() == 1) {
+        return { { model, model->views.front().get() } };
+    }
     for (auto& v : model->views) {
-        if (v->id == id) {
+        if (event.is_inside(v->id)) {
             return { { model, v.get() } };
         }
     }
@@ -1,10 +1,10 @@
 #pragma once
 
+#include "../../brunhild/events.hh"
 #include "../../brunhild/node.hh"
 #include "models.hh"
 #include "view.hh"
 #include <ctime>
-#include <emscripten/val.h>
 #include <string>
 #include <string_view>
 
@@ -14,8 +14,9 @@ const brunhild::Node delete_toggle = brunhild::Node("input",
         { "type", "checkbox" }, { "class", "deleted-toggle" },
     });
 
-// Renders readable elapsed time since Unix timestamp then
-std::string relative_time(time_t then);
+// Renders readable elapsed time since Unix timestamp then. If next_change is
+// set, it is set to the Unix time the rendered text changes at.
+std::string relative_time(time_t then, time_t* next_change = nullptr);
 
 // Generate absolute URL of a thread
 std::string absolute_thread_url(unsigned long id, std::string board);
@@ -27,8 +28,9 @@ brunhild::Node render_post_link(unsigned long id, const LinkData& data);
 brunhild::Node render_link(
     std::string_view url, std::string_view text, bool new_tab = true);
 
-// Match target post by attributes of an element. If none found, returns NULL.
-Post* match_post(emscripten::val&);
+// Match target post by the attributes of the event target. If none found, returns NULL.
+Post* match_post(const brunhild::Event&);
 
-// Match target post view and model by attributes of an element.
-std::optional<std::tuple<Post*, PostView*>> match_view(emscripten::val& event);
+// Match target post view and model by the attributes of the event target.
+std::optional<std::tuple<Post*, PostView*>> match_view(
+    const brunhild::Event& event);
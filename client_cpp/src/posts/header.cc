@@ -2,6 +2,7 @@
 #include "../options/options.hh"
 #include "../state.hh"
 #include "etc.hh"
+#include "timers.hh"
 #include "view.hh"
 #include <array>
 #include <string>
@@ -262,7 +263,13 @@ Node PostView::render_header()
     n.children.push_back({ "a", { { "class", "control" } },
         R"'(<svg xmlns="http://www.w3.org/2000/svg" width="8" height="8" viewBox="0 0 8 8"><path d="M1.5 0l-1.5 1.5 4 4 4-4-1.5-1.5-2.5 2.5-2.5-2.5z" transform="translate(0 1)" /></svg>)'" });
 
-    n.stringify_subtree();
+    // The time element is updated on its own by patch_time(), so only the
+    // subtrees of its siblings are stringified
+    for (auto& ch : n.children) {
+        if (ch.children.size()) {
+            ch.stringify_subtree();
+        }
+    }
     return n;
 }
 
@@ -312,7 +319,11 @@ Node PostView::render_time()
         << lang.week[then->tm_wday] << ") " << setw(2) << then->tm_hour << ':'
         << setw(2) << then->tm_min << ':' << setw(2) << then->tm_sec;
 
-    const auto rel = relative_time(m->time);
+    time_t next_change;
+    const auto rel = relative_time(m->time, &next_change);
+    if (options.relative_time) {
+        schedule_post_update(m->id, next_change);
+    }
 
     return Node("time",
         { { "title", options.relative_time ? abs.str() : rel } },
@@ -1,57 +1,76 @@
+#include "hide.hh"
 #include "../options/options.hh"
 #include "../state.hh"
-#include "models.hh"
-#include <optional>
-#include <unordered_set>
+#include <algorithm>
+#include <vector>
 
-// Recursively gather links of posts linking to the parent post
-static void recurse_backlinks(
-    const std::map<unsigned long, LinkData>& backlinks,
-    std::optional<std::unordered_set<unsigned long>>& to_hide)
+// Hide all posts linking the posts in worklist directly or indirectly.
+// Traverses backlinks iteratively, so long reply chains can not overflow the
+// stack. Posts already hidden are not traversed again, as any posts linking
+// them were hidden along with them. Appends slots of newly hidden posts to
+// hidden.
+static void hide_linkers(
+    std::vector<uint32_t>& worklist, std::vector<uint32_t>& hidden)
 {
-    for (auto & [ id, _ ] : backlinks) {
-        // Skip posts already marked as hidden. Those will have or have already
-        // had posts linking them marked recursively by other calls
-        if (!post_ids.hidden.count(id) && posts.count(id)) {
-            post_ids.hidden.insert(id);
-            if (to_hide) {
-                to_hide->insert(id);
+    while (worklist.size()) {
+        const auto slot = worklist.back();
+        worklist.pop_back();
+        for (auto s : link_graph.backlinks(slot)) {
+            if (post_ids.hidden.insert(link_graph.id(s)).second) {
+                worklist.push_back(s);
+                hidden.push_back(s);
             }
-            recurse_backlinks(posts.at(id).backlinks, to_hide);
         }
     }
 }
 
 void recurse_hidden_posts()
 {
-    std::optional<std::unordered_set<unsigned long>> to_hide;
-    const bool recurse = options.hide_recursively;
-    for (auto const & [ id, p ] : posts) {
-        if (post_ids.hidden.count(id)) {
-            if (recurse) {
-                recurse_backlinks(p.backlinks, to_hide);
-            }
+    if (!options.hide_recursively) {
+        return;
+    }
+
+    // Only hidden posts linked by loaded posts can hide any
+    std::vector<uint32_t> worklist, hidden;
+    for (auto id : post_ids.hidden) {
+        if (const auto slot = link_graph.slot(id); slot != LinkGraph::none) {
+            worklist.push_back(slot);
         }
     }
+    hide_linkers(worklist, hidden);
 }
 
 void hide_recursively(Post& post)
 {
-    std::optional<std::unordered_set<unsigned long>> to_hide = { { {} } };
     post_ids.hidden.insert(post.id);
+    const auto slot = link_graph.slot(post.id);
+    if (slot == LinkGraph::none) {
+        post.touch();
+        post.patch();
+        return;
+    }
+
+    std::vector<uint32_t> hidden = { slot };
     if (options.hide_recursively) {
-        recurse_backlinks(post.backlinks, to_hide);
-    } else {
-        // Still patch all links to this post
-        for (auto & [ id, _ ] : posts) {
-            to_hide->insert(id);
-        }
+        std::vector<uint32_t> worklist = hidden;
+        hide_linkers(worklist, hidden);
     }
 
-    post.patch();
-    for (auto id : *to_hide) {
-        if (posts.count(id)) {
-            posts.at(id).patch();
+    // Links to hidden posts are rendered struck through, so only the hidden
+    // posts and the posts linking them or linked by them change
+    std::vector<uint32_t> changed = hidden;
+    for (auto s : hidden) {
+        const auto links = link_graph.links(s),
+                   backlinks = link_graph.backlinks(s);
+        changed.insert(changed.end(), links.begin(), links.end());
+        changed.insert(changed.end(), backlinks.begin(), backlinks.end());
+    }
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    for (auto s : changed) {
+        if (auto p = posts.find(link_graph.id(s)); p) {
+            p->touch();
+            p->patch();
         }
     }
 }
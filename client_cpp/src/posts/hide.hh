@@ -2,11 +2,11 @@
 
 #include "../posts/models.hh"
 
-// Remove all hidden posts from post collection.
-// If recursive post hiding is enabled, recursively scan post list and remove
-// all posts, that link hidden posts
+// If recursive post hiding is enabled, hide all posts, that link hidden posts
+// directly or indirectly. Does not patch any posts.
 void recurse_hidden_posts();
 
 // Hide all posts that reply to post recursively, if enabled. Otherwise just
-// hide this one post.
+// hide this one post. Patches only the hidden posts and the posts rendering
+// links to them.
 void hide_recursively(Post& post);
@@ -306,21 +306,16 @@ std::tuple<Node, optional<Node>> PostView::render_image()
 
     const string id_str = std::to_string(m->id);
     inner.attrs["data-id"] = id_str;
-    Node n({
-        "figure", {},
+    Node a("a",
         {
-            {
-                "a",
-                {
-                    { "href", img.source_path() }, { "target", "_blank" },
-                    { "data-id", id_str },
-                },
-                { inner },
-            },
-        },
-    });
+            { "href", img.source_path() }, { "target", "_blank" },
+            { "data-id", id_str },
+        });
+    a.children.push_back(std::move(inner));
+    Node n("figure");
+    n.children.push_back(std::move(a));
     n.stringify_subtree();
-    return { n, audio };
+    return { std::move(n), std::move(audio) };
 }
 
 // Match view with image or return
@@ -334,7 +329,7 @@ std::tuple<Node, optional<Node>> PostView::render_image()
         return;                                                                \
     }
 
-void handle_image_click(emscripten::val& event)
+void handle_image_click(const brunhild::Event& event)
 {
     if (page.catalog) {
         return;
@@ -350,33 +345,29 @@ void handle_image_click(emscripten::val& event)
     case FileType::targz:
     case FileType::tarxz:
     case FileType::txt:
-        EM_ASM_INT(
+        EM_ASM(
             {
-                if (!document.querySelector) {
-                    // Really old browser. Fuck it!
-                    return;
-                }
-                document.getElementById(UTF8ToString($0))
-                    .querySelector('figcaption a[download]')
-                    .click();
+                brunhild.call('click',
+                    [ UTF8ToString($0), 'figcaption a[download]' ]);
             },
             view->id.data());
         return;
     }
 
     view->expanded = !view->expanded;
+    view->invalidate();
     if (options.inline_fit == Options::FittingMode::width
         && !options.gallery_mode_toggle
-        && img.dims[1]
-            > emscripten::val::global("window")["innerHeight"].as<unsigned>()) {
+        && img.dims[1] > EM_ASM_INT({ return brunhild.innerHeight(); })) {
         brunhild::scroll_into_view(view->id);
     }
     view->patch();
 }
 
-void toggle_hidden_thumbnail(emscripten::val& event)
+void toggle_hidden_thumbnail(const brunhild::Event& event)
 {
     MATCH_WITH_IMAGE(event);
     view->reveal_thumbnail = !view->reveal_thumbnail;
+    view->invalidate();
     view->patch();
 }
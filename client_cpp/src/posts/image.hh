@@ -3,7 +3,7 @@
 #include "../../brunhild/events.hh"
 
 // Image click handler
-void handle_image_click(emscripten::val&);
+void handle_image_click(const brunhild::Event&);
 
 // Reveal/hide thumbnail by clicking [Show]/[Hide] in hidden thumbnail mode
-void toggle_hidden_thumbnail(emscripten::val&);
+void toggle_hidden_thumbnail(const brunhild::Event&);
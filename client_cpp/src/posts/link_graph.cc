@@ -0,0 +1,121 @@
+#include "link_graph.hh"
+#include <algorithm>
+
+uint32_t LinkGraph::slot(unsigned long id) const
+{
+    if (auto it = index.find(id); it != index.end()) {
+        return it->second;
+    }
+    return none;
+}
+
+uint32_t LinkGraph::add_node(unsigned long id)
+{
+    auto[it, inserted] = index.try_emplace(id, ids.size());
+    if (inserted) {
+        ids.push_back(id);
+        out.add_node();
+        in.add_node();
+    }
+    return it->second;
+}
+
+void LinkGraph::link(unsigned long from, unsigned long to)
+{
+    const auto f = add_node(from);
+    const auto t = add_node(to);
+    if (out.insert(f, t)) {
+        in.insert(t, f);
+        links_total++;
+    }
+}
+
+void LinkGraph::set_links(
+    unsigned long from, const std::unordered_map<unsigned long, LinkData>& links)
+{
+    const auto f = add_node(from);
+
+    // Iterate backwards, as removal moves the last slot into the removed one
+    for (auto i = out.get(f).size(); i-- > 0;) {
+        const auto t = out.get(f).begin()[i];
+        if (!links.count(ids[t])) {
+            out.remove(f, t);
+            in.remove(t, f);
+            links_total--;
+        }
+    }
+    for (auto && [ to, _ ] : links) {
+        link(from, to);
+    }
+}
+
+void LinkGraph::clear()
+{
+    index.clear();
+    ids.clear();
+    out.clear();
+    in.clear();
+    links_total = 0;
+}
+
+bool LinkGraph::Lists::insert(uint32_t node, uint32_t slot)
+{
+    auto& r = ranges[node];
+    const auto begin = pool.begin() + r.start, end = begin + r.size;
+    if (std::find(begin, end, slot) != end) {
+        return false;
+    }
+
+    if (r.size == r.capacity) {
+        const uint32_t capacity = r.capacity ? r.capacity * 2 : 2;
+        if (r.start + r.capacity == pool.size()) {
+            // Last list in the pool can grow in place
+            pool.resize(r.start + capacity);
+        } else {
+            const uint32_t start = pool.size();
+            pool.resize(start + capacity);
+            std::copy_n(pool.begin() + r.start, r.size, pool.begin() + start);
+            unused += r.capacity;
+            r.start = start;
+        }
+        r.capacity = capacity;
+    }
+    pool[r.start + r.size++] = slot;
+
+    if (unused > pool.size() / 2) {
+        compact();
+    }
+    return true;
+}
+
+void LinkGraph::Lists::remove(uint32_t node, uint32_t slot)
+{
+    auto& r = ranges[node];
+    const auto begin = pool.begin() + r.start, end = begin + r.size;
+    if (auto it = std::find(begin, end, slot); it != end) {
+        *it = *(end - 1);
+        r.size--;
+    }
+}
+
+void LinkGraph::Lists::compact()
+{
+    std::vector<uint32_t> packed;
+    packed.reserve(pool.size() - unused);
+    for (auto& r : ranges) {
+        const uint32_t start = packed.size();
+        packed.insert(packed.end(), pool.begin() + r.start,
+            pool.begin() + r.start + r.size);
+        r.start = start;
+        r.capacity = r.size;
+    }
+    pool = std::move(packed);
+    unused = 0;
+}
+
+void LinkGraph::Lists::clear()
+{
+    ranges.clear();
+    pool.clear();
+    unused = 0;
+}
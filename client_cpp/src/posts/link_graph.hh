@@ -0,0 +1,112 @@
+#pragma once
+
+#include "models.hh"
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// Index of links between posts in both directions. Posts are identified by
+// dense node slots, so traversals only touch compact arrays of slots instead
+// of the link maps of the much larger Post structs. Posts linked, but not
+// loaded, have nodes too, as they can still be hidden.
+class LinkGraph {
+public:
+    // Returned for posts without a node
+    static constexpr uint32_t none = uint32_t(-1);
+
+    // Range of node slots. Invalidated by any modification of the graph.
+    class Slots {
+    public:
+        Slots(const uint32_t* begin, const uint32_t* end)
+            : b(begin)
+            , e(end)
+        {
+        }
+
+        const uint32_t* begin() const { return b; }
+        const uint32_t* end() const { return e; }
+        size_t size() const { return e - b; }
+
+    private:
+        const uint32_t *b, *e;
+    };
+
+    // Returns the node slot of a post or none
+    uint32_t slot(unsigned long id) const;
+
+    // Returns the post ID of a node slot
+    unsigned long id(uint32_t slot) const { return ids[slot]; }
+
+    // Number of nodes
+    size_t size() const { return ids.size(); }
+
+    // Number of links
+    size_t link_count() const { return links_total; }
+
+    // Slots of posts linked by a post
+    Slots links(uint32_t slot) const { return out.get(slot); }
+
+    // Slots of posts linking a post
+    Slots backlinks(uint32_t slot) const { return in.get(slot); }
+
+    // Add a link from one post to another, if not already linked
+    void link(unsigned long from, unsigned long to);
+
+    // Replace all links of a post. Also adds a node for the post, if none.
+    void set_links(unsigned long from,
+        const std::unordered_map<unsigned long, LinkData>& links);
+
+    // Remove all nodes and links
+    void clear();
+
+private:
+    // Lists of slots of all nodes packed into a single array. A full list is
+    // moved to the end of the array with double the capacity and the array is
+    // compacted, once more than half of it is unused.
+    class Lists {
+    public:
+        Slots get(uint32_t node) const
+        {
+            const auto& r = ranges[node];
+            const auto p = pool.data() + r.start;
+            return { p, p + r.size };
+        }
+
+        void add_node() { ranges.emplace_back(); }
+
+        // Append slot to the list of node, if not in it. Returns, if appended.
+        bool insert(uint32_t node, uint32_t slot);
+
+        // Remove slot from the list of node, if in it. Does not preserve the
+        // order of the list.
+        void remove(uint32_t node, uint32_t slot);
+
+        void clear();
+
+    private:
+        struct Range {
+            uint32_t start = 0, size = 0, capacity = 0;
+        };
+        std::vector<Range> ranges;
+        std::vector<uint32_t> pool;
+
+        // Number of pool elements not in any list's capacity
+        size_t unused = 0;
+
+        // Repack all lists without spare capacity
+        void compact();
+    };
+
+    // Node slots by post ID
+    std::unordered_map<unsigned long, uint32_t> index;
+
+    // Post IDs by node slot
+    std::vector<unsigned long> ids;
+
+    Lists out, in;
+    size_t links_total = 0;
+
+    // Returns the node slot of a post, adding a node, if none
+    uint32_t add_node(unsigned long id);
+};
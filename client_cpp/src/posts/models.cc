@@ -1,87 +1,127 @@
 #include "models.hh"
 #include "../../brunhild/mutations.hh"
+#include "../options/options.hh"
 #include "../state.hh"
 #include "hide.hh"
 #include "view.hh"
 #include <sstream>
 
-using nlohmann::json;
 using std::string;
 
-// Deserialize a property that might or might not be present from a kew of the
-// same name
-#define PARSE_OPT(key)                                                         \
-    if (j.count(#key)) {                                                       \
-        key = j[#key];                                                         \
-    }
-
-// Same as parse_opt, but explicitly converts to an std::string.
-// Needed with std::optional<std::string> fields.
-#define PARSE_OPT_STRING(key)                                                  \
-    if (j.count(#key)) {                                                       \
-        key = j.at(#key).get<string>();                                        \
-    }
+Image::Image(JSONReader& r)
+{
+    r.read_object([&](std::string_view key) {
+        if (!decode_field(key, r)) {
+            r.skip();
+        }
+    });
+}
 
-Image::Image(nlohmann::json& j)
+bool Image::decode_field(std::string_view key, JSONReader& r)
 {
-    PARSE_OPT(apng);
-    PARSE_OPT(audio);
-    PARSE_OPT(video);
-    PARSE_OPT(spoiler);
-    file_type = static_cast<FileType>(j["fileType"]);
-    thumb_type = static_cast<FileType>(j["thumbType"]);
-
-    auto& j_dims = j["dims"];
-    for (int i = 0; i < 4; i++) {
-        dims[i] = j_dims[i];
+    if (key == "apng") {
+        apng = r.read_bool();
+    } else if (key == "audio") {
+        audio = r.read_bool();
+    } else if (key == "video") {
+        video = r.read_bool();
+    } else if (key == "spoiler") {
+        spoiler = r.read_bool();
+    } else if (key == "fileType") {
+        file_type = static_cast<FileType>(r.read_uint());
+    } else if (key == "thumbType") {
+        thumb_type = static_cast<FileType>(r.read_uint());
+    } else if (key == "dims") {
+        int i = 0;
+        r.read_array([&]() {
+            const auto d = r.read_uint();
+            if (i < 4) {
+                dims[i++] = d;
+            }
+        });
+    } else if (key == "length") {
+        length = r.read_uint();
+    } else if (key == "size") {
+        size = r.read_uint();
+    } else if (key == "artist") {
+        artist = string(r.read_string());
+    } else if (key == "title") {
+        title = string(r.read_string());
+    } else if (key == "MD5") {
+        MD5 = r.read_string();
+    } else if (key == "SHA1") {
+        SHA1 = r.read_string();
+    } else if (key == "name") {
+        name = r.read_string();
+    } else {
+        return false;
     }
-
-    PARSE_OPT(length);
-    size = j["size"];
-    PARSE_OPT_STRING(artist);
-    PARSE_OPT_STRING(title);
-    MD5 = j["MD5"];
-    SHA1 = j["SHA1"];
-    name = j["name"];
+    return true;
 }
 
-Command::Command(nlohmann::json& j)
+Command::Command(JSONReader& r)
 {
-    uint8_t _typ = j["type"];
-    typ = static_cast<Type>(_typ);
-
-    auto const& v = j["val"];
-    switch (typ) {
-    case Type::flip:
-        val = v.get<bool>();
-        break;
-    case Type::eight_ball:
-        eight_ball = v;
-        break;
-    case Type::pyu:
-    case Type::pcount:
-    case Type::rcount:
-        val = v.get<unsigned long>();
-        break;
-    case Type::sync_watch: {
-        std::array<unsigned long, 5> arr;
-        for (int i = 0; i < 5; i++) {
-            arr[i] = v[i];
+    bool has_type = false;
+    r.read_object([&](std::string_view key) {
+        if (key == "type") {
+            typ = static_cast<Type>(r.read_uint());
+            has_type = true;
+            return;
         }
-        val = arr;
-    } break;
-    case Type::dice: {
-        std::array<uint16_t, 10> arr = { { 0 } };
-        const int size = v.size();
-        for (int i = 0; i < size; i++) {
-            arr[i] = v[i];
+        if (key != "val" || !has_type) {
+            r.skip();
+            return;
         }
-        val = arr;
-    } break;
-    case Type::roulette:
-        val = std::array<uint8_t, 2>({ { v[0], v[1] } });
-        break;
-    }
+
+        switch (typ) {
+        case Type::flip:
+            val = r.read_bool();
+            break;
+        case Type::eight_ball:
+            eight_ball = r.read_string();
+            break;
+        case Type::pyu:
+        case Type::pcount:
+        case Type::rcount:
+            val = (unsigned long)(r.read_uint());
+            break;
+        case Type::sync_watch: {
+            std::array<unsigned long, 5> arr = { { 0 } };
+            int i = 0;
+            r.read_array([&]() {
+                const auto v = r.read_uint();
+                if (i < 5) {
+                    arr[i++] = v;
+                }
+            });
+            val = arr;
+        } break;
+        case Type::dice: {
+            std::array<uint16_t, 10> arr = { { 0 } };
+            int i = 0;
+            r.read_array([&]() {
+                const auto v = r.read_uint();
+                if (i < 10) {
+                    arr[i++] = v;
+                }
+            });
+            val = arr;
+        } break;
+        case Type::roulette: {
+            std::array<uint8_t, 2> arr = { { 0 } };
+            int i = 0;
+            r.read_array([&]() {
+                const auto v = r.read_uint();
+                if (i < 2) {
+                    arr[i++] = v;
+                }
+            });
+            val = arr;
+        } break;
+        default:
+            r.skip();
+        }
+    });
 }
 
 string Image::image_root() const
@@ -108,57 +148,107 @@ string Image::source_path() const
     return s.str();
 }
 
-void Post::extend(nlohmann::json& j)
+void Post::extend(JSONReader& r)
 {
-    PARSE_OPT(editing);
-    PARSE_OPT(deleted);
-    PARSE_OPT(sage);
-    PARSE_OPT(banned);
-    PARSE_OPT(sticky);
-    PARSE_OPT(locked);
-
-    id = j["id"];
-    PARSE_OPT(op);
-    time = j["time"];
-
-    body = j["body"];
-    PARSE_OPT(board);
-    PARSE_OPT_STRING(name);
-    PARSE_OPT_STRING(trip);
-    PARSE_OPT_STRING(auth);
-    PARSE_OPT_STRING(flag);
-    if (j.count("posterID")) {
-        poster_id = j["posterID"].get<string>();
-    }
+    r.read_object([&](std::string_view key) {
+        if (!decode_field(key, r)) {
+            r.skip();
+        }
+    });
+    touch();
+}
 
-    if (j.count("image")) {
-        image = Image(j["image"]);
+bool Post::decode_field(std::string_view key, JSONReader& r)
+{
+    // Optional strings may be explicitly null
+    auto read_opt_string = [&r](std::optional<string>& dst) {
+        if (r.read_null()) {
+            dst = std::nullopt;
+        } else {
+            dst = string(r.read_string());
+        }
+    };
+
+    if (key == "editing") {
+        editing = r.read_bool();
+    } else if (key == "deleted") {
+        deleted = r.read_bool();
+    } else if (key == "sage") {
+        sage = r.read_bool();
+    } else if (key == "banned") {
+        banned = r.read_bool();
+    } else if (key == "sticky") {
+        sticky = r.read_bool();
+    } else if (key == "locked") {
+        locked = r.read_bool();
+    } else if (key == "id") {
+        id = r.read_uint();
+    } else if (key == "op") {
+        op = r.read_uint();
+    } else if (key == "time") {
+        time = r.read_int();
+    } else if (key == "body") {
+        body = r.read_string();
+    } else if (key == "board") {
+        board = r.read_string();
+    } else if (key == "name") {
+        read_opt_string(name);
+    } else if (key == "trip") {
+        read_opt_string(trip);
+    } else if (key == "auth") {
+        read_opt_string(auth);
+    } else if (key == "flag") {
+        read_opt_string(flag);
+    } else if (key == "posterID") {
+        read_opt_string(poster_id);
+    } else if (key == "image") {
+        if (r.read_null()) {
+            image = std::nullopt;
+        } else {
+            image = Image(r);
+        }
+    } else if (key == "commands") {
+        parse_commands(r);
+    } else if (key == "links") {
+        parse_links(r);
+    } else {
+        return false;
     }
-    parse_commands(j);
-    parse_links(j);
+    return true;
 }
 
-void Post::parse_links(nlohmann::json& j)
+void Post::parse_links(JSONReader& r)
 {
-    if (j.count("links")) {
-        auto& l = j["links"];
-        links.reserve(l.size());
-        for (auto& val : l) {
-            links[val["id"]] = { false, val["op"], val["board"] };
-        }
+    if (r.read_null()) {
+        return;
     }
+    r.read_array([&]() {
+        unsigned long id = 0;
+        LinkData data;
+        r.read_object([&](std::string_view key) {
+            if (key == "id") {
+                id = r.read_uint();
+            } else if (key == "op") {
+                data.op = r.read_uint();
+            } else if (key == "board") {
+                data.board = r.read_string();
+            } else {
+                r.skip();
+            }
+        });
+        links[id] = std::move(data);
+    });
+    touch();
 }
 
-void Post::parse_commands(nlohmann::json& j)
+void Post::parse_commands(JSONReader& r)
 {
-    if (j.count("commands")) {
-        auto& c = j["commands"];
-        commands.clear(); // Not to duplicate existing entries
-        commands.reserve(c.size());
-        for (auto& com : c) {
-            commands.push_back(Command(com));
-        }
+    commands.clear(); // Not to duplicate existing entries
+    touch();
+    if (r.read_null()) {
+        return;
     }
+    r.read_array([&]() { commands.emplace_back(r); });
 }
 
 void Post::propagate_links()
@@ -166,16 +256,26 @@ void Post::propagate_links()
 
     // TODO: Notify about replies, if this post links to one of the user's posts
 
+    bool links_hidden = false;
     for (auto && [ id, _ ] : links) {
-        if (posts.count(id)) {
-            auto& target = posts.at(id);
-            target.backlinks[this->id] = LinkData{ false, op, board };
-            target.patch();
+        link_graph.link(this->id, id);
+        if (auto p = posts.find(id); p) {
+            // Only rerender targets not already backlinking this post
+            auto& target = *p;
+            if (target.backlinks
+                    .try_emplace(this->id, LinkData{ false, op, board })
+                    .second) {
+                target.touch();
+                target.patch();
+            }
         }
         if (post_ids.hidden.count(id)) {
-            hide_recursively(*this);
+            links_hidden = true;
         }
     }
+    if (links_hidden && options.hide_recursively) {
+        hide_recursively(*this);
+    }
 }
 
 void Post::patch()
@@ -185,8 +285,23 @@ void Post::patch()
     }
 }
 
+void Post::patch_time()
+{
+    // Inlined posts are rendered by their parent, so the parent has to be
+    // rerendered as if changed
+    if (inlined_into) {
+        touch();
+        patch();
+        return;
+    }
+    for (auto& v : views) {
+        v->patch_time();
+    }
+}
+
 void Post::close()
 {
     editing = false;
+    touch();
     patch();
 }
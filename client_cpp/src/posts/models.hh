@@ -1,9 +1,11 @@
 #pragma once
 
+#include "../../brunhild/view.hh"
+#include "../json_reader.hh"
 #include <array>
 #include <functional>
 #include <map>
-#include <nlohmann/json.hpp>
+#include <memory>
 #include <optional>
 #include <stdint.h>
 #include <string>
@@ -70,8 +72,12 @@ struct Image {
 
     Image() = default;
 
-    // Parse from JSON
-    Image(nlohmann::json&);
+    // Parse from a JSON object
+    Image(JSONReader&);
+
+    // Decode the value of a JSON object key. Returns false without consuming
+    // anything, if the key is not an image field.
+    bool decode_field(std::string_view key, JSONReader&);
 
     // Returns the path to this files's thumbnail
     std::string thumb_path() const;
@@ -105,8 +111,10 @@ public:
         val;
     std::string eight_ball; // Result of #8ball command
 
-    // Parse from JSON
-    Command(nlohmann::json&);
+    Command() = default;
+
+    // Parse from a JSON object. The "type" key must precede "val".
+    Command(JSONReader&);
 };
 
 // Data associated with link to another post. Is always pared in a map with
@@ -123,8 +131,9 @@ struct LinkData {
 
 class PostView;
 
-// Generic post model
-struct Post {
+// Generic post model. Any code modifying a stored post must call touch()
+// before patching it.
+struct Post : public brunhild::Versioned {
     // Post is currrently being edited
     bool editing = false,
          // Deleted by moderator
@@ -172,25 +181,34 @@ struct Post {
 
     Post() = default;
 
-    // Parse from JSON
-    Post(nlohmann::json& j) { extend(j); }
+    // Parse from a JSON object
+    Post(JSONReader& r) { extend(r); }
 
-    // Extend post data by parsing new values from JSON
-    void extend(nlohmann::json&);
+    // Extend post data by parsing new values from a JSON object
+    void extend(JSONReader&);
 
-    // Patches all views associated with this post
+    // Decode the value of a JSON object key. Returns false without consuming
+    // anything, if the key is not a post field.
+    bool decode_field(std::string_view key, JSONReader&);
+
+    // Patches all views associated with this post. Views of unchanged posts
+    // are not rerendered.
     void patch();
 
+    // Update the time-dependent elements of all views of this post, like
+    // syncwatches and relative timestamps, without rerendering them
+    void patch_time();
+
     // Check if this post replied to one of the user's posts and trigger
     // handlers.
     // Set and render backlinks on any linked posts.
     void propagate_links();
 
-    // Parse link data from JSON
-    void parse_links(nlohmann::json&);
+    // Parse link data from a JSON array and merge it into links
+    void parse_links(JSONReader&);
 
-    // Parse hash command results from JSON
-    void parse_commands(nlohmann::json&);
+    // Parse hash command results from a JSON array and replace commands
+    void parse_commands(JSONReader&);
 
     // Close a post being edited
     void close();
@@ -16,29 +16,14 @@ static optional<Node> render_omitted(unsigned long id, std::string board)
         return {};
     }
     auto const& t = threads.at(id);
-
-    // Collect all posts for this thread
-    std::vector<Post*> owned;
-    owned.reserve(32);
-    for (auto & [ _, p ] : posts) {
-        if (p.op == id) {
-            owned.push_back(&p);
-        }
-    }
+    auto const& loaded = get_thread_posts(id);
 
     // Calculate omitted posts and images
-    long omit = long(t.post_ctr) - owned.size();
-    long image_omit = 0;
-    if (omit) {
-        image_omit = t.image_ctr;
-        for (auto p : owned) {
-            if (p->image) {
-                image_omit--;
-            }
-        }
-    } else {
+    const long omit = long(t.post_ctr) - long(loaded.posts.size());
+    if (!omit) {
         return {};
     }
+    const long image_omit = long(t.image_ctr) - long(loaded.image_count);
 
     std::ostringstream s;
     s << pluralize(omit, "post") << ' ' << lang.posts.at("and") << ' '
@@ -58,6 +43,7 @@ static optional<Node> render_omitted(unsigned long id, std::string board)
 
 Node PostView::render(Post* m)
 {
+    syncwatches.clear();
     if (post_ids.hidden.count(m->id)) {
         return { "article", { { "hidden", "" } } };
     }
@@ -84,11 +70,11 @@ Node PostView::render(Post* m)
         if ((!options.hide_thumbs && !options.work_mode_toggle)
             || reveal_thumbnail) {
             auto[figure, audio] = render_image();
-            pc_ch.push_back(figure);
+            pc_ch.push_back(std::move(figure));
 
             // Will be false almost always, so need to reserve memory for this
             if (audio) {
-                pc_ch.push_back(*audio);
+                pc_ch.push_back(std::move(*audio));
             }
         }
     }
@@ -97,19 +83,22 @@ Node PostView::render(Post* m)
         n.children.push_back(
             { "b", { { "class", "admin banned" } }, lang.posts.at("banned") });
     }
-    n.children.push_back({ "div", { { "class", "post-container" } }, pc_ch });
+    n.children.push_back({ "div", { { "class", "post-container" } }, std::move(pc_ch) });
 
     if (m->id == m->op) {
         if (auto omit = render_omitted(m->id, m->board); omit) {
-            n.children.push_back(*omit);
+            n.children.push_back(std::move(*omit));
         }
     }
     if (m->backlinks.size()) {
         Node bl("span", { { "class", "backlinks" } });
         for (auto && [ id, data ] : m->backlinks) {
-            bl.children.push_back(render_link(id, data));
+            // Keyed by post ID, so inserting a backlink in the middle does
+            // not rerender its siblings
+            auto& ch = bl.children.emplace_back(render_link(id, data));
+            ch.key = id;
         }
-        n.children.push_back(bl);
+        n.children.push_back(std::move(bl));
     }
 
     return n;
@@ -0,0 +1,101 @@
+#include "store.hh"
+#include <stdexcept>
+
+PostStore::PostStore() { index.assign(64, none); }
+
+PostStore::~PostStore() { clear(); }
+
+size_t PostStore::hash(unsigned long id) const
+{
+    // Fibonacci hashing. Post IDs are mostly sequential, so the multiplication
+    // spreads them over the table.
+    return size_t((uint64_t(id) * 0x9E3779B97F4A7C15ull) >> 32)
+        & (index.size() - 1);
+}
+
+size_t PostStore::probe(unsigned long id) const
+{
+    const size_t mask = index.size() - 1;
+    size_t i = hash(id);
+    while (index[i] != none && meta[index[i]].id != id) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+uint32_t PostStore::lookup(unsigned long id) const
+{
+    if (!id) {
+        return none;
+    }
+    return index[probe(id)];
+}
+
+Post* PostStore::find(unsigned long id)
+{
+    const auto slot = lookup(id);
+    return slot == none ? nullptr : slot_ptr(slot);
+}
+
+Post& PostStore::at(unsigned long id)
+{
+    if (auto p = find(id); p) {
+        return *p;
+    }
+    throw std::out_of_range("post not loaded");
+}
+
+uint32_t PostStore::alloc_slot()
+{
+    const uint32_t slot = meta.size();
+    if (slot % chunk_size == 0) {
+        chunks.emplace_back(new Chunk);
+    }
+    meta.emplace_back();
+    return slot;
+}
+
+std::pair<Post*, bool> PostStore::insert(Post&& p)
+{
+    auto i = probe(p.id);
+    if (index[i] != none) {
+        return { slot_ptr(index[i]), false };
+    }
+
+    const auto slot = alloc_slot();
+    meta[slot].id = p.id;
+    Post* stored = new (slot_ptr(slot)) Post(std::move(p));
+    index[i] = slot;
+    if (++live << 1 > index.size()) {
+        grow();
+    }
+    return { stored, true };
+}
+
+void PostStore::clear()
+{
+    for (uint32_t slot = 0; slot < meta.size(); slot++) {
+        slot_ptr(slot)->~Post();
+    }
+    meta.clear();
+    chunks.clear();
+    live = 0;
+    index.assign(64, none);
+}
+
+void PostStore::grow()
+{
+    index.assign(index.size() << 1, none);
+    const size_t mask = index.size() - 1;
+    for (uint32_t slot = 0; slot < meta.size(); slot++) {
+        size_t i = hash(meta[slot].id);
+        while (index[i] != none) {
+            i = (i + 1) & mask;
+        }
+        index[i] = slot;
+    }
+}
+
+PostStore::iterator PostStore::begin() { return iterator(this, 0); }
+
+PostStore::iterator PostStore::end() { return iterator(this, meta.size()); }
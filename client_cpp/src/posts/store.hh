@@ -0,0 +1,112 @@
+#pragma once
+
+#include "models.hh"
+#include <memory>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+// Storage for loaded posts. Posts are kept in fixed-size chunks, so they never
+// move in memory and pointers to them stay valid until the store is
+// cleared. Hot metadata
+// used for lookups and filtering is kept separately in a dense array, so
+// probing and iteration do not need to touch the much larger Post structs.
+class PostStore {
+public:
+    class iterator;
+
+    PostStore();
+    ~PostStore();
+    PostStore(const PostStore&) = delete;
+    PostStore& operator=(const PostStore&) = delete;
+
+    // Returns a pointer to the post or NULL, if not loaded
+    Post* find(unsigned long id);
+
+    // Returns, if a post is loaded
+    bool count(unsigned long id) const { return lookup(id) != none; }
+
+    // Returns a reference to a loaded post. Throws std::out_of_range, if not
+    // loaded.
+    Post& at(unsigned long id);
+
+    // Returns the post with the same ID as p or inserts p, if none.
+    // The bool is true, if p was inserted.
+    std::pair<Post*, bool> insert(Post&& p);
+
+    // Remove all posts
+    void clear();
+
+    size_t size() const { return live; }
+
+    // Iterates posts in unspecified order
+    iterator begin();
+    iterator end();
+
+private:
+    static constexpr uint32_t none = uint32_t(-1);
+    static constexpr size_t chunk_size = 256;
+
+    // Hot metadata of a storage slot
+    struct Meta {
+        unsigned long id = 0;
+    };
+    std::vector<Meta> meta;
+
+    // Post storage. Slots are only constructed while in use.
+    struct Chunk {
+        alignas(Post) unsigned char buf[chunk_size * sizeof(Post)];
+    };
+    std::vector<std::unique_ptr<Chunk>> chunks;
+
+    size_t live = 0;
+
+    // Open addressing hash table of slot indices keyed by post ID with linear
+    // probing. Empty entries are none. Kept at most half full.
+    std::vector<uint32_t> index;
+
+    Post* slot_ptr(uint32_t slot) const
+    {
+        return reinterpret_cast<Post*>(chunks[slot / chunk_size]->buf) + slot
+            % chunk_size;
+    }
+
+    size_t hash(unsigned long id) const;
+
+    // Returns the slot of a post or none
+    uint32_t lookup(unsigned long id) const;
+
+    // Returns the index position of a post ID or the empty position, it
+    // would be inserted at
+    size_t probe(unsigned long id) const;
+
+    // Double index capacity and reinsert all entries
+    void grow();
+
+    // Allocate a new slot
+    uint32_t alloc_slot();
+};
+
+class PostStore::iterator {
+public:
+    iterator(PostStore* store, uint32_t slot)
+        : store(store)
+        , slot(slot)
+    {
+    }
+
+    Post& operator*() const { return *store->slot_ptr(slot); }
+    Post* operator->() const { return store->slot_ptr(slot); }
+
+    iterator& operator++()
+    {
+        slot++;
+        return *this;
+    }
+
+    bool operator!=(const iterator& other) const { return slot != other.slot; }
+
+private:
+    PostStore* store;
+    uint32_t slot;
+};
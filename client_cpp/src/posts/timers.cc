@@ -0,0 +1,44 @@
+#include "timers.hh"
+#include "../../brunhild/mutations.hh"
+#include "../../brunhild/timer_wheel.hh"
+#include "../state.hh"
+
+// Posts pending an update by the Unix time of the update. Only the posts due
+// are visited each second, no matter how many are scheduled.
+static brunhild::TimerWheel wheel(std::time(0));
+
+// Unix time of the pending delayed frame request, if any
+static time_t next_tick = 0;
+
+// Request a frame in a second, unless one is already pending
+static void request_tick()
+{
+    const auto now = std::time(0);
+    if (next_tick <= now) {
+        next_tick = now + 1;
+        brunhild::request_frame_in(1000);
+    }
+}
+
+void schedule_post_update(unsigned long id, time_t at)
+{
+    wheel.schedule(id, at);
+    request_tick();
+}
+
+void update_post_timers()
+{
+    if (!wheel.size()) {
+        return;
+    }
+
+    // Posts might have been removed by now
+    wheel.advance(std::time(0), [](unsigned long id) {
+        if (auto p = posts.find(id); p) {
+            p->patch_time();
+        }
+    });
+    if (wheel.size()) {
+        request_tick();
+    }
+}
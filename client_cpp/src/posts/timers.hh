@@ -0,0 +1,12 @@
+#pragma once
+
+#include <ctime>
+
+// Schedule the time-dependent elements of a post, like syncwatches and
+// relative timestamps, to be updated at Unix time at. If the post is already
+// scheduled, the earlier time is kept.
+void schedule_post_update(unsigned long id, time_t at);
+
+// Update the time-dependent elements of all posts, that are due. Run before
+// each flush of DOM mutations.
+void update_post_timers();
@@ -1,10 +1,10 @@
 #include "url.hh"
 #include "etc.hh"
-#include <algorithm>
-#include <emscripten.h>
+#include <array>
+#include <cctype>
 #include <sstream>
-#include <tuple>
-#include <unordered_map>
+#include <stdint.h>
+#include <string>
 
 using std::nullopt;
 using std::optional;
@@ -18,20 +18,277 @@ using std::string_view;
 // Types of supported embed providers
 enum class Provider { Youtube, Soundcloud, Vimeo };
 
-// Call into JS to validate URL. Keeps us from depending on a parsing library
-// and increasing binary size.
-static bool validate_url(string_view url)
+// URI schemes links are rendered for
+enum class Scheme { http, https, ftp, ftps, bitcoin };
+
+// Components of a validated URI. Views into the parsed string.
+struct URI {
+    Scheme scheme;
+    string_view host, path, query;
+};
+
+// Character classes of RFC 3986 as bitmasks
+enum CharClass : uint8_t {
+    unreserved = 1,
+    sub_delim = 1 << 1,
+    hex_digit = 1 << 2,
+    digit = 1 << 3,
+};
+
+// Classes of all byte values. Non-ASCII bytes are treated as unreserved, as
+// browsers accept internationalized URLs (RFC 3987) and percent-encode them.
+static constexpr std::array<uint8_t, 256> char_classes = [] {
+    std::array<uint8_t, 256> c = {};
+    for (int i = 0x80; i < 256; i++) {
+        c[i] = unreserved;
+    }
+    for (int i = 'a'; i <= 'z'; i++) {
+        c[i] = unreserved;
+    }
+    for (int i = 'A'; i <= 'Z'; i++) {
+        c[i] = unreserved;
+    }
+    for (int i = '0'; i <= '9'; i++) {
+        c[i] = unreserved | hex_digit | digit;
+    }
+    for (int i = 0; i < 6; i++) {
+        c['a' + i] |= hex_digit;
+        c['A' + i] |= hex_digit;
+    }
+    for (char ch : { '-', '.', '_', '~' }) {
+        c[(uint8_t)ch] = unreserved;
+    }
+    for (char ch : { '!', '$', '&', '\'', '(', ')', '*', '+', ',', ';', '=' }) {
+        c[(uint8_t)ch] = sub_delim;
+    }
+    return c;
+}();
+
+static bool is(char ch, uint8_t classes)
 {
-    return (bool)EM_ASM_INT(
-        {
-            try {
-                new URL(UTF8ToString($0));
-                return true;
-            } catch (e) {
-                return false;
+    return char_classes[(uint8_t)ch] & classes;
+}
+
+// Strip prefix from s, if s starts with it
+static bool consume(string_view& s, string_view prefix)
+{
+    if (s.substr(0, prefix.size()) != prefix) {
+        return false;
+    }
+    s.remove_prefix(prefix.size());
+    return true;
+}
+
+// Return length of the leading run of s consisting of percent-encoded octets,
+// unreserved and sub-delimiter characters and any characters in extra
+static size_t span(string_view s, string_view extra)
+{
+    size_t i = 0;
+    while (i < s.size()) {
+        const char ch = s[i];
+        if (is(ch, unreserved | sub_delim) || extra.find(ch) != string::npos) {
+            i++;
+        } else if (ch == '%' && i + 2 < s.size() && is(s[i + 1], hex_digit)
+            && is(s[i + 2], hex_digit)) {
+            i += 3;
+        } else {
+            break;
+        }
+    }
+    return i;
+}
+
+// Parse and strip the scheme. Rejects most words on their first byte.
+static optional<Scheme> parse_scheme(string_view& s)
+{
+    if (!s.size()) {
+        return nullopt;
+    }
+    switch (s[0]) {
+    case 'h':
+        if (consume(s, "http:")) {
+            return Scheme::http;
+        }
+        if (consume(s, "https:")) {
+            return Scheme::https;
+        }
+        break;
+    case 'f':
+        if (consume(s, "ftp:")) {
+            return Scheme::ftp;
+        }
+        if (consume(s, "ftps:")) {
+            return Scheme::ftps;
+        }
+        break;
+    case 'b':
+        if (consume(s, "bitcoin:")) {
+            return Scheme::bitcoin;
+        }
+        break;
+    }
+    return nullopt;
+}
+
+// Validate the authority of a hierarchical URI and return its host
+static optional<string_view> parse_authority(string_view auth)
+{
+    if (const size_t i = auth.rfind('@'); i != string::npos) {
+        if (span(auth.substr(0, i), ":") != i) {
+            return nullopt;
+        }
+        auth.remove_prefix(i + 1);
+    }
+
+    string_view host;
+    if (auth.size() && auth[0] == '[') {
+        // IP literal
+        const size_t end = auth.find(']');
+        if (end == string::npos || end == 1) {
+            return nullopt;
+        }
+        host = auth.substr(0, end + 1);
+        for (char ch : auth.substr(1, end - 1)) {
+            if (!is(ch, hex_digit) && ch != ':' && ch != '.') {
+                return nullopt;
             }
-        },
-        string(url).c_str());
+        }
+    } else {
+        host = auth.substr(0, auth.find(':'));
+        if (!host.size() || span(host, "") != host.size()) {
+            return nullopt;
+        }
+    }
+
+    auth.remove_prefix(host.size());
+    if (consume(auth, ":")) {
+        for (char ch : auth) {
+            if (!is(ch, digit)) {
+                return nullopt;
+            }
+        }
+    } else if (auth.size()) {
+        return nullopt;
+    }
+    return host;
+}
+
+// Validate the structure of a URI according to RFC 3986 and split it into
+// components
+static optional<URI> parse_uri(string_view s)
+{
+    URI u;
+    if (auto scheme = parse_scheme(s)) {
+        u.scheme = *scheme;
+    } else {
+        return nullopt;
+    }
+
+    if (u.scheme == Scheme::bitcoin) {
+        // Rootless path with a non-empty address
+        u.path = s.substr(0, span(s, ":@/"));
+        if (!u.path.size() || u.path[0] == '/') {
+            return nullopt;
+        }
+    } else {
+        // Authority with a non-empty host followed by an absolute path
+        if (!consume(s, "//")) {
+            return nullopt;
+        }
+        const auto auth = s.substr(0, s.find_first_of("/?#"));
+        if (auto host = parse_authority(auth)) {
+            u.host = *host;
+        } else {
+            return nullopt;
+        }
+        s.remove_prefix(auth.size());
+        u.path = s.substr(0, span(s, ":@/"));
+    }
+    s.remove_prefix(u.path.size());
+
+    if (consume(s, "?")) {
+        u.query = s.substr(0, span(s, ":@/?"));
+        s.remove_prefix(u.query.size());
+    }
+    if (consume(s, "#")) {
+        s.remove_prefix(span(s, ":@/?"));
+    }
+    if (s.size()) {
+        return nullopt;
+    }
+    return u;
+}
+
+// Return, if host is domain or domain with a single subdomain label
+static bool match_host(string_view host, string_view domain)
+{
+    if (host.size() <= domain.size()) {
+        return host == domain;
+    }
+    const auto label = host.substr(0, host.size() - domain.size());
+    return host.substr(label.size()) == domain && label.back() == '.'
+        && label.find('.') == label.size() - 1;
+}
+
+// Return, if the query has a non-empty value for key
+static bool has_query_param(string_view query, string_view key)
+{
+    while (1) {
+        const size_t i = query.find('&');
+        auto param = query.substr(0, i);
+        if (consume(param, key) && consume(param, "=") && param.size()) {
+            return true;
+        }
+        if (i == string::npos) {
+            return false;
+        }
+        query.remove_prefix(i + 1);
+    }
+}
+
+// Return, if s starts with a character of a Youtube video ID
+static bool starts_with_video_id(string_view s)
+{
+    return s.size() && (isalnum((unsigned char)s[0]) || s[0] == '_'
+                           || s[0] == '-');
+}
+
+// Match URI to a supported embed provider. Equivalent to the following
+// patterns, but precompiled and anchored to the URI components:
+//
+// https?://(?:[^.]+\.)?youtube\.com/watch/?\?(?:.+&)?v=[^&]+
+// https?://(?:[^.]+\.)?(?:youtu\.be|youtube\.com/embed)/[a-zA-Z0-9_-]+
+// https?://soundcloud\.com/.*
+// https?://(?:www\.)?vimeo\.com/.+
+static optional<Provider> match_provider(const URI& u)
+{
+    if (u.scheme != Scheme::http && u.scheme != Scheme::https) {
+        return nullopt;
+    }
+
+    string_view path = u.path;
+    if (match_host(u.host, "youtube.com")) {
+        if ((path == "/watch" || path == "/watch/")
+            && has_query_param(u.query, "v")) {
+            return Provider::Youtube;
+        }
+        if (consume(path, "/embed/") && starts_with_video_id(path)) {
+            return Provider::Youtube;
+        }
+    } else if (match_host(u.host, "youtu.be")) {
+        if (consume(path, "/") && starts_with_video_id(path)) {
+            return Provider::Youtube;
+        }
+    } else if (u.host == "soundcloud.com") {
+        if (path.size()) {
+            return Provider::Soundcloud;
+        }
+    } else if (u.host == "vimeo.com" || u.host == "www.vimeo.com") {
+        if (path.size() > 1 || (path.size() && u.query.size())) {
+            return Provider::Vimeo;
+        }
+    }
+    return nullopt;
 }
 
 // Formatter for the noembed.com meta-provider
@@ -68,59 +325,14 @@ static Node format_noembed(const Provider prov, const string href)
     };
 }
 
-// Parse for presence of embed links. Returns Node, if valid URL found.
-static optional<Node> parse_embeds(string_view word)
-{
-    if (!validate_url(word)) {
-        return nullopt;
-    }
-
-    // URL matching patterns for their respective providers
-    const static std::tuple<Provider, char const*> patterns[4] = {
-        { Provider::Youtube,
-            R"'(https?:\/\/(?:[^\.]+\.)?youtube\.com\/watch\/?\?(?:.+&)?v=[^&]+)'" },
-        { Provider::Youtube,
-            R"'(https?:\/\/(?:[^\.]+\.)?(?:youtu\.be|youtube\.com\/embed)\/[a-zA-Z0-9_-]+)'" },
-        { Provider::Soundcloud, R"'(https?:\/\/soundcloud.com\/.*)'" },
-        { Provider::Vimeo, R"'(https?:\/\/(?:www\.)?vimeo\.com\/.+)'" },
-    };
-
-    const string href(word);
-    for (auto && [ prov, pat ] : patterns) {
-        // Call into JS, to avoid including <regex> and bloating the binary
-        const bool match = (bool)EM_ASM_INT(
-            {
-                // TODO: Don't recompile RegExp on each call
-                return new RegExp(UTF8ToString($0)).test(UTF8ToString($1));
-            },
-            pat, href.c_str());
-        if (match) {
-            return { format_noembed(prov, href) };
-        }
-    }
-
-    return nullopt;
-}
-
 optional<Node> parse_url(string_view word)
 {
-    if (auto n = parse_embeds(word)) {
-        return n;
-    }
-
-    const static string allowed_prefixes[5]
-        = { "http:", "https:", "ftp:", "ftps:", "bitcoin:" };
-
-    bool valid = false;
-    for (auto& pre : allowed_prefixes) {
-        if (std::equal(pre.begin(), pre.end(), word.begin())) {
-            valid = true;
-            break;
-        }
-    }
-    if (!valid || !validate_url(word)) {
+    const auto uri = parse_uri(word);
+    if (!uri) {
         return nullopt;
     }
-    // Don't open a new tab for magnet links
-    return { render_link(word, word, word[0] != 'm') };
+    if (auto prov = match_provider(*uri)) {
+        return { format_noembed(*prov, string(word)) };
+    }
+    return { render_link(word, word) };
 }
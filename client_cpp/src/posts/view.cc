@@ -1,21 +1,67 @@
 #include "view.hh"
+#include "../options/options.hh"
 #include "../state.hh"
 
 Post* PostView::get_model()
 {
-    return posts.count(model_id) ? &posts.at(model_id) : NULL;
+    return posts.find(model_id);
 }
 
 void PostView::patch()
 {
-    // Proxy to top-most parent post, if inlined
+    // Proxy to top-most parent post, if inlined. The parent renders this
+    // post, so it changes with it.
     if (const auto inlined_into = get_model()->inlined_into; inlined_into) {
-        return posts.at(inlined_into).patch();
+        if (!is_current()) {
+            auto& parent = posts.at(inlined_into);
+            parent.touch();
+            parent.patch();
+        }
+        return;
     }
 
     ModelView::patch();
 }
 
+// Call fn on each time element and syncwatch in the subtree of n in document
+// order. Posts inlined into n are not descended into, as they schedule their
+// own updates.
+template <class F> static void find_timed(Node& n, F fn)
+{
+    for (auto& ch : n.children) {
+        if (ch.tag == "time") {
+            fn(ch);
+        } else if (ch.tag == "strong") {
+            if (auto it = ch.attrs.find("class");
+                it != ch.attrs.end() && it->second == "embed syncwatch") {
+                fn(ch);
+            }
+        } else if (ch.tag != "article") {
+            find_timed(ch, fn);
+        }
+    }
+}
+
+void PostView::patch_time()
+{
+    if (!is_current()) {
+        patch();
+        return;
+    }
+
+    m = get_model();
+    size_t i = 0;
+    find_timed(saved, [&](Node& n) {
+        if (n.tag == "time") {
+            if (options.relative_time) {
+                patch_node(n, render_time());
+            }
+        } else if (i < syncwatches.size()) {
+            patch_node(n, render_syncwatch(syncwatches[i++]));
+        }
+    });
+}
+
 void TextState::reset(Node* root)
 {
     spoiler = false;
@@ -27,6 +73,7 @@ void TextState::reset(Node* root)
     blue = false;
     have_syncwatch = false;
     successive_newlines = 0;
+    code_lang = CodeLang::any;
     dice_index = 0;
     buf.clear();
     parents.clear();
@@ -44,7 +91,7 @@ void TextState::append(Node n, bool descend, unsigned gt_count)
     // Flush pending text node
     flush_text();
 
-    parents.back()->children.push_back(n);
+    parents.back()->children.push_back(std::move(n));
     if (descend) {
         parents.push_back(&parents.back()->children.back());
     }
@@ -61,6 +108,6 @@ void TextState::flush_text()
     if (buf.size()) {
         Node n("span", buf, true);
         buf.clear();
-        append(n);
+        append(std::move(n));
     }
 }
@@ -2,10 +2,23 @@
 
 #include "../../brunhild/view.hh"
 #include "models.hh"
+#include <array>
 #include <memory>
+#include <optional>
+#include <stdint.h>
+#include <string_view>
+#include <tuple>
+#include <vector>
 
 using brunhild::Node;
 
+// Languages with their own keyword sets for code highlighting. Selected by a
+// hint following the opening code tag on its own line, like "``js".
+enum class CodeLang : uint8_t { any, c, cpp, go, js, py, rust };
+
+// Parse the name of a language hint
+std::optional<CodeLang> parse_code_lang(std::string_view name);
+
 // State of a post's text. Used for adding enclosing tags to the HTML while
 // parsing.
 class TextState {
@@ -19,6 +32,7 @@ public:
         blue = false, // Text inside blue color tag
         have_syncwatch = false; // Text contains #syncwatch command(s)
     int successive_newlines = 0; // Number of successive newlines in text
+    CodeLang code_lang = CodeLang::any; // Language of the code block
     size_t dice_index = 0; // Index of the next dice array item to use
 
     // Used for building text nodes. Flushed on append() or ascend().
@@ -50,6 +64,23 @@ public:
         return { { spoiler, bold, italic, red, blue } };
     }
 
+    // State carried over from one line of text to the next
+    typedef std::tuple<bool, bool, bool, bool, bool, bool, int, CodeLang>
+        LineState;
+
+    LineState line_state() const
+    {
+        return { spoiler, code, bold, italic, red, blue, successive_newlines,
+            code_lang };
+    }
+
+    void set_line_state(const LineState& s)
+    {
+        std::tie(spoiler, code, bold, italic, red, blue, successive_newlines,
+            code_lang)
+            = s;
+    }
+
 private:
     // Last child nodes of the blockquote subtree.
     // Used to keep track of nodes to append to, while populating the
@@ -78,11 +109,47 @@ public:
     // delegate the patch to the topmost parent.
     void patch();
 
+    // Update the time-dependent elements of the post in the DOM, like
+    // syncwatches and relative timestamps, by patching only their subtrees.
+    // Patches the entire post, if it changed since the last render.
+    void patch_time();
+
     Post* get_model();
 
 private:
+    // Renders bodies with the previous parser for differential fuzzing in
+    // native/
+    friend class ReferenceBody;
+
     TextState state;
 
+    // Rendered line of an open post's body. Reused as long as the line and
+    // the state it is parsed in are unchanged, so typing into a post only
+    // reparses lines from the edited one onward.
+    struct CachedLine {
+        // Hash of the line's text
+        size_t hash;
+
+        // Line is the first of the body
+        bool first;
+
+        // Text state before and after the line
+        TextState::LineState in, out;
+
+        // Nodes appended to the body by the line
+        brunhild::Children nodes;
+    };
+
+    // Rendered lines of the body by line index
+    std::vector<CachedLine> line_cache;
+
+    // render_epoch line_cache was populated in
+    uint64_t line_cache_epoch = 0;
+
+    // Arguments of the syncwatches in the body in document order. Used to
+    // update their countdowns without rerendering the body.
+    std::vector<std::array<unsigned long, 5>> syncwatches;
+
     // Posts inlined into this post's links
     std::unordered_map<unsigned long, std::unique_ptr<PostView>> inlined_posts;
 
@@ -113,6 +180,9 @@ private:
     // Render the text body of a post
     Node render_body();
 
+    // Render a line of the body
+    void render_line(std::string_view line, bool first);
+
     // Parse temporary links in open posts, that still may be edited
     void parse_temp_links(std::string_view);
 
@@ -122,34 +192,18 @@ private:
     // Highlight common programming code syntax
     void highlight_syntax(std::string_view);
 
-    // Function run on a separated string fragment
-    typedef std::function<void(std::string_view)> OnFrag;
-
-    // Detect and format code tags. Call fn on unmatched sub-fragments.
-    void parse_code(std::string_view frag, OnFrag fn);
-
-    // Inject spoiler tags and call fn on the remaining parts
-    void parse_spoilers(std::string_view frag, OnFrag fn);
+    // Parse a line's formatting tags in a single pass and pass the text
+    // between them to parse_temp_links() or parse_fragment() or, inside
+    // code tags, to highlight_syntax()
+    void parse_formatting(std::string_view line);
 
     // Open and close any tags up to level, if they are set.
     // Increment level by 1 for each tag deeper you go.
     void wrap_tags(int level);
 
-    // Inject bold tags and call fn on the remaining parts
-    void parse_bolds(std::string_view frag, OnFrag fn);
-
-    // Inject italic tags and call fn on the remaining parts
-    void parse_italics(std::string_view frag, OnFrag fn);
-
-    // Inject red color tags and call fn on the remaining parts
-    void parse_reds(std::string_view frag, OnFrag fn);
-
-    // Inject red color tags and call fn on the remaining parts
-    void parse_blues(std::string_view frag, OnFrag fn);
-
     // Parse a string into words and call fn on each word.
     // Handles space padding and leading/trailing punctuation.
-    void parse_words(std::string_view frag, OnFrag fn);
+    template <class F> void parse_words(std::string_view frag, F fn);
 
     // Parse internally-defined or board reference URL.
     // Returns preceding '>' count and link Node, if matched.
@@ -163,4 +217,8 @@ private:
 
     // Parse syncwatch command and return Node, if matched
     std::optional<Node> parse_syncwatch(std::string_view frag);
+
+    // Render the countdown of a syncwatch and schedule its next update, if
+    // not finished
+    Node render_syncwatch(const std::array<unsigned long, 5>& args);
 };
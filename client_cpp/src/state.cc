@@ -1,13 +1,17 @@
 #include "state.hh"
+#include "../brunhild/view.hh"
+#include "decoder.hh"
 #include "lang.hh"
 #include "options/options.hh"
 #include "page/page.hh"
 #include "posts/models.hh"
 #include "util.hh"
+#include <algorithm>
 #include <array>
 #include <emscripten.h>
 #include <emscripten/bind.h>
 #include <map>
+#include <stdexcept>
 #include <string_view>
 #include <unordered_map>
 #include <unordered_set>
@@ -34,47 +38,164 @@ static void extract_backlinks(const Post& p, Backlinks& backlinks)
 // Extract thread data from JSON and populate post collection.
 // Places inverse post links into backlinks for later assignment to individual
 // post models.
-static void extract_thread(json& j, Backlinks& backlinks)
+static void extract_thread(JSONReader& r, Backlinks& backlinks)
 {
-    // TODO: Homogenize board and thread page data structure
-    auto thread = ThreadDecoder(j);
-    auto op = page.thread ? thread.posts[0] : Post(j);
-    const string board = thread.board;
-    const unsigned long thread_id = op.id;
-    op.op = thread_id;
-    op.board = board;
-    extract_backlinks(op, backlinks);
-    (threads)[thread_id] = static_cast<Thread>(thread);
-    (posts)[thread_id] = std::move(op);
-
-    for (auto post : thread.posts) {
-        post.board = board;
+    auto thread = ThreadDecoder(r);
+    if (thread.posts.empty()) {
+        return;
+    }
+    const unsigned long thread_id = thread.posts.front().id;
+    for (auto& post : thread.posts) {
+        post.board = thread.board;
         post.op = thread_id;
         extract_backlinks(post, backlinks);
-        (posts)[post.id] = post;
+        store_post(std::move(post));
+    }
+    thread.posts.clear();
+    (threads)[thread_id] = static_cast<Thread>(thread);
+}
+
+// Orders post pointers by post ID
+static bool id_less(const Post* a, unsigned long id) { return a->id < id; }
+
+// Add a post to the index of its thread
+static void index_post(Post& p)
+{
+    auto& t = thread_posts[p.op];
+    if (t.posts.empty() || t.posts.back()->id < p.id) {
+        // Posts mostly arrive in order
+        t.posts.push_back(&p);
+    } else {
+        t.posts.insert(
+            std::lower_bound(t.posts.begin(), t.posts.end(), p.id, id_less),
+            &p);
+    }
+    if (p.image) {
+        t.image_count++;
+    }
+}
+
+// Remove a post from the index of its thread
+static void unindex_post(Post& p)
+{
+    auto& t = thread_posts[p.op];
+    auto it = std::lower_bound(t.posts.begin(), t.posts.end(), p.id, id_less);
+    if (it != t.posts.end() && *it == &p) {
+        t.posts.erase(it);
+        if (p.image) {
+            t.image_count--;
+        }
+    }
+}
+
+Post& store_post(Post&& p)
+{
+    if (auto found = posts.find(p.id); found) {
+        // Replace in place, so the post keeps its address
+        auto& stored = *found;
+        if (stored.op == p.op) {
+            thread_posts[p.op].image_count += bool(p.image);
+            thread_posts[p.op].image_count -= bool(stored.image);
+            stored = std::move(p);
+        } else {
+            unindex_post(stored);
+            stored = std::move(p);
+            index_post(stored);
+        }
+        link_graph.set_links(stored.id, stored.links);
+        return stored;
     }
+
+    auto& stored = *posts.insert(std::move(p)).first;
+    index_post(stored);
+    link_graph.set_links(stored.id, stored.links);
+    return stored;
 }
 
-void load_posts(std::string_view data)
+void set_post_image(Post& p, std::optional<Image> image)
+{
+    auto& t = thread_posts[p.op];
+    t.image_count += bool(image);
+    t.image_count -= bool(p.image);
+    p.image = std::move(image);
+}
+
+const ThreadPosts& get_thread_posts(unsigned long thread_id)
+{
+    static const ThreadPosts empty;
+    if (auto it = thread_posts.find(thread_id); it != thread_posts.end()) {
+        return it->second;
+    }
+    return empty;
+}
+
+void clear_posts()
+{
+    posts.clear();
+    threads.clear();
+    thread_posts.clear();
+    link_graph.clear();
+}
+
+// Decode threads from a binary payload directly into the post collection.
+// Places inverse post links into backlinks for later assignment to individual
+// post models.
+static void extract_binary(std::string_view data, Backlinks& backlinks)
+{
+    BinaryDecoder d(data);
+    d.read_byte(); // Tag
+    if (d.read_byte() != binary_payload_version) {
+        throw std::runtime_error("unsupported binary post payload version");
+    }
+    const auto page_total = d.read_uint();
+    if (!page.thread) {
+        page.page_total = page_total;
+    }
+
+    const auto thread_count = d.read_count();
+    for (size_t i = 0; i < thread_count; i++) {
+        auto t = d.read_thread();
+        const auto post_count = d.read_count();
+        for (size_t j = 0; j < post_count; j++) {
+            auto p = d.read_post();
+            p.op = t.id;
+            p.board = t.board;
+            extract_backlinks(p, backlinks);
+            store_post(std::move(p));
+        }
+        threads[t.id] = std::move(t);
+    }
+}
+
+void load_posts(char* data, size_t size)
 {
     Backlinks backlinks;
     backlinks.reserve(128);
-    auto j = json::parse(data);
-    if (page.thread) {
-        extract_thread(j, backlinks);
+    if (size && data[0] == binary_payload_tag) {
+        extract_binary(std::string_view(data, size), backlinks);
     } else {
-        page.page_total = j["pages"];
-        for (auto& thread : j["threads"]) {
-            extract_thread(thread, backlinks);
-        }
+        JSONReader r(data, size);
+        if (page.thread) {
+            extract_thread(r, backlinks);
+        } else {
+            r.read_object([&](std::string_view key) {
+                if (key == "pages") {
+                    page.page_total = r.read_uint();
+                } else if (key == "threads") {
+                    r.read_array([&]() { extract_thread(r, backlinks); });
+                } else {
+                    r.skip();
+                }
+            });
 
-        // TODO: Catalog pages
+            // TODO: Catalog pages
+        }
     }
 
     // Assign backlinks to their post models
     for (auto [target_id, data] : backlinks) {
-        if (posts.count(target_id)) {
-            posts.at(target_id).backlinks = std::move(data);
+        if (auto p = posts.find(target_id); p) {
+            p->backlinks = std::move(data);
         }
     }
 }
@@ -83,19 +204,18 @@ void load_state()
 {
     // Order is important to prevent race conditions
 
-    debug = val::global("location")["search"].as<string>().find("debug=true")
-        != string::npos;
-    auto location = val::global("location");
+    auto location = val::global("brunhild").call<val>("location");
+    debug = location["search"].as<string>().find("debug=true") != string::npos;
     location_origin = location["origin"].as<string>();
     page = { location["href"].as<string>().substr(location_origin.size()) };
     options.load();
     lang.load();
 
-    for (auto& pair : json::parse(get_inner_html("board-title-data"))) {
+    for (auto& pair : json::parse(get_page_data("board-title-data"))) {
         boards[pair["id"]] = pair["title"];
     }
 
-    config = { get_inner_html("conf-data") };
+    config = { get_page_data("conf-data") };
 }
 
 Config::Config(const c_string_view& s)
@@ -240,6 +360,9 @@ void add_to_storage(int typ, const std::vector<unsigned long> ids)
     }
     set->reserve(set->size() + ids.size());
     set->insert(ids.begin(), ids.end());
+
+    // Post rendering depends on these sets
+    brunhild::invalidate_views();
 }
 
 EMSCRIPTEN_BINDINGS(module_state)
@@ -248,33 +371,46 @@ EMSCRIPTEN_BINDINGS(module_state)
     emscripten::function("add_to_storage", &add_to_storage);
 }
 
-ThreadDecoder::ThreadDecoder(json& j)
+ThreadDecoder::ThreadDecoder(JSONReader& r)
 {
-// Decode a key, that may not be in the object
-#define OPT_DECODE(key)                                                        \
-    if (j.count(#key)) {                                                       \
-        key = j[#key];                                                         \
-    }
-
-    OPT_DECODE(deleted)
-    OPT_DECODE(locked)
-    OPT_DECODE(sticky)
-
-    // Redundant field on thread pages
-    id = page.thread ? page.thread : (unsigned long)(j["id"]);
-
-    post_ctr = j["postCtr"];
-    image_ctr = j["imageCtr"];
-    time = j["time"];
-    reply_time = j["replyTime"];
-    bump_time = j["bumpTime"];
-    board = j["board"];
-    subject = j["subject"];
-    if (!page.catalog) {
-        auto& p = j.at("posts");
-        posts.reserve(p.size());
-        for (auto& data : p) {
-            posts.push_back(Post(data));
+    // TODO: Homogenize board and thread page data structure
+    // On board pages the OP is inlined into the thread object. Fields shared
+    // by both are decoded into both.
+    Post op;
+    r.read_object([&](std::string_view key) {
+        if (key == "deleted") {
+            deleted = op.deleted = r.read_bool();
+        } else if (key == "locked") {
+            locked = op.locked = r.read_bool();
+        } else if (key == "sticky") {
+            sticky = op.sticky = r.read_bool();
+        } else if (key == "id") {
+            id = op.id = r.read_uint();
+        } else if (key == "time") {
+            time = op.time = r.read_int();
+        } else if (key == "board") {
+            board = op.board = r.read_string();
+        } else if (key == "postCtr") {
+            post_ctr = r.read_uint();
+        } else if (key == "imageCtr") {
+            image_ctr = r.read_uint();
+        } else if (key == "replyTime") {
+            reply_time = r.read_uint();
+        } else if (key == "bumpTime") {
+            bump_time = r.read_uint();
+        } else if (key == "subject") {
+            subject = r.read_string();
+        } else if (key == "posts" && !page.catalog) {
+            r.read_array([&]() { posts.emplace_back(r); });
+        } else if (!op.decode_field(key, r)) {
+            r.skip();
         }
+    });
+
+    if (page.thread) {
+        // Redundant field on thread pages. The OP is the first post.
+        id = page.thread;
+    } else {
+        posts.insert(posts.begin(), std::move(op));
     }
 }
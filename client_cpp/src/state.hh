@@ -1,6 +1,8 @@
 #pragma once
 
+#include "posts/link_graph.hh"
 #include "posts/models.hh"
+#include "posts/store.hh"
 #include "util.hh"
 #include <map>
 #include <nlohmann/json.hpp>
@@ -10,7 +12,7 @@
 
 // Contains all posts currently loaded on the page. Posts might or might not
 // be actually displayed.
-inline std::map<unsigned long, Post> posts;
+inline PostStore posts;
 
 // Caches the origin of the page
 inline std::string location_origin;
@@ -18,6 +20,40 @@ inline std::string location_origin;
 // Loaded thread metadata
 inline std::unordered_map<unsigned long, Thread> threads;
 
+// Loaded posts of a thread
+struct ThreadPosts {
+    // Posts ordered by ID. Includes the OP.
+    std::vector<Post*> posts;
+
+    // Number of posts with images
+    unsigned long image_count = 0;
+};
+
+// Index of loaded posts by thread ID. Maintained by store_post(),
+// set_post_image() and clear_posts(), so posts must only be added and have
+// their images changed through these.
+inline std::unordered_map<unsigned long, ThreadPosts> thread_posts;
+
+// Index of links between posts in both directions. Maintained by store_post(),
+// Post::propagate_links() and clear_posts(), so links of stored posts must
+// only be added through these.
+inline LinkGraph link_graph;
+
+// Insert a post into the posts collection, thread index and link graph or
+// replace an existing one with the same ID. Returns a reference to the stored post.
+Post& store_post(Post&& p);
+
+// Set or, if image is std::nullopt, remove the image of a post and update the
+// thread index
+void set_post_image(Post& p, std::optional<Image> image);
+
+// Returns the loaded posts of a thread. Returns an empty list, if the thread
+// has no loaded posts.
+const ThreadPosts& get_thread_posts(unsigned long thread_id);
+
+// Remove all posts, threads and their indices
+void clear_posts();
+
 // Debug mode. Can be enabled by setting the "debug=true" query string.
 inline bool debug = false;
 
@@ -78,10 +114,12 @@ inline Page page;
 // Load initial application state
 void load_state();
 
-// Load posts from inlined JSON. Returns a vector of detected thread IDs.
+// Load posts from JSON or a binary payload, as described in decoder.hh.
+// Binary payloads are detected by their leading tag byte. JSON strings are
+// unescaped in place, so the contents of data are modified.
 // TODO: Fetch this as binary data from the server. It is probably a good idea
 // to do this and configuration fetches in one request.
-void load_posts(std::string_view data);
+void load_posts(char* data, size_t size);
 
 // Stores post ID of various catagories
 struct PostIDs {
@@ -97,11 +135,11 @@ inline PostIDs post_ids;
 enum class StorageType : int { mine, seen_replies, seen_posts, hidden };
 
 // Used to decode thread JSON
-// TODO: Get rid of this in favour of a binary decoder
 class ThreadDecoder : public Thread {
 public:
+    // Posts of the thread. The first post is always the OP.
     std::vector<Post> posts;
 
-    // Parse from JSON
-    ThreadDecoder(nlohmann::json& j);
+    // Parse from a JSON object
+    ThreadDecoder(JSONReader& r);
 };
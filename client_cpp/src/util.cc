@@ -11,11 +11,11 @@
 using brunhild::Node;
 using std::string;
 
-c_string_view get_inner_html(const string& id)
+c_string_view get_page_data(const string& id)
 {
     return c_string_view((char*)EM_ASM_INT(
         {
-            var s = document.getElementById(UTF8ToString($0)).innerHTML;
+            var s = brunhild.pageData(UTF8ToString($0)) || '';
             var len = lengthBytesUTF8(s) + 1;
             var buf = Module._malloc(len);
             stringToUTF8(s, buf, len);
@@ -133,7 +133,7 @@ Node render_last_100_link(string board, unsigned long id)
 
 void alert(std::string msg)
 {
-    EM_ASM_INT({ alert(UTF8ToString($0)); }, msg.c_str());
+    EM_ASM({ brunhild.call('alert', [ UTF8ToString($0) ]); }, msg.c_str());
 }
 
 std::string to_lower(const std::string& s)
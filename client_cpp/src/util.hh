@@ -40,8 +40,9 @@ private:
     char* ch;
 };
 
-// Read inner HTML from DOM element by ID
-c_string_view get_inner_html(const std::string& id);
+// Read the contents of an embedded JSON data element by ID. Returns an empty
+// string, if there is no such element.
+c_string_view get_page_data(const std::string& id);
 
 // Return either the singular or plural form of a translation, depending on n.
 // word is the index used for finding the localization tuple.
@@ -100,7 +101,7 @@ private:
     ~WaitGroup() = default;
 };
 
-// Call the JS alert() function
+// Call the JS alert() function on the main thread
 void alert(std::string);
 
 // Convert string to lowercase